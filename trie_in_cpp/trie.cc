@@ -6,22 +6,71 @@
 
 
 
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+TrieImpl<Container, ContainerItr, NodeType, Policy>::~TrieImpl() {
+    for (Shard& shard : shards) {
+        // No thread can be reading now, so free directly rather than
+        // through any epoch deferral.
+        auto& direct = getDirectAllocator(shard);
+
+        // An allocator which releases everything when it is destroyed only
+        // needs the nodes visited if they (or their values) have destructors
+        // to run.
+        if (std::remove_reference<decltype(direct)>::type::releasesAll &&
+            std::is_trivially_destructible<NodeType>::value &&
+            !NodeType::releaseValues) {
+            continue;
+        }
+
+        // Free the nodes without recursion, a long key would otherwise mean
+        // an equally deep stack.
+        std::vector<NodeType*> pending;
+        shard.root.forEachChild([&pending](auto* child) {
+            pending.push_back(static_cast<NodeType*>(child));
+        });
+        while (!pending.empty()) {
+            NodeType* node = pending.back();
+            pending.pop_back();
+            node->forEachChild([&pending](auto* child) {
+                pending.push_back(static_cast<NodeType*>(child));
+            });
+            node->release(direct);
+            trieDelete(direct, node);
+        }
+        shard.root.release(direct);
+    }
+}
+
 /**
  * Protected
  * TrieCommon::findKey
  */
-template <typename Container, typename ContainerItr, typename NodeType>
-NodeType* TrieImpl<Container, ContainerItr, NodeType>::findKey(const ContainerItr begin,
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+NodeType* TrieImpl<Container, ContainerItr, NodeType, Policy>::findKey(const ContainerItr begin,
                                                                const ContainerItr end) {
-    std::lock_guard<std::mutex> lg(lock);
-    NodeType* node = &root;
+    static_assert(!Locking::optimistic, "findKey requires TrieMutexLocking, use visitKey");
+    Probe probe(instrumentation, TrieOp::Find);
+    Shard& shard = getShard(begin, end);
+    TrieReadLock<typename Locking::Mutex> lg(shard.lock);
+    probe.locked();
+    NodeType* node = &shard.root;
 
     // Iterate from root looking for each element of key
-    for (ContainerItr element = begin; element != end; element++) {
+    ContainerItr element = begin;
+    while (element != end) {
         NodeType* n = nullptr;
+        Instrumentation::countNode();
         if ((n = node->findChild(*element)) == nullptr) {
             return nullptr;
         }
+        element++;
+
+        // The whole edge must match, a key ending part way down an edge
+        // is not in the trie.
+        const auto segment = n->getSegmentView();
+        if (matchSegment(segment, element, end) != segment.length) {
+            return nullptr;
+        }
         node = n;
     }
 
@@ -29,54 +78,108 @@ NodeType* TrieImpl<Container, ContainerItr, NodeType>::findKey(const ContainerIt
     return node;
 }
 
-template <typename Container, typename ContainerItr, typename NodeType>
-NodeType* TrieImpl<Container, ContainerItr, NodeType>::insertKey(const Container& key) {
-    std::lock_guard<std::mutex> lg(lock);
-    NodeType* node = &root;
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::insertKey(const ContainerItr begin,
+                                                            const ContainerItr end,
+                                                            Visitor visit) {
+    Probe probe(instrumentation, TrieOp::Insert);
+    if constexpr (Locking::optimistic) {
+        insertOptimistic(begin, end, visit);
+        return;
+    }
+
+    Shard& shard = getShard(begin, end);
+    std::lock_guard<typename Locking::Mutex> lg(shard.lock);
+    probe.locked();
+    NodeType* node = &shard.root;
 
     // 1. Walk the trie looking for each element of key.
     // and stop when a node is found that has no child for the element.
-    auto it = key.begin();
+    auto it = begin;
     NodeType* n = nullptr;
-    while ((n = node->findChild(*it)) != nullptr) {
-        ////std::cout << "Found a node for " << *it <<std::endl;
-        node = n;
+    while (it != end) {
+        Instrumentation::countNode();
+        if ((n = node->findChild(*it)) == nullptr) {
+            break;
+        }
         it++; // next element of key
-    }
 
-    //std::cout << "Ended search at " << *it <<std::endl;
-    //std::cout << "Node = " << (node == &root ? '*' : node->getId()) << std::endl;
+        // If the key leaves the edge part way, split the edge so there is
+        // a node at the point the key ends or diverges.
+        const auto segment = n->getSegmentView();
+        uint32_t matched = matchSegment(segment, it, end);
+        if (matched != segment.length) {
+            n = splitNode(shard, node, n, matched);
+        }
+        node = n;
+    }
 
     // 2. If the key has more elements, add them to the node.
-    if (it != key.end()) {
-        do {
-            //std::cout << "Adding a node for " << *it <<std::endl;
-            NodeType* n = new NodeType(*it);
-            node->addChild(n);
-            node = n;
-        } while(++it != key.end());
+    if (it != end) {
+        NodeType* last = nullptr;
+        node->addChild(newTail(shard, it, end, last), shard.allocator);
+        node = last;
     }
 
     // 3. Mark that the final node terminates a key.
+    if (!node->isTerminator()) {
+        countKey(shard, static_cast<size_t>(end - begin), true);
+    }
     node->setTerminates(true);
 
-    // 4. Return the final node so that the sub-classes can work on it.
-    return node;
+    // 4. Let the sub-classes work on the final node.
+    visit(node, shard.allocator);
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+NodeType* TrieImpl<Container, ContainerItr, NodeType, Policy>::newTail(Shard& shard,
+                                                               ContainerItr it,
+                                                               const ContainerItr end,
+                                                               NodeType*& last) {
+    NodeType* first = newNode(shard, *it);
+    if (layout == TrieLayout::PathCompressed) {
+        // The tail of the key is unique, so it all goes in one node.
+        first->setSegment(it + 1, end, shard.allocator);
+        last = first;
+        return first;
+    }
+
+    last = first;
+    while (++it != end) {
+        NodeType* n = newNode(shard, *it);
+        last->addChild(n, shard.allocator);
+        last = n;
+    }
+    return first;
 }
 
-template <typename Container, typename ContainerItr, typename NodeType>
-NodeType* TrieImpl<Container, ContainerItr, NodeType>::prefixFindKey(const ContainerItr begin,
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+NodeType* TrieImpl<Container, ContainerItr, NodeType, Policy>::prefixFindKey(const ContainerItr begin,
                                                                      const ContainerItr end) {
-    std::lock_guard<std::mutex> lg(lock);
-    NodeType* node = &root;
+    static_assert(!Locking::optimistic, "prefixFindKey requires TrieMutexLocking, use visitPrefix");
+    Probe probe(instrumentation, TrieOp::PrefixFind);
+    Shard& shard = getShard(begin, end);
+    TrieReadLock<typename Locking::Mutex> lg(shard.lock);
+    probe.locked();
+    NodeType* node = &shard.root;
 
     // Iterate from root looking for each element of key
-    for (ContainerItr element = begin; element != end; element++) {
+    ContainerItr element = begin;
+    while (element != end) {
         NodeType* n = nullptr;
+        Instrumentation::countNode();
         if ((n = static_cast<NodeType*>(node->findChild(*element))) == nullptr) {
             // node doesn't contain element
             return nullptr;
         }
+        element++;
+
+        const auto segment = n->getSegmentView();
+        if (matchSegment(segment, element, end) != segment.length) {
+            // key diverges from (or ends within) the edge
+            return nullptr;
+        }
 
         node = n;
 
@@ -86,121 +189,1298 @@ NodeType* TrieImpl<Container, ContainerItr, NodeType>::prefixFindKey(const Conta
         }
     }
 
-    //std::cout << "HERE??\n";
     return nullptr;
 }
 
-template <typename Container, typename ContainerItr, typename NodeType>
-NodeType* TrieImpl<Container, ContainerItr, NodeType>::eraseKey(const Container& key) {
-    std::lock_guard<std::mutex> lg(lock);
-    auto itr = key.begin();
-
-    // If root has a child which matches the first element of key.
-    // Go ahead and try to delete.
-    NodeType* child = root.findChild(*itr);
-    if (child) {
-        // run delete node which will recurse the trie and determine how to remove
-        // the key
-        //std::cout << "Delete from " << child->getId() << " element " << *itr << std::endl;
-        NodeType* n = deleteNode(child, key, ++itr); // returns the last node of t
-
-        // insert(ham)
-        // deleteNode(ham) -> null
-
-        // insert(ham)
-        // insert(hamster)
-        // deleteNode(ham) -> m (and terminates cleared)
-
-        // insert(ham)
-        // insert(hamster)
-        // deleteNode(hamster) -> r
-
-        // insert(ham)
-        // deleteNode(ham) -> null
-
-
-        // Certain delete cases deleteNode isn't returning the last node
-        //   insert(ham)
-        //   insert(hamster)
-        //   remove(hamster) is returning m (of ham) and caller mustn't see it
-        //                   m is a terminator of ham.
-        // vs
-        //   insert(ham)
-        //   insert(hamster)
-        //   remove(ham) correctly returns m and triemap needs to deleteValue
-        // caller can only have returned value if it is not a terminator.
-        if (n && !n->isTerminator()) {
-            // n is not a terminator so caller can have it.
-            return n;
-        } else if (!n) {
-            root.unlinkChild(child->getId());
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::visitKey(const ContainerItr begin,
+                                                           const ContainerItr end,
+                                                           Visitor visit) {
+    if constexpr (Locking::optimistic) {
+        Probe probe(instrumentation, TrieOp::Find);
+        return visitOptimistic(begin, end, false, false, [&visit](NodeType* node, size_t) {
+            visit(node);
+        });
+    } else {
+        NodeType* node = findKey(begin, end);
+        if (!node || !node->isTerminator()) {
+            return false;
         }
+        visit(node);
+        return true;
     }
-    return nullptr;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::visitPrefix(const ContainerItr begin,
+                                                              const ContainerItr end,
+                                                              Visitor visit) {
+    if constexpr (Locking::optimistic) {
+        Probe probe(instrumentation, TrieOp::PrefixFind);
+        return visitOptimistic(begin, end, true, false, [&visit](NodeType* node, size_t) {
+            visit(node);
+        });
+    } else {
+        NodeType* node = prefixFindKey(begin, end);
+        if (!node) {
+            return false;
+        }
+        visit(node);
+        return true;
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::visitLongestPrefix(const ContainerItr begin,
+                                                                     const ContainerItr end,
+                                                                     Visitor visit) {
+    Probe probe(instrumentation, TrieOp::PrefixFind);
+    if constexpr (Locking::optimistic) {
+        return visitOptimistic(begin, end, true, true, visit);
+    } else {
+        Shard& shard = getShard(begin, end);
+        TrieReadLock<typename Locking::Mutex> lg(shard.lock);
+        probe.locked();
+        NodeType* longest = nullptr;
+        size_t longestLength = 0;
+        walkPrefixes(shard, begin, end, [&longest, &longestLength](NodeType* node, size_t length) {
+            longest = node;
+            longestLength = length;
+        });
+        if (!longest) {
+            return false;
+        }
+        visit(longest, longestLength);
+        return true;
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::visitAllPrefixes(const ContainerItr begin,
+                                                                   const ContainerItr end,
+                                                                   Visitor visit) {
+    static_assert(!Locking::optimistic,
+                  "visitAllPrefixes is not supported with TrieOptimisticLocking");
+    Shard& shard = getShard(begin, end);
+    TrieReadLock<typename Locking::Mutex> lg(shard.lock);
+    bool visited = false;
+    walkPrefixes(shard, begin, end, [&visited, &visit](NodeType* node, size_t length) {
+        visited = true;
+        visit(node, length);
+    });
+    return visited;
+}
+
+/**
+ * Each lookup alternates between two steps, so that the memory a step
+ * needs was requested a whole round of the other lookups earlier:
+ *
+ *   arrive - the node has been loaded, request its segment and children
+ *   search - match the segment, find the child and request it
+ */
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename KeyAt, typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::visitBatch(size_t count,
+                                                             KeyAt keyAt,
+                                                             bool prefix,
+                                                             Visitor visit) {
+    if constexpr (Locking::optimistic) {
+        for (size_t i = 0; i < count; i++) {
+            auto key = keyAt(i);
+            auto visitNode = [i, &visit](NodeType* node) {
+                visit(i, node);
+            };
+            if (prefix) {
+                visitPrefix(key.first, key.second, visitNode);
+            } else {
+                visitKey(key.first, key.second, visitNode);
+            }
+        }
+    } else {
+        // visitKey/visitPrefix count each optimistic lookup, here the
+        // whole batch is one probe of count lookups
+        Probe probe(instrumentation, prefix ? TrieOp::PrefixFind : TrieOp::Find, count);
+        std::vector<TrieCursorLock<typename Locking::Mutex> > locks;
+        for (Shard& shard : shards) {
+            locks.emplace_back(shard.lock);
+        }
+        probe.locked();
+
+        struct Lookup {
+            size_t index;
+            ContainerItr begin;
+            ContainerItr element;
+            ContainerItr end;
+            NodeType* node;
+            bool arrived;
+        };
+        Lookup lookups[batchWidth];
+        size_t active = 0;
+        size_t next = 0;
+
+        auto start = [&](Lookup& lookup) {
+            if (next == count) {
+                return false;
+            }
+            auto key = keyAt(next);
+            lookup.index = next++;
+            lookup.begin = key.first;
+            lookup.element = key.first;
+            lookup.end = key.second;
+            lookup.node = &getShard(key.first, key.second).root;
+            lookup.arrived = true;
+            return true;
+        };
+
+        // Returns false once the lookup is done
+        auto step = [&](Lookup& lookup) {
+            NodeType* node = lookup.node;
+            if (!lookup.arrived) {
+                node->prefetchSegment();
+                node->prefetchChildren();
+                lookup.arrived = true;
+                return true;
+            }
+
+            if (lookup.element != lookup.begin) {
+                const auto segment = node->getSegmentView();
+                if (matchSegment(segment, lookup.element, lookup.end) != segment.length) {
+                    return false;
+                }
+                if (prefix && node->isTerminator()) {
+                    visit(lookup.index, node);
+                    return false;
+                }
+            }
+            if (lookup.element == lookup.end) {
+                if (!prefix && node->isTerminator()) {
+                    visit(lookup.index, node);
+                }
+                return false;
+            }
+
+            Instrumentation::countNode();
+            NodeType* child = static_cast<NodeType*>(node->findChild(*lookup.element));
+            if (!child) {
+                return false;
+            }
+            lookup.element++;
+            triePrefetch(child);
+            lookup.node = child;
+            lookup.arrived = false;
+            return true;
+        };
+
+        while (active < batchWidth && start(lookups[active])) {
+            active++;
+        }
+        while (active) {
+            for (size_t l = 0; l < active;) {
+                if (step(lookups[l])) {
+                    l++;
+                } else if (start(lookups[l])) {
+                    l++;
+                } else {
+                    // none left to start, close the gap
+                    lookups[l] = lookups[--active];
+                }
+            }
+        }
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::walkPrefixes(Shard& shard,
+                                                               const ContainerItr begin,
+                                                               const ContainerItr end,
+                                                               Visitor visit) {
+    NodeType* node = &shard.root;
+    ContainerItr element = begin;
+    while (element != end) {
+        Instrumentation::countNode();
+        NodeType* n = static_cast<NodeType*>(node->findChild(*element));
+        if (!n) {
+            return;
+        }
+        element++;
+
+        const auto segment = n->getSegmentView();
+        if (matchSegment(segment, element, end) != segment.length) {
+            return;
+        }
+
+        node = n;
+        if (node->isTerminator()) {
+            visit(node, static_cast<size_t>(element - begin));
+        }
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::eraseKey(const ContainerItr begin,
+                                                           const ContainerItr end) {
+    Probe probe(instrumentation, TrieOp::Erase);
+    if constexpr (Locking::optimistic) {
+        return eraseOptimistic(begin, end);
+    }
+
+    Shard& shard = getShard(begin, end);
+    std::lock_guard<typename Locking::Mutex> lg(shard.lock);
+    probe.locked();
+    bool erased = false;
+    if (begin == end) {
+        erased = shard.root.isTerminator();
+        shard.root.clearTerminator(shard.allocator);
+    } else {
+        erased = deleteNode(shard, &shard.root, begin, end);
+    }
+    if (erased) {
+        countKey(shard, static_cast<size_t>(end - begin), false);
+    }
+    return erased;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Itr, typename KeyOf, typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::buildKeys(Itr begin,
+                                                            Itr end,
+                                                            KeyOf keyOf,
+                                                            Visitor visit) {
+    typedef typename std::iterator_traits<Itr>::value_type Item;
+
+    // Order by key through pointers, stable so the last duplicate wins
+    std::vector<const Item*> items;
+    for (Itr it = begin; it != end; ++it) {
+        items.push_back(&*it);
+    }
+    auto less = [&keyOf](const Item* a, const Item* b) {
+        return keyOf(*a) < keyOf(*b);
+    };
+    if (!std::is_sorted(items.begin(), items.end(), less)) {
+        std::stable_sort(items.begin(), items.end(), less);
+    }
+
+    auto isEmpty = [this]() {
+        for (Shard& shard : shards) {
+            if (shard.root.hasChildren() || shard.root.isTerminator()) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    bool built = false;
+    if constexpr (Locking::optimistic) {
+        // Holding the root's write lock keeps everyone else out, readers
+        // and writers restart until the whole trie is linked in.
+        TrieVersionLock& rootLock = shards[0].root.getLock();
+        uint32_t version;
+        while (!rootLock.readLock(version) || !rootLock.upgrade(version)) {
+            std::this_thread::yield();
+        }
+        if (isEmpty()) {
+            buildSorted(items, keyOf, visit);
+            built = true;
+        }
+        rootLock.unlock();
+    } else {
+        std::vector<std::unique_lock<typename Locking::Mutex> > locks;
+        for (Shard& shard : shards) {
+            locks.emplace_back(shard.lock);
+        }
+        if (isEmpty()) {
+            buildSorted(items, keyOf, visit);
+            built = true;
+        }
+    }
+
+    if (!built) {
+        for (const Item* item : items) {
+            const Container& key = keyOf(*item);
+            insertKey(key.data(), key.data() + key.size(),
+                      [&visit, item](NodeType* node, auto& allocator) {
+                visit(node, *item, allocator);
+            });
+        }
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::walkLevelOrder(Visitor visit) {
+    static_assert(std::is_same<Container, std::string>::value,
+                  "walkLevelOrder is only supported for char keys");
+
+    std::vector<std::unique_lock<typename Locking::Mutex> > locks;
+    if constexpr (!Locking::optimistic) {
+        for (Shard& shard : shards) {
+            locks.emplace_back(shard.lock);
+        }
+    }
+
+    // A step is a node and how much of its segment has been walked, all
+    // of it (the segment length) means the node's own children are next.
+    struct Step {
+        NodeType* node;
+        uint32_t offset;
+    };
+    std::deque<Step> queue;
+    std::vector<NodeType*> children;
+    std::vector<uint8_t> labels;
+
+    auto visitNode = [&](NodeType* node) {
+        labels.clear();
+        for (NodeType* child : children) {
+            labels.push_back(static_cast<uint8_t>(child->getId()));
+            queue.push_back({child, 0});
+        }
+        visit(node->isTerminator() ? node : nullptr, labels.data(), labels.size());
+    };
+    auto addChild = [&children](auto* child) {
+        children.push_back(static_cast<NodeType*>(child));
+    };
+
+    // The root's children are spread over the shards
+    for (Shard& shard : shards) {
+        shard.root.forEachChild(addChild);
+    }
+    std::sort(children.begin(), children.end(), [](NodeType* a, NodeType* b) {
+        return static_cast<uint8_t>(a->getId()) < static_cast<uint8_t>(b->getId());
+    });
+    visitNode(&shards[0].root);
+
+    while (!queue.empty()) {
+        Step step = queue.front();
+        queue.pop_front();
+
+        const auto segment = step.node->getSegmentView();
+        if (step.offset < segment.length) {
+            // within a segment there is exactly one child
+            uint8_t label = static_cast<uint8_t>(segment.data[step.offset]);
+            queue.push_back({step.node, step.offset + 1});
+            visit(static_cast<NodeType*>(nullptr), &label, 1);
+            continue;
+        }
+
+        // char nodes give their children in unsigned byte order
+        children.clear();
+        step.node->forEachChild(addChild);
+        visitNode(step.node);
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::walkKeys(Visitor visit) {
+    static_assert(std::is_same<Container, std::string>::value,
+                  "walkKeys is only supported for char keys");
+
+    std::vector<std::unique_lock<typename Locking::Mutex> > locks;
+    if constexpr (!Locking::optimistic) {
+        for (Shard& shard : shards) {
+            locks.emplace_back(shard.lock);
+        }
+    }
+
+    // Depth first with an explicit stack, a step is a node and the length
+    // of its parent's key.
+    struct Step {
+        NodeType* node;
+        size_t depth;
+    };
+    std::vector<Step> stack;
+    std::vector<NodeType*> children;
+    std::string key;
+
+    // Push the children in reverse so the smallest is visited first
+    auto pushChildren = [&]() {
+        std::sort(children.begin(), children.end(), [](NodeType* a, NodeType* b) {
+            return static_cast<uint8_t>(a->getId()) > static_cast<uint8_t>(b->getId());
+        });
+        for (NodeType* child : children) {
+            stack.push_back({child, key.size()});
+        }
+    };
+    auto addChild = [&children](auto* child) {
+        children.push_back(static_cast<NodeType*>(child));
+    };
+
+    // Only shard 0 holds the empty key, the root's children are spread
+    // over the shards
+    if (shards[0].root.isTerminator()) {
+        visit(key, &shards[0].root);
+    }
+    for (Shard& shard : shards) {
+        shard.root.forEachChild(addChild);
+    }
+    pushChildren();
+
+    while (!stack.empty()) {
+        Step step = stack.back();
+        stack.pop_back();
+
+        const auto segment = step.node->getSegmentView();
+        key.resize(step.depth);
+        key.push_back(step.node->getId());
+        key.append(segment.data, segment.length);
+        if (step.node->isTerminator()) {
+            visit(key, step.node);
+        }
+
+        children.clear();
+        step.node->forEachChild(addChild);
+        pushChildren();
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+TrieStats TrieImpl<Container, ContainerItr, NodeType, Policy>::stats(bool exact) {
+    TrieStats stats;
+    if (!exact) {
+        for (Shard& shard : shards) {
+            stats.keys += shard.keyCount.load(std::memory_order_relaxed);
+            stats.keyElements += shard.keyElements.load(std::memory_order_relaxed);
+            stats.nodes += shard.nodeCount.load(std::memory_order_relaxed);
+        }
+        stats.nodeBytes = stats.nodes * (sizeof(NodeType) - NodeType::valueBytes);
+        stats.valueBytes = stats.nodes * NodeType::valueBytes +
+                           stats.keys * NodeType::keyValueBytes;
+        return stats;
+    }
+
+    std::vector<TrieCursorLock<typename Locking::Mutex> > locks;
+    if constexpr (!Locking::optimistic) {
+        for (Shard& shard : shards) {
+            locks.emplace_back(shard.lock);
+        }
+    }
+    stats.exact = true;
+
+    // Depth first with an explicit stack, a step is a node, how many
+    // nodes it is below the root and the length of its key.
+    struct Step {
+        NodeType* node;
+        size_t depth;
+        size_t keyLength;
+    };
+    std::vector<Step> stack;
+
+    auto visitNode = [&stats, &stack](const Step& step) {
+        NodeType* node = step.node;
+        if (node->isTerminator()) {
+            if (stats.keyDepths.size() <= step.depth) {
+                stats.keyDepths.resize(step.depth + 1);
+            }
+            stats.keyDepths[step.depth]++;
+            stats.keys++;
+            stats.keyElements += step.keyLength;
+        }
+        stats.childBytes += node->getChildBytes();
+        node->forEachChild([&stack, &step](auto* child) {
+            NodeType* n = static_cast<NodeType*>(child);
+            stack.push_back({n, step.depth + 1, step.keyLength + 1 + n->getSegmentLength()});
+        });
+    };
+
+    for (Shard& shard : shards) {
+        visitNode({&shard.root, 0, 0});
+        while (!stack.empty()) {
+            Step step = stack.back();
+            stack.pop_back();
+            stats.nodes++;
+            stats.fanout[TrieStats::fanoutClass(step.node->getChildCount())]++;
+            stats.segmentBytes += step.node->getSegmentBytes();
+            visitNode(step);
+        }
+    }
+    stats.nodeBytes = stats.nodes * (sizeof(NodeType) - NodeType::valueBytes);
+    stats.valueBytes = stats.nodes * NodeType::valueBytes +
+                       stats.keys * NodeType::keyValueBytes;
+    return stats;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor::Cursor(TrieImpl& trie)
+  : depth(0),
+    current(nullptr) {
+    static_assert(!Locking::optimistic, "Cursor is not supported with TrieOptimisticLocking");
+    for (Shard& shard : trie.shards) {
+        locks.emplace_back(shard.lock);
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor::pushChildren(NodeType* node) {
+    if (depth == frames.size()) {
+        frames.emplace_back();
+    }
+    Frame& frame = frames[depth++];
+    frame.children.clear();
+    frame.next = 0;
+    frame.keyLength = keyBuffer.size();
+    node->forEachChild([&frame](auto* child) {
+        frame.children.push_back(static_cast<NodeType*>(child));
+    });
+    if constexpr (!NodeType::orderedChildren) {
+        std::sort(frame.children.begin(), frame.children.end(), [](NodeType* a, NodeType* b) {
+            return NodeType::idLess(a->getId(), b->getId());
+        });
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor::pushRoot(TrieImpl& trie) {
+    pushChildren(&trie.shards[0].root);
+    if (Locking::shards > 1) {
+        Frame& frame = frames[depth - 1];
+        for (size_t s = 1; s < Locking::shards; s++) {
+            trie.shards[s].root.forEachChild([&frame](auto* child) {
+                frame.children.push_back(static_cast<NodeType*>(child));
+            });
+        }
+        std::sort(frame.children.begin(), frame.children.end(), [](NodeType* a, NodeType* b) {
+            return NodeType::idLess(a->getId(), b->getId());
+        });
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor::setChildKey(NodeType* child) {
+    const auto segment = child->getSegmentView();
+    keyBuffer.resize(frames[depth - 1].keyLength);
+    keyBuffer.push_back(child->getId());
+    keyBuffer.insert(keyBuffer.end(), segment.data, segment.data + segment.length);
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor::next() {
+    // Depth first, each node's key comes before those below it
+    current = nullptr;
+    while (depth) {
+        Frame& frame = frames[depth - 1];
+        if (frame.next == frame.children.size()) {
+            depth--;
+            continue;
+        }
+        NodeType* child = frame.children[frame.next++];
+        setChildKey(child);
+        pushChildren(child);
+        if (child->isTerminator()) {
+            current = child;
+            return;
+        }
+    }
+}
+
+/**
+ * Walk the path of the search key pushing the frame of each node on it,
+ * each frame's next child being the first after the path. Where the path
+ * leaves the trie the keys from there on are all greater, so next()
+ * finds the answer, unless the path ends at (or inside the segment of)
+ * a node whose own key qualifies.
+ */
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor::seek(TrieImpl& trie,
+                                                               const ContainerItr begin,
+                                                               const ContainerItr end,
+                                                               bool inclusive) {
+    pushRoot(trie);
+    NodeType* node = &trie.shards[0].root;
+    ContainerItr element = begin;
+    while (true) {
+        if (element == end) {
+            // node's key is the search key
+            if (inclusive && node->isTerminator()) {
+                current = node;
+            } else {
+                next();
+            }
+            return;
+        }
+
+        Frame& frame = frames[depth - 1];
+        auto child = std::lower_bound(frame.children.begin(), frame.children.end(), *element,
+                                      [](NodeType* n, const Element& id) {
+                                          return NodeType::idLess(n->getId(), id);
+                                      });
+        frame.next = child - frame.children.begin();
+        if (child == frame.children.end() || NodeType::idLess(*element, (*child)->getId())) {
+            next();
+            return;
+        }
+        frame.next++;
+        node = *child;
+        element++;
+
+        const auto segment = node->getSegmentView();
+        const uint32_t matched = matchSegment(segment, element, end);
+        setChildKey(node);
+        if (matched == segment.length) {
+            pushChildren(node);
+            continue;
+        }
+        if (element == end || NodeType::idLess(*element, segment.data[matched])) {
+            // node's key and all below it are greater than the search key
+            pushChildren(node);
+            if (node->isTerminator()) {
+                current = node;
+            } else {
+                next();
+            }
+            return;
+        }
+        // all of node's keys are less, carry on after it
+        next();
+        return;
+    }
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+typename TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor
+TrieImpl<Container, ContainerItr, NodeType, Policy>::cursor() {
+    Cursor cursor(*this);
+    cursor.pushRoot(*this);
+    if (shards[0].root.isTerminator()) {
+        cursor.current = &shards[0].root;
+    } else {
+        cursor.next();
+    }
+    return cursor;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+typename TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor
+TrieImpl<Container, ContainerItr, NodeType, Policy>::lowerBound(const ContainerItr begin,
+                                                        const ContainerItr end) {
+    Cursor cursor(*this);
+    cursor.seek(*this, begin, end, true);
+    return cursor;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+typename TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor
+TrieImpl<Container, ContainerItr, NodeType, Policy>::upperBound(const ContainerItr begin,
+                                                        const ContainerItr end) {
+    Cursor cursor(*this);
+    cursor.seek(*this, begin, end, false);
+    return cursor;
+}
+
+/**
+ * Find the node whose key is the shortest with the prefix (the prefix
+ * may end inside its segment), the cursor then only walks below it.
+ */
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+typename TrieImpl<Container, ContainerItr, NodeType, Policy>::Cursor
+TrieImpl<Container, ContainerItr, NodeType, Policy>::prefixCursor(const ContainerItr begin,
+                                                          const ContainerItr end) {
+    if (begin == end) {
+        return cursor();
+    }
+    Cursor cursor(*this);
+    NodeType* node = &getShard(begin, end).root;
+    ContainerItr element = begin;
+    while (element != end) {
+        NodeType* child = static_cast<NodeType*>(node->findChild(*element));
+        if (!child) {
+            return cursor;
+        }
+        element++;
+        const auto segment = child->getSegmentView();
+        if (matchSegment(segment, element, end) != segment.length && element != end) {
+            // diverges from the segment
+            return cursor;
+        }
+        cursor.keyBuffer.push_back(child->getId());
+        cursor.keyBuffer.insert(cursor.keyBuffer.end(), segment.data, segment.data + segment.length);
+        node = child;
+    }
+
+    cursor.pushChildren(node);
+    if (node->isTerminator()) {
+        cursor.current = node;
+    } else {
+        cursor.next();
+    }
+    return cursor;
+}
+
+/**
+ * Sorted keys sharing a prefix are adjacent, so the trie is built
+ * depth first along the path of the previous key. Nodes on that path are
+ * pending (their children are still being added), a node is only
+ * allocated once the keys have moved on from it and it is complete.
+ *
+ * A pending node covers the key elements [begin, end), begin being the
+ * element which is its id. When the next key shares only L elements with
+ * the previous one, pending nodes starting at or after L are complete and
+ * one spanning L is split there, its lower part being complete.
+ */
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Item, typename KeyOf, typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::buildSorted(const std::vector<const Item*>& items,
+                                                              KeyOf& keyOf,
+                                                              Visitor& visit) {
+    struct Pending {
+        size_t begin;
+        size_t end;
+        // an item whose key runs through this node, the node's own key
+        // if it terminates
+        const Item* item;
+        bool terminates;
+        std::vector<NodeType*> children;
+    };
+
+    // Entries above depth are kept for their children vector's capacity
+    std::vector<Pending> stack;
+    size_t depth = 0;
+    Shard* shard = nullptr;
+
+    auto push = [&](size_t begin, size_t end, const Item* item, bool terminates) {
+        if (depth == stack.size()) {
+            stack.emplace_back();
+        }
+        Pending& p = stack[depth++];
+        p.begin = begin;
+        p.end = end;
+        p.item = item;
+        p.terminates = terminates;
+        p.children.clear();
+    };
+
+    auto complete = [&](NodeType* node, Pending& p) {
+        node->reserveChildren(p.children.size(), shard->allocator);
+        for (NodeType* child : p.children) {
+            node->addChild(child, shard->allocator);
+        }
+        if (p.terminates) {
+            node->setTerminates(true);
+            countKey(*shard, keyOf(*p.item).size(), true);
+            visit(node, *p.item, shard->allocator);
+        }
+    };
+
+    // Allocate the node(s) for p, returning the top
+    auto allocate = [&](Pending& p) {
+        const Container& key = keyOf(*p.item);
+        NodeType* top = newNode(*shard, key[p.begin]);
+        NodeType* last = top;
+        if (layout == TrieLayout::PathCompressed) {
+            top->setSegment(key.begin() + p.begin + 1,
+                            key.begin() + p.end,
+                            shard->allocator);
+        } else {
+            for (size_t i = p.begin + 1; i < p.end; i++) {
+                NodeType* n = newNode(*shard, key[i]);
+                last->addChild(n, shard->allocator);
+                last = n;
+            }
+        }
+        complete(last, p);
+        return top;
+    };
+
+    // Complete every pending node which does not lie within [0, shared)
+    auto unwind = [&](size_t shared) {
+        while (stack[depth - 1].end > shared) {
+            Pending& top = stack[depth - 1];
+            if (top.begin >= shared) {
+                NodeType* node = allocate(top);
+                depth--;
+                stack[depth - 1].children.push_back(node);
+            } else {
+                const size_t begin = top.begin;
+                top.begin = shared;
+                NodeType* lower = allocate(top);
+                top.begin = begin;
+                top.end = shared;
+                top.terminates = false;
+                top.children.clear();
+                top.children.push_back(lower);
+            }
+        }
+    };
+
+    // Link everything pending into the shard's root
+    auto flush = [&]() {
+        if (shard) {
+            unwind(0);
+            complete(&shard->root, stack[0]);
+        }
+    };
+
+    const Container* previous = nullptr;
+    for (const Item* item : items) {
+        const Container& key = keyOf(*item);
+        Shard& keyShard = getShard(key.begin(), key.end());
+        if (&keyShard != shard) {
+            flush();
+            shard = &keyShard;
+            depth = 0;
+            push(0, 0, nullptr, false);
+            previous = nullptr;
+        }
+
+        size_t shared = 0;
+        if (previous) {
+            auto mismatch = std::mismatch(previous->begin(), previous->end(),
+                                          key.begin(), key.end());
+            shared = std::distance(previous->begin(), mismatch.first);
+        }
+        unwind(shared);
+
+        if (shared == key.size()) {
+            // a duplicate (or the empty key), which ends at the top node
+            stack[depth - 1].terminates = true;
+            stack[depth - 1].item = item;
+        } else {
+            push(shared, key.size(), item, true);
+        }
+        previous = &key;
+    }
+    flush();
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Itr>
+uint32_t TrieImpl<Container, ContainerItr, NodeType, Policy>::matchSegment(const TrieSegmentView<Element>& segment,
+                                                                   Itr& itr,
+                                                                   const Itr end) {
+    uint32_t matched = 0;
+    while (matched < segment.length && itr != end && *itr == segment.data[matched]) {
+        matched++;
+        itr++;
+    }
+    return matched;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+NodeType* TrieImpl<Container, ContainerItr, NodeType, Policy>::splitNode(Shard& shard,
+                                                                 NodeType* parent,
+                                                                 NodeType* child,
+                                                                 uint32_t length) {
+    const auto segment = child->getSegmentView();
+    NodeType* upper = newNode(shard, child->getId());
+    upper->setSegment(segment.data, segment.data + length, shard.allocator);
+
+    // child now starts at the first element after the split point
+    child->setId(segment.data[length]);
+    child->setSegment(segment.data + length + 1,
+                      segment.data + segment.length,
+                      shard.allocator);
+    upper->addChild(child, shard.allocator);
+
+    // upper is complete before it is linked in (replaced by its id, which
+    // was child's)
+    parent->replaceChild(upper);
+    return upper;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::mergeNode(Shard& shard,
+                                                            NodeType* parent,
+                                                            NodeType* child) {
+    // Merge child into its only child (rather than the other way around)
+    // so that the surviving node keeps its children, terminator and value.
+    NodeType* only = static_cast<NodeType*>(child->getOnlyChild());
+    const auto upper = child->getSegmentView();
+
+    child->unlinkChild(only->getId(), shard.allocator);
+    only->prependSegment(upper.data, upper.data + upper.length, only->getId(), shard.allocator);
+    only->setId(child->getId());
+
+    parent->replaceChild(only);
+    freeNode(shard, child);
 }
 
 /**
  * Walk the trie using key and determine how key should be removed.
  * If key is not a substring it can be wholly removed.
  * If key is a substring of a bigger key it cannot be deleted.
- *  Only the terminator is cleared and the final node of key is returned so
- *  any trie sub-class can clear a stored value etc...
+ *  Only the terminator is cleared so that any trie sub-class also drops
+ *  a stored value etc...
+ * On the way back up, nodes which no longer lead to a key are removed and
+ * in a path compressed trie, single child chains are merged again.
  *
  * node is the current node
- * itr is the child of node we want to look for
- * key is the full key we are deleting
+ * itr is the element of key which selects the child of node
+ * returns true if the key was found and erased
  */
-template <typename Container, typename ContainerItr, typename NodeType>
-NodeType* TrieImpl<Container, ContainerItr, NodeType>::deleteNode(NodeType* node,
-                                                                  const Container& key,
-                                                                  typename Container::const_iterator& itr) {
-
-    //std::cout << ".. [" << node->getId() << "] [" << *itr << "]" << std::endl;
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::deleteNode(Shard& shard,
+                                                             NodeType* node,
+                                                             ContainerItr itr,
+                                                             const ContainerItr end) {
     // First step is to see if the node has a child matching the current
     // element (*itr)
+    Instrumentation::countNode();
     NodeType* child = node->findChild(*itr);
-    if (child) {
-        //std::cout << " recurse from [" << child->getId() << "] to element [" << *itr << "]" << std::endl;
-        NodeType* n = nullptr;
-        // The node has a matching child, so we will recurse down.
-        if ((n=deleteNode(child, key, ++itr)) == nullptr) {
-            //std::cout << " Unlink [" << child->getId() << "] from [" << node->getId() << "]" << std::endl;
-            node->unlinkChild(child->getId());
-     //       perfomedDelete = true;
-            if (!node->hasChildren() && !node->isTerminator()) {
-                //std::cout << " Return nullp A [" << node->getId() << "]" <<std::endl;
-                return nullptr;
-            } else {
-                //std::cout << " Return node [" << node->getId() << "]" <<std::endl;
-                return node;
+    if (!child) {
+        return false;
+    }
+    itr++;
+    const auto segment = child->getSegmentView();
+    if (matchSegment(segment, itr, end) != segment.length) {
+        return false;
+    }
+
+    if (itr == end) {
+        // child is the final node of key
+        if (!child->isTerminator()) {
+            return false;
+        }
+        // in this case, clear terminator flag so that 'ham' is no longer a
+        // sub-key of 'hamster'.
+        child->clearTerminator(shard.allocator);
+    } else if (!deleteNode(shard, child, itr, end)) {
+        return false;
+    }
+
+    if (!child->isTerminator()) {
+        if (!child->hasChildren()) {
+            // child no longer leads to any key
+            freeNode(shard, static_cast<NodeType*>(node->unlinkChild(child->getId(), shard.allocator)));
+        } else if (layout == TrieLayout::PathCompressed &&
+                   child->getOnlyChild()) {
+            mergeNode(shard, node, child);
+        }
+    }
+    return true;
+}
+
+/**
+ * Optimistic lock coupling.
+ *
+ * Readers hold no locks. Each node's version is read before the node and
+ * validated after, a child is only trusted once its parent is validated
+ * after the child's own version was read. Any failed validation restarts
+ * the operation from the root.
+ *
+ * Writers walk the same way and upgrade only the versions of the nodes
+ * they change. An upgrade fails if the node changed since it was read,
+ * so no writer ever waits on a lock and there is no lock ordering to get
+ * wrong. Unlinked nodes are marked obsolete and freed through the epoch
+ * allocator.
+ */
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::visitOptimistic(const ContainerItr begin,
+                                                                  const ContainerItr end,
+                                                                  bool prefix,
+                                                                  bool longest,
+                                                                  Visitor visit) {
+    Shard& shard = shards[0];
+    typename Allocator::Epochs::Guard guard(shard.allocator.getEpochs());
+restart:
+    NodeType* node = &shard.root;
+    uint32_t version;
+    if (!node->getLock().readLock(version)) {
+        goto restart;
+    }
+
+    // The longest prefix so far and the version it was seen at
+    NodeType* best = nullptr;
+    uint32_t bestVersion = 0;
+    size_t bestLength = 0;
+
+    for (ContainerItr element = begin; element != end;) {
+        Instrumentation::countNode();
+        NodeType* n = node->findChild(*element);
+        if (!node->getLock().validate(version)) {
+            goto restart;
+        }
+        if (!n) {
+            break;
+        }
+
+        uint32_t childVersion;
+        if (!n->getLock().readLock(childVersion) ||
+            !node->getLock().validate(version)) {
+            goto restart;
+        }
+        element++;
+
+        const auto segment = n->getSegmentView();
+        const bool matched = matchSegment(segment, element, end) == segment.length;
+        if (!n->getLock().validate(childVersion)) {
+            goto restart;
+        }
+        if (!matched) {
+            break;
+        }
+
+        node = n;
+        version = childVersion;
+        if (prefix && node->isTerminator()) {
+            if (longest) {
+                best = node;
+                bestVersion = version;
+                bestLength = static_cast<size_t>(element - begin);
+                continue;
             }
+            visit(node, static_cast<size_t>(element - begin));
+            if (!node->getLock().validate(version)) {
+                goto restart;
+            }
+            return true;
         }
-        //std::cout << "no [" << n->getId() << "]"<< std::endl;
-        return n;
-    // The node does not have a matching child
-    } else if (!node->hasChildren() && itr == key.end()) {
-        //std::cout << "Node has no children and key is ended\n";
-        // return true. No children and the key has no elements remaining
-        return nullptr;
-    } else if(itr == key.end()) {
-        // in this case, just clear terminator flag so that 'ham' is no longer a sub-key of 'hamster'.
-        assert(node->isTerminator());
-        // TODO node->deleteValue();
-        node->setTerminates(false);
-       // perfomedDelete = true;
-        //std::cout << "clear terminates key is ended - returning " << node->getId() << std::endl;
-        return node;
-    }
-
-    //std::cout << "Final return [" << node->getId() << "]" << (itr == key.end()) << std::endl;
-    return node;
+        if (element == end && !prefix) {
+            const bool found = node->isTerminator();
+            if (found) {
+                visit(node, static_cast<size_t>(element - begin));
+            }
+            if (!node->getLock().validate(version)) {
+                goto restart;
+            }
+            return found;
+        }
+    }
+
+    if (prefix) {
+        if (!best) {
+            return false;
+        }
+        visit(best, bestLength);
+        if (!best->getLock().validate(bestVersion)) {
+            goto restart;
+        }
+        return true;
+    }
+
+    // Only the empty key reaches here with all of key matched
+    if (begin != end) {
+        return false;
+    }
+    const bool found = node->isTerminator();
+    if (found) {
+        visit(node, 0);
+    }
+    if (!node->getLock().validate(version)) {
+        goto restart;
+    }
+    return found;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+template <typename Visitor>
+void TrieImpl<Container, ContainerItr, NodeType, Policy>::insertOptimistic(const ContainerItr begin,
+                                                                   const ContainerItr end,
+                                                                   Visitor visit) {
+    Shard& shard = shards[0];
+    typename Allocator::Epochs::Guard guard(shard.allocator.getEpochs());
+restart:
+    NodeType* node = &shard.root;
+    uint32_t version;
+    if (!node->getLock().readLock(version)) {
+        goto restart;
+    }
+
+    auto it = begin;
+    while (it != end) {
+        Instrumentation::countNode();
+        NodeType* n = node->findChild(*it);
+        if (!node->getLock().validate(version)) {
+            goto restart;
+        }
+        if (!n) {
+            break;
+        }
+
+        uint32_t childVersion;
+        if (!n->getLock().readLock(childVersion) ||
+            !node->getLock().validate(version)) {
+            goto restart;
+        }
+
+        auto next = it + 1;
+        const auto segment = n->getSegmentView();
+        const uint32_t matched = matchSegment(segment, next, end);
+        if (!n->getLock().validate(childVersion)) {
+            goto restart;
+        }
+
+        if (matched != segment.length) {
+            // Split under the parent and child locks, then walk again.
+            if (!node->getLock().upgrade(version)) {
+                goto restart;
+            }
+            if (!n->getLock().upgrade(childVersion)) {
+                node->getLock().unlock();
+                goto restart;
+            }
+            splitNode(shard, node, n, matched);
+            n->getLock().unlock();
+            node->getLock().unlock();
+            goto restart;
+        }
+
+        it = next;
+        node = n;
+        version = childVersion;
+    }
+
+    if (!node->getLock().upgrade(version)) {
+        goto restart;
+    }
+
+    if (it != end) {
+        // The new nodes are complete before addChild makes them visible.
+        NodeType* last = nullptr;
+        NodeType* tail = newTail(shard, it, end, last);
+        last->setTerminates(true);
+        visit(last, shard.allocator);
+        node->addChild(tail, shard.allocator);
+        countKey(shard, static_cast<size_t>(end - begin), true);
+    } else {
+        if (!node->isTerminator()) {
+            countKey(shard, static_cast<size_t>(end - begin), true);
+        }
+        node->setTerminates(true);
+        visit(node, shard.allocator);
+    }
+    node->getLock().unlock();
 }
 
-template <typename K>
-bool Trie<K>::exists(const typename std::vector<K>::iterator begin,
-                     const typename std::vector<K>::iterator end) {
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::eraseOptimistic(const ContainerItr begin,
+                                                                  const ContainerItr end) {
+    Shard& shard = shards[0];
+    typename Allocator::Epochs::Guard guard(shard.allocator.getEpochs());
+    struct Step {
+        NodeType* node;
+        uint32_t version;
+    };
+    std::vector<Step> path;
+restart:
+    path.clear();
+    path.push_back({&shard.root, 0});
+    if (!shard.root.getLock().readLock(path.back().version)) {
+        goto restart;
+    }
+
+    for (auto it = begin; it != end;) {
+        Step& step = path.back();
+        Instrumentation::countNode();
+        NodeType* n = step.node->findChild(*it);
+        if (!step.node->getLock().validate(step.version)) {
+            goto restart;
+        }
+        if (!n) {
+            return false;
+        }
+
+        uint32_t childVersion;
+        if (!n->getLock().readLock(childVersion) ||
+            !step.node->getLock().validate(step.version)) {
+            goto restart;
+        }
+        it++;
 
-    TrieNode<K>* node = this->findKey(begin, end);
+        const auto segment = n->getSegmentView();
+        const bool matched = matchSegment(segment, it, end) == segment.length;
+        if (!n->getLock().validate(childVersion)) {
+            goto restart;
+        }
+        if (!matched) {
+            return false;
+        }
+        path.push_back({n, childVersion});
+    }
+
+    // The key's node, it must still terminate the key once locked.
+    const size_t target = path.size() - 1;
+    if (!path[target].node->getLock().upgrade(path[target].version)) {
+        goto restart;
+    }
+    NodeType* node = path[target].node;
+    if (!node->isTerminator()) {
+        node->getLock().unlock();
+        return false;
+    }
+
+    if (target == 0 || node->hasChildren()) {
+        // Still leads to other keys, so the node stays.
+        node->clearTerminator(shard.allocator);
+        countKey(shard, static_cast<size_t>(end - begin), false);
+        if (layout == TrieLayout::PathCompressed && target > 0 &&
+            node->getOnlyChild() &&
+            path[target - 1].node->getLock().upgrade(path[target - 1].version)) {
+            if (!tryMergeNode(shard, path[target - 1].node, node)) {
+                node->getLock().unlock();
+            }
+            path[target - 1].node->getLock().unlock();
+            return true;
+        }
+        node->getLock().unlock();
+        return true;
+    }
+
+    // Find the highest node which only leads to the key, the whole chain
+    // from there down is unlinked from its parent in one step.
+    size_t top = target;
+    while (top > 1 &&
+           !path[top - 1].node->isTerminator() &&
+           path[top - 1].node->getOnlyChild() == path[top].node) {
+        top--;
+    }
+    for (size_t i = target; i-- > top - 1;) {
+        if (!path[i].node->getLock().upgrade(path[i].version)) {
+            for (size_t j = i + 1; j <= target; j++) {
+                path[j].node->getLock().unlock();
+            }
+            goto restart;
+        }
+    }
+
+    NodeType* parent = path[top - 1].node;
+    parent->unlinkChild(path[top].node->getId(), shard.allocator);
+    countKey(shard, static_cast<size_t>(end - begin), false);
+    for (size_t i = top; i <= target; i++) {
+        // release the node before the version goes obsolete, the memory
+        // itself is only reused once no reader can hold it
+        path[i].node->getLock().unlockObsolete();
+        freeNode(shard, path[i].node);
+    }
+
+    // The parent may now be a single child chain to merge with its child.
+    if (layout == TrieLayout::PathCompressed && top > 1 &&
+        !parent->isTerminator() && parent->getOnlyChild() &&
+        path[top - 2].node->getLock().upgrade(path[top - 2].version)) {
+        if (!tryMergeNode(shard, path[top - 2].node, parent)) {
+            parent->getLock().unlock();
+        }
+        path[top - 2].node->getLock().unlock();
+        return true;
+    }
+    parent->getLock().unlock();
+    return true;
+}
+
+template <typename Container, typename ContainerItr, typename NodeType, typename Policy>
+bool TrieImpl<Container, ContainerItr, NodeType, Policy>::tryMergeNode(Shard& shard,
+                                                               NodeType* parent,
+                                                               NodeType* child) {
+    NodeType* only = static_cast<NodeType*>(child->getOnlyChild());
+    uint32_t version;
+    if (!only->getLock().readLock(version) || !only->getLock().upgrade(version)) {
+        return false;
+    }
+    // child is freed by the merge, so its version goes obsolete first
+    child->getLock().unlockObsolete();
+    mergeNode(shard, parent, child);
+    only->getLock().unlock();
+    return true;
+}
+
+template <typename K, typename Policy>
+bool Trie<K, Policy>::exists(TrieKeySpan<K> key) {
+
+    TrieNode<K>* node = this->findKey(key.begin(), key.end());
 
     // Check if a node was found and that it is a terminator.
     // e.g. insert("hamster")
@@ -209,130 +1489,368 @@ bool Trie<K>::exists(const typename std::vector<K>::iterator begin,
     return (node && node->isTerminator());
 }
 
-bool Trie<char>::exists(const char* begin, const char* end) {
-    TrieNode<char>* node = this->findKey(begin, end);
-    // Check if a node was found and that it is a terminator.
+template <typename Policy>
+bool Trie<char, Policy>::exists(const char* begin, const char* end) {
+    // Only a node which terminates a key is visited.
     // e.g. insert("hamster")
     //      find("ham") -> false, m is not a terminator
     //      find("hamster") -> true, r is a terminator
-    return (node && node->isTerminator());
+    return this->visitKey(begin, end, [](TrieNode<char>*) {});
+}
+
+template <typename K, typename Policy>
+void Trie<K, Policy>::insert(TrieKeySpan<K> key) {
+    this->insertKey(key.begin(), key.end());
 }
 
-template <typename K>
-void Trie<K>::insert(const std::vector<K>& key) {
-    (void)this->insertKey(key);
+template <typename Policy>
+void Trie<char, Policy>::insert(std::string_view key) {
+    this->insertKey(key.data(), key.data() + key.size());
 }
 
-void Trie<char>::insert(const std::string& key) {
-    (void)this->insertKey(key);
+template <typename K, typename Policy>
+bool Trie<K, Policy>::prefixExists(TrieKeySpan<K> key) {
+    return (this->prefixFindKey(key.begin(), key.end()) != nullptr);
 }
 
-template <typename K>
-bool Trie<K>::prefixExists(const typename std::vector<K>::iterator begin,
-                           const typename std::vector<K>::iterator end) {
-    return (this->prefixFindKey(begin, end) != nullptr);
+template <typename Policy>
+bool Trie<char, Policy>::prefixExists(const char* begin, const char* end) {
+    return this->visitPrefix(begin, end, [](TrieNode<char>*) {});
 }
 
-bool Trie<char>::prefixExists(const char* begin, const char* end) {
-    return (this->prefixFindKey(begin, end) != nullptr);
+template <typename Policy>
+template <typename Itr>
+size_t Trie<char, Policy>::existsBatch(Itr begin, Itr end, bool* results) {
+    static_assert(std::is_base_of<std::random_access_iterator_tag,
+                                  typename std::iterator_traits<Itr>::iterator_category>::value,
+                  "batch lookups need random access to the keys");
+    const size_t count = std::distance(begin, end);
+    std::fill(results, results + count, false);
+    size_t found = 0;
+    this->visitBatch(count,
+                     [begin](size_t i) {
+                         const auto& key = *std::next(begin, i);
+                         return std::make_pair(key.data(), key.data() + key.size());
+                     },
+                     false,
+                     [results, &found](size_t i, TrieNode<char>*) {
+                         results[i] = true;
+                         found++;
+                     });
+    return found;
 }
 
-template <typename K>
-void Trie<K>::erase(const std::vector<K>& key) {
-    this->eraseKey(key);
+template <typename Policy>
+template <typename Itr>
+size_t Trie<char, Policy>::prefixExistsBatch(Itr begin, Itr end, bool* results) {
+    static_assert(std::is_base_of<std::random_access_iterator_tag,
+                                  typename std::iterator_traits<Itr>::iterator_category>::value,
+                  "batch lookups need random access to the keys");
+    const size_t count = std::distance(begin, end);
+    std::fill(results, results + count, false);
+    size_t found = 0;
+    this->visitBatch(count,
+                     [begin](size_t i) {
+                         const auto& key = *std::next(begin, i);
+                         return std::make_pair(key.data(), key.data() + key.size());
+                     },
+                     true,
+                     [results, &found](size_t i, TrieNode<char>*) {
+                         results[i] = true;
+                         found++;
+                     });
+    return found;
 }
 
-void Trie<char>::erase(const std::string& key) {
-    this->eraseKey(key);
+template <typename K, typename Policy>
+void Trie<K, Policy>::erase(TrieKeySpan<K> key) {
+    this->eraseKey(key.begin(), key.end());
 }
 
-template <typename K, typename V>
-typename TrieMap<K, V>::iterator  TrieMap<K, V>::find(const typename std::vector<K>::iterator begin,
-                                                      const typename std::vector<K>::iterator end) {
-    TrieMapNode<K, V>* node = this->findKey(begin, end);
+template <typename Policy>
+void Trie<char, Policy>::erase(std::string_view key) {
+    this->eraseKey(key.data(), key.data() + key.size());
+}
+
+template <typename K, typename Policy>
+template <typename Itr>
+void Trie<K, Policy>::bulkInsert(Itr begin, Itr end) {
+    this->buildKeys(begin, end,
+                    [](const std::vector<K>& key) -> const std::vector<K>& {
+                        return key;
+                    },
+                    [](TrieNode<K>*, const std::vector<K>&, auto&) {});
+}
+
+template <typename Policy>
+template <typename Itr>
+void Trie<char, Policy>::bulkInsert(Itr begin, Itr end) {
+    this->buildKeys(begin, end,
+                    [](const std::string& key) -> const std::string& {
+                        return key;
+                    },
+                    [](TrieNode<char>*, const std::string&, auto&) {});
+}
+
+template <typename Policy>
+FrozenTrie Trie<char, Policy>::freeze() {
+    FrozenTrie frozen;
+    frozen.clear();
+    this->walkLevelOrder([&frozen](TrieNode<char>* node, const uint8_t* labels, size_t count) {
+        frozen.appendNode(node != nullptr, labels, count);
+    });
+    frozen.finish();
+    return frozen;
+}
+
+template <typename Policy>
+DoubleArrayTrie Trie<char, Policy>::buildDoubleArray() {
+    std::vector<std::string> keys;
+    this->walkKeys([&keys](const std::string& key, TrieNode<char>*) {
+        keys.push_back(key);
+    });
+    DoubleArrayTrie darray;
+    darray.build(keys);
+    return darray;
+}
+
+template <typename Policy>
+AhoCorasick Trie<char, Policy>::buildAhoCorasick() {
+    std::vector<std::string> keys;
+    this->walkKeys([&keys](const std::string& key, TrieNode<char>*) {
+        keys.push_back(key);
+    });
+    AhoCorasick automaton;
+    automaton.build(keys);
+    return automaton;
+}
+
+template <typename K, typename V, typename Policy>
+typename TrieMap<K, V, Policy>::iterator  TrieMap<K, V, Policy>::find(TrieKeySpan<K> key) {
+    Node* node = this->findKey(key.begin(), key.end());
     // Check if a node was found and that it is a terminator
     // then get the terminator's value
     // e.g. insert("hamster", 101)
     //      find("ham") -> false, m is not a terminator
     //      find("hamster") -> true, m is a terminator with value 101
     if (node && node->isTerminator()) {
-        return TrieMap<K, V>::iterator(node);
+        return TrieMap<K, V, Policy>::iterator(node);
     } else {
         return this->end();
     }
 }
 
-template <typename V>
-typename TrieMap<char, V>::iterator TrieMap<char, V>::find(const char* begin,
+template <typename V, typename Policy>
+typename TrieMap<char, V, Policy>::iterator TrieMap<char, V, Policy>::find(const char* begin,
                                                            const char* end) {
-    TrieMapNode<char, V>* node = this->findKey(begin, end);
+    Node* node = this->findKey(begin, end);
     // Check if a node was found and that it is a terminator
     // then get the terminator's value
     // e.g. insert("hamster", 101)
     //      find("ham") -> false, m is not a terminator
     //      find("hamster") -> true, m is a terminator with value 101
     if (node && node->isTerminator()) {
-        return TrieMap<char, V>::iterator(node);
+        return TrieMap<char, V, Policy>::iterator(node);
     } else {
         return this->end();
     }
 }
 
-template <typename K, typename V>
-void TrieMap<K,V>::insert(const std::vector<K>& key, V value) {
-    TrieMapNode<K, V>* node = this->insertKey(key);
-    if (node) {
-        node->setValue(value);
-    }
+template <typename K, typename V, typename Policy>
+void TrieMap<K, V, Policy>::insert(TrieKeySpan<K> key, V value) {
+    this->insertKey(key.begin(), key.end(), [&value](Node* node, auto& allocator) {
+        node->setValue(std::move(value), allocator);
+    });
 }
 
-template <typename V>
-void TrieMap<char,V>::insert(const std::string& key, V value) {
-    TrieMapNode<char, V>* node = this->insertKey(key);
-    if (node) {
-        node->setValue(value);
-    }
+template <typename V, typename Policy>
+void TrieMap<char, V, Policy>::insert(std::string_view key, V value) {
+    // The value is set whilst the key's node is still locked, moved into
+    // the node's value slot
+    this->insertKey(key.data(), key.data() + key.size(), [&value](Node* node, auto& allocator) {
+        node->setValue(std::move(value), allocator);
+    });
+}
+
+template <typename V, typename Policy>
+bool TrieMap<char, V, Policy>::findValue(const char* begin, const char* end, V& value) {
+    return this->visitKey(begin, end, [&value](Node* node) {
+        value = node->getValue();
+    });
 }
 
-template <typename K, typename V>
-typename TrieMap<K, V>::iterator TrieMap<K, V>::prefixFind(const typename std::vector<K>::iterator begin,
-                                                           const typename std::vector<K>::iterator end) {
-    TrieMapNode<K, V>* node = this->prefixFindKey(begin, end);
+template <typename V, typename Policy>
+bool TrieMap<char, V, Policy>::prefixFindValue(const char* begin, const char* end, V& value) {
+    return this->visitPrefix(begin, end, [&value](Node* node) {
+        value = node->getValue();
+    });
+}
+
+template <typename K, typename V, typename Policy>
+typename TrieMap<K, V, Policy>::iterator TrieMap<K, V, Policy>::prefixFind(TrieKeySpan<K> key) {
+    Node* node = this->prefixFindKey(key.begin(), key.end());
     if (node) {
-        return TrieMap<K, V>::iterator(node);;
+        return TrieMap<K, V, Policy>::iterator(node);;
     } else {
         return this->end();
     }
 }
 
-template <typename V>
-typename TrieMap<char, V>::iterator TrieMap<char, V>::prefixFind(const char* begin,
+template <typename V, typename Policy>
+typename TrieMap<char, V, Policy>::iterator TrieMap<char, V, Policy>::prefixFind(const char* begin,
                                                                  const char* end) {
-    TrieMapNode<char, V>* node = this->prefixFindKey(begin, end);
+    Node* node = this->prefixFindKey(begin, end);
     if (node) {
-        return TrieMap<char, V>::iterator(node);
+        return TrieMap<char, V, Policy>::iterator(node);
     } else {
         return this->end();
     }
 }
 
-template <typename K, typename V>
-void TrieMap<K, V>::erase(const std::vector<K>& key) {
-    TrieMapNode<K, V>* node = this->removeKey(key);
+template <typename K, typename V, typename Policy>
+typename TrieMap<K, V, Policy>::iterator TrieMap<K, V, Policy>::longestPrefixFind(TrieKeySpan<K> key) {
+    Node* node = nullptr;
+    this->visitLongestPrefix(key.begin(), key.end(), [&node](Node* n, size_t) {
+        node = n;
+    });
+    return node ? TrieMap<K, V, Policy>::iterator(node) : this->end();
+}
 
-    // If removeKey returns a node and the node is not a terminator
-    // drop the value.
-    if (node) {
-        node->deleteValue();
-    }
+template <typename K, typename V, typename Policy>
+template <typename Visitor>
+void TrieMap<K, V, Policy>::allPrefixes(TrieKeySpan<K> key, Visitor visit) {
+    this->visitAllPrefixes(key.begin(), key.end(), [&visit](Node* node, size_t length) {
+        visit(length, node->getReferenceValue());
+    });
 }
 
-template <typename V>
-void TrieMap<char, V>::erase(const std::string& key) {
-    TrieMapNode<char, V>* node = this->removeKey(key);
-    // If removeKey returns a node and the node is not a terminator
-    // drop the value.
-    if (node) {
-        node->deleteValue();
-    }
+template <typename V, typename Policy>
+template <typename Itr>
+size_t TrieMap<char, V, Policy>::findBatch(Itr begin, Itr end, V* values, bool* found) {
+    static_assert(std::is_base_of<std::random_access_iterator_tag,
+                                  typename std::iterator_traits<Itr>::iterator_category>::value,
+                  "batch lookups need random access to the keys");
+    const size_t count = std::distance(begin, end);
+    std::fill(found, found + count, false);
+    size_t foundCount = 0;
+    this->visitBatch(count,
+                     [begin](size_t i) {
+                         const auto& key = *std::next(begin, i);
+                         return std::make_pair(key.data(), key.data() + key.size());
+                     },
+                     false,
+                     [values, found, &foundCount](size_t i, Node* node) {
+                         values[i] = node->getValue();
+                         found[i] = true;
+                         foundCount++;
+                     });
+    return foundCount;
+}
+
+template <typename V, typename Policy>
+typename TrieMap<char, V, Policy>::iterator TrieMap<char, V, Policy>::longestPrefixFind(const char* begin,
+                                                                        const char* end) {
+    static_assert(!Policy::Locking::optimistic,
+                  "longestPrefixFind requires TrieMutexLocking, use longestPrefixFindValue");
+    Node* node = nullptr;
+    this->visitLongestPrefix(begin, end, [&node](Node* n, size_t) {
+        node = n;
+    });
+    return node ? TrieMap<char, V, Policy>::iterator(node) : this->end();
+}
+
+template <typename V, typename Policy>
+bool TrieMap<char, V, Policy>::longestPrefixFindValue(const char* begin,
+                                                      const char* end,
+                                                      V& value,
+                                                      size_t* length) {
+    return this->visitLongestPrefix(begin, end, [&value, length](Node* node, size_t l) {
+        value = node->getValue();
+        if (length) {
+            *length = l;
+        }
+    });
+}
+
+template <typename V, typename Policy>
+template <typename Visitor>
+void TrieMap<char, V, Policy>::allPrefixes(const char* begin, const char* end, Visitor visit) {
+    this->visitAllPrefixes(begin, end, [&visit](Node* node, size_t length) {
+        visit(length, node->getReferenceValue());
+    });
+}
+
+template <typename K, typename V, typename Policy>
+void TrieMap<K, V, Policy>::erase(TrieKeySpan<K> key) {
+    // eraseKey clears the terminator of the key's node which drops the value
+    this->eraseKey(key.begin(), key.end());
+}
+
+template <typename V, typename Policy>
+void TrieMap<char, V, Policy>::erase(std::string_view key) {
+    // eraseKey clears the terminator of the key's node which drops the value
+    this->eraseKey(key.data(), key.data() + key.size());
+}
+
+template <typename K, typename V, typename Policy>
+template <typename Itr>
+void TrieMap<K, V, Policy>::bulkInsert(Itr begin, Itr end) {
+    this->buildKeys(begin, end,
+                    [](const auto& item) -> const std::vector<K>& {
+                        return item.first;
+                    },
+                    [](Node* node, const auto& item, auto& allocator) {
+                        node->setValue(item.second, allocator);
+                    });
+}
+
+template <typename V, typename Policy>
+template <typename Itr>
+void TrieMap<char, V, Policy>::bulkInsert(Itr begin, Itr end) {
+    // generic lambdas, so a std::map's pair<const Key, V> is also taken
+    // by reference rather than converted
+    this->buildKeys(begin, end,
+                    [](const auto& item) -> const std::string& {
+                        return item.first;
+                    },
+                    [](Node* node, const auto& item, auto& allocator) {
+                        node->setValue(item.second, allocator);
+                    });
+}
+
+template <typename V, typename Policy>
+FrozenTrieMap<V> TrieMap<char, V, Policy>::freeze() {
+    FrozenTrieMap<V> frozen;
+    frozen.clear();
+    this->walkLevelOrder([&frozen](Node* node, const uint8_t* labels, size_t count) {
+        frozen.appendNode(node ? &node->getReferenceValue() : nullptr, labels, count);
+    });
+    frozen.finish();
+    return frozen;
+}
+
+template <typename V, typename Policy>
+DoubleArrayTrieMap<V> TrieMap<char, V, Policy>::buildDoubleArray() {
+    std::vector<std::string> keys;
+    std::vector<V> values;
+    this->walkKeys([&keys, &values](const std::string& key, Node* node) {
+        keys.push_back(key);
+        values.push_back(node->getReferenceValue());
+    });
+    DoubleArrayTrieMap<V> darray;
+    darray.build(keys, std::move(values));
+    return darray;
+}
+
+template <typename V, typename Policy>
+AhoCorasickMap<V> TrieMap<char, V, Policy>::buildAhoCorasick() {
+    std::vector<std::string> keys;
+    std::vector<V> values;
+    this->walkKeys([&keys, &values](const std::string& key, Node* node) {
+        keys.push_back(key);
+        values.push_back(node->getReferenceValue());
+    });
+    AhoCorasickMap<V> automaton;
+    automaton.build(keys, std::move(values));
+    return automaton;
 }
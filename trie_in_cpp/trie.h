@@ -6,56 +6,743 @@
     Jim Walker (jim.w.walker@gmail.com)
 **/
 
+#pragma once
+
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <deque>
+#include <initializer_list>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include "utilities/trienode.h"
+#include "utilities/trie_louds.h"
+#include "utilities/trie_darray.h"
+#include "utilities/trie_aho.h"
+#include "utilities/trie_instrument.h"
+
+/**
+    How a TrieImpl lays out keys.
+
+    Expanded       - one node per key element.
+    PathCompressed - chains of single child nodes are collapsed into one
+                     node which stores the run of elements (a radix or
+                     Patricia trie). Long keys with unique tails need far
+                     fewer nodes and far fewer pointer loads per lookup.
+**/
+enum class TrieLayout {
+    Expanded,
+    PathCompressed
+};
+
+/**
+    A key of K elements held contiguously by the caller (a std::vector,
+    std::array, C array or any slice of one), in the way of
+    std::span<const K> which C++17 does not have. The generic Trie and
+    TrieMap take keys as a TrieKeySpan so a key is never copied into a
+    std::vector to be looked up or inserted (char keys take a
+    std::string_view).
+
+    Only a view, the elements must outlive it. A braced list ({1, 2, 3})
+    is only valid as a call argument.
+**/
+template <typename K>
+class TrieKeySpan {
+public:
+
+    TrieKeySpan()
+      : first(nullptr),
+        last(nullptr) {}
+
+    TrieKeySpan(const K* begin, const K* end)
+      : first(begin),
+        last(end) {}
+
+    TrieKeySpan(const K* data, size_t size)
+      : first(data),
+        last(data + size) {}
+
+    TrieKeySpan(const std::vector<K>& key)
+      : first(key.data()),
+        last(key.data() + key.size()) {}
+
+    template <size_t N>
+    TrieKeySpan(const std::array<K, N>& key)
+      : first(key.data()),
+        last(key.data() + N) {}
+
+    template <size_t N>
+    TrieKeySpan(const K (&key)[N])
+      : first(key),
+        last(key + N) {}
+
+    TrieKeySpan(std::initializer_list<K> key)
+      : first(std::data(key)),
+        last(std::data(key) + key.size()) {}
+
+    /**
+        [begin, end) of a contiguous container, e.g. the iterators of a
+        std::vector<K>.
+    **/
+    template <typename Itr,
+              typename = typename std::enable_if<!std::is_pointer<Itr>::value>::type>
+    TrieKeySpan(Itr begin, Itr end)
+      : first(begin == end ? nullptr : std::addressof(*begin)),
+        last(first + (end - begin)) {}
+
+    const K* begin() const {
+        return first;
+    }
+
+    const K* end() const {
+        return last;
+    }
+
+    const K* data() const {
+        return first;
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(last - first);
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+
+private:
+    const K* first;
+    const K* last;
+};
+
+/**
+    Policy Locking option: the trie is partitioned by the first element
+    of each key into Shards sub-tries, each with its own lock, root and
+    allocator. Operations on different shards never contend, with a
+    std::shared_mutex the readers of one shard do not contend either.
+
+    A key and every key it prefixes share a first element, so all of the
+    lookups stay within one shard.
+**/
+template <size_t Shards, typename M = std::shared_mutex>
+struct TrieShardedLocking {
+    static_assert(Shards > 0, "TrieShardedLocking needs at least one shard");
+    static const bool optimistic = false;
+    static const size_t shards = Shards;
+    typedef M Mutex;
+};
+
+/**
+    Policy Locking option: one mutex serialises every operation.
+**/
+struct TrieMutexLocking : TrieShardedLocking<1, std::mutex> {};
+
+/**
+    The lock held by a reader of a shard, shared if the mutex allows it.
+**/
+template <typename Mutex>
+using TrieReadLock = typename std::conditional<std::is_same<Mutex, std::shared_mutex>::value,
+                                               std::shared_lock<Mutex>,
+                                               std::lock_guard<Mutex> >::type;
+
+/**
+    The movable form of TrieReadLock, held by a TrieImpl::Cursor.
+**/
+template <typename Mutex>
+using TrieCursorLock = typename std::conditional<std::is_same<Mutex, std::shared_mutex>::value,
+                                                 std::shared_lock<Mutex>,
+                                                 std::unique_lock<Mutex> >::type;
+
+/**
+    The memory and shape of a trie, see TrieImpl::stats.
+
+    Bytes are what the trie asked its allocator for, not counting any
+    rounding or slab overhead of the allocator (a map's child storage is
+    an estimate). The root node of each shard is part of the TrieImpl so
+    is not in nodes or nodeBytes.
+**/
+struct TrieStats {
+    // false if only the counters were read, then fanout, childBytes,
+    // segmentBytes and keyDepths are left empty
+    bool exact = false;
+
+    size_t keys = 0;
+    // the length of every key added together
+    size_t keyElements = 0;
+    size_t nodes = 0;
+
+    // nodes by how many children they have: 0, 1, 2-4, 5-16, 17-48,
+    // 49-256 and more. For char nodes these are the child layouts
+    // (TrieNode<char>::Kind) as a node grows into them.
+    static const size_t fanoutClasses = 7;
+    std::array<size_t, fanoutClasses> fanout{};
+
+    // the nodes themselves, without their value slot
+    size_t nodeBytes = 0;
+    // child layouts, packed arrays and maps
+    size_t childBytes = 0;
+    // path compressed segments
+    size_t segmentBytes = 0;
+    // value slots, a pointer or small value in every node of a TrieMap
+    // and a slot for each key's value (see TrieMapNode)
+    size_t valueBytes = 0;
+
+    // keyDepths[d] is how many keys end d nodes below the root, the
+    // number of nodes a lookup of the key visits
+    std::vector<size_t> keyDepths;
+
+    static size_t fanoutClass(size_t children) {
+        static const size_t limits[fanoutClasses - 1] = {0, 1, 4, 16, 48, 256};
+        return std::lower_bound(limits, limits + fanoutClasses - 1, children) - limits;
+    }
+
+    static const char* fanoutName(size_t fanoutClass) {
+        static const char* names[fanoutClasses] = {
+            "0", "1", "2-4", "5-16", "17-48", "49-256", "257+"
+        };
+        return names[fanoutClass];
+    }
+
+    size_t totalBytes() const {
+        return nodeBytes + childBytes + segmentBytes + valueBytes;
+    }
+
+    double averageKeyLength() const {
+        return keys ? double(keyElements) / keys : 0;
+    }
+
+    double bytesPerKey() const {
+        return keys ? double(totalBytes()) / keys : 0;
+    }
+};
+
+/**
+    Compile time options for TrieImpl and so Trie/TrieMap.
+    Derive from this and override members to opt in to alternatives, e.g.
+
+        struct ArenaPolicy : DefaultTriePolicy {
+            typedef TrieArenaAllocator Allocator;
+        };
+        Trie<char, ArenaPolicy> t;
+**/
+struct DefaultTriePolicy {
+    // Where nodes and their child layouts are allocated from
+    typedef TrieHeapAllocator Allocator;
 
-template <typename Container, typename ContainerItr, typename NodeType>
+    // How concurrent operations are kept apart, TrieMutexLocking,
+    // TrieShardedLocking or TrieOptimisticLocking (see trie_olc.h)
+    typedef TrieMutexLocking Locking;
+
+    // What operations record, TrieNoInstrumentation or
+    // TrieCountingInstrumentation (see trie_instrument.h)
+    typedef TrieNoInstrumentation Instrumentation;
+};
+
+template <typename Container,
+          typename ContainerItr,
+          typename NodeType,
+          typename Policy = DefaultTriePolicy>
 class TrieImpl {
+public:
+
+    typedef typename Policy::Locking Locking;
+
+    typedef typename Policy::Instrumentation Instrumentation;
+
+    typedef typename Instrumentation::template NodeAllocator<typename Policy::Allocator> NodeAllocator;
+
+    // An optimistic trie defers every free until no reader can see it
+    typedef typename std::conditional<Locking::optimistic,
+                                      TrieEpochAllocator<NodeAllocator>,
+                                      NodeAllocator>::type Allocator;
+
+    static_assert(!Locking::optimistic || std::is_same<Container, std::string>::value,
+                  "TrieOptimisticLocking is only supported for char keys");
+    static_assert(!Locking::optimistic || Policy::Allocator::threadSafe,
+                  "TrieOptimisticLocking requires a thread safe allocator");
+    static_assert(!Locking::optimistic || Locking::shards == 1,
+                  "TrieOptimisticLocking is not sharded");
+
+    TrieImpl(TrieLayout layout = TrieLayout::Expanded)
+      : layout(layout) {}
+
+    TrieImpl(const TrieImpl&) = delete;
+    TrieImpl& operator=(const TrieImpl&) = delete;
+
+    ~TrieImpl();
+
+    TrieLayout getLayout() const {
+        return layout;
+    }
+
+    /**
+        The policy's Instrumentation, e.g.
+        getInstrumentation().read(TrieOp::Find) with
+        TrieCountingInstrumentation.
+    **/
+    const Instrumentation& getInstrumentation() const {
+        return instrumentation;
+    }
+
+    /**
+        Report the memory and shape of the trie (see TrieStats).
+
+        With exact the trie is walked, every shard is read locked for the
+        walk, which is linear in the number of nodes. Otherwise only the
+        counters kept by insert and erase are read, which is O(1) and
+        takes no lock so suits periodic monitoring of a live trie.
+        An exact walk of an optimistic trie must not have writers running.
+    **/
+    TrieStats stats(bool exact = true);
+
+    /**
+        Ordered iteration over the keys, in the order of the node's idLess
+        (std::string order for char keys).
+
+        A cursor keeps an explicit stack of the sorted children of each
+        node on the path to its key and one key buffer, so its memory is
+        bounded by the depth of the trie however many keys it passes.
+
+        A cursor holds the read lock of every shard until it is destroyed
+        (shared only with a std::shared_mutex, so a thread must not hold
+        two cursors of a TrieMutexLocking trie), writers wait for it. To
+        page through a large range with writers running, take a page of
+        keys, drop the cursor and continue from upperBound(last key).
+        Not supported with TrieOptimisticLocking.
+    **/
+    class Cursor {
+    public:
+
+        Cursor(Cursor&&) = default;
+        Cursor& operator=(Cursor&&) = default;
+
+        /**
+            False once the cursor has passed the last key.
+        **/
+        bool valid() const {
+            return current != nullptr;
+        }
+
+        /**
+            Move to the next key.
+        **/
+        void next();
+
+        /**
+            The current key, only valid until next().
+        **/
+        const Container& key() const {
+            return keyBuffer;
+        }
+
+        /**
+            The current key's value (TrieMap only).
+        **/
+        auto& value() const {
+            return current->getReferenceValue();
+        }
+
+    private:
+
+        friend class TrieImpl;
+
+        explicit Cursor(TrieImpl& trie);
+
+        struct Frame {
+            // sorted children of the node and the next to visit
+            std::vector<NodeType*> children;
+            size_t next;
+            // the length of the node's key
+            size_t keyLength;
+        };
+
+        /**
+            Push a frame for node, whose key is the key buffer.
+        **/
+        void pushChildren(NodeType* node);
+
+        /**
+            Push the frame of the root, the children of every shard.
+        **/
+        void pushRoot(TrieImpl& trie);
+
+        /**
+            Set the key buffer to the key of child of the top frame.
+        **/
+        void setChildKey(NodeType* child);
+
+        /**
+            Move to the first key which is not less than (inclusive) or
+            greater than [begin, end).
+        **/
+        void seek(TrieImpl& trie, const ContainerItr begin, const ContainerItr end, bool inclusive);
+
+        std::vector<TrieCursorLock<typename Locking::Mutex> > locks;
+        // frames [0, depth) are in use, the rest are kept for reuse
+        std::vector<Frame> frames;
+        size_t depth;
+        Container keyBuffer;
+        NodeType* current;
+    };
+
+    /**
+        A cursor at the first key.
+    **/
+    Cursor cursor();
+
+    /**
+        A cursor at the first key not less than [begin, end).
+    **/
+    Cursor lowerBound(const ContainerItr begin, const ContainerItr end);
+
+    /**
+        A cursor at the first key greater than [begin, end).
+    **/
+    Cursor upperBound(const ContainerItr begin, const ContainerItr end);
+
+    /**
+        A cursor over only the keys which start with [begin, end),
+        including that key itself.
+    **/
+    Cursor prefixCursor(const ContainerItr begin, const ContainerItr end);
+
+    /**
+        lowerBound, upperBound and prefixCursor for a key held in any
+        contiguous container, e.g. by std::vector<K>::iterator.
+    **/
+    template <typename Itr>
+    Cursor lowerBound(Itr begin, Itr end) {
+        TrieKeySpan<typename Container::value_type> key(begin, end);
+        return lowerBound(key.begin(), key.end());
+    }
+
+    template <typename Itr>
+    Cursor upperBound(Itr begin, Itr end) {
+        TrieKeySpan<typename Container::value_type> key(begin, end);
+        return upperBound(key.begin(), key.end());
+    }
+
+    template <typename Itr>
+    Cursor prefixCursor(Itr begin, Itr end) {
+        TrieKeySpan<typename Container::value_type> key(begin, end);
+        return prefixCursor(key.begin(), key.end());
+    }
+
 protected:
 
+    /**
+        findKey and prefixFindKey return a node which the caller keeps
+        using after the call, so they are only available with
+        TrieMutexLocking. visitKey/visitPrefix work with either locking.
+    **/
     NodeType* findKey(const ContainerItr begin, const ContainerItr end);
 
-    NodeType* insertKey(const Container& key);
-
     NodeType* prefixFindKey(const ContainerItr begin, const ContainerItr end);
 
-    NodeType* eraseKey(const Container& key);
+    /**
+        Insert key [begin, end) and call visit(node, allocator) on the
+        key's node before any other operation can see it, allocator being
+        the one the node was allocated from (for its value).
+    **/
+    template <typename Visitor>
+    void insertKey(const ContainerItr begin, const ContainerItr end, Visitor visit);
+
+    void insertKey(const ContainerItr begin, const ContainerItr end) {
+        insertKey(begin, end, [](NodeType*, auto&) {});
+    }
+
+    /**
+        If key is in the Trie call visit(node) on its node and return true.
+        With TrieOptimisticLocking visit may be called more than once and
+        on a node which is being changed, only the final call is valid so
+        visit should just copy out what it needs.
+    **/
+    template <typename Visitor>
+    bool visitKey(const ContainerItr begin, const ContainerItr end, Visitor visit);
+
+    /**
+        As visitKey, for the first key in the Trie which prefixes key.
+    **/
+    template <typename Visitor>
+    bool visitPrefix(const ContainerItr begin, const ContainerItr end, Visitor visit);
+
+    /**
+        As visitPrefix, for the longest key in the Trie which prefixes
+        key, calling visit(node, length) with the number of elements it
+        covers. One walk of key's path, nothing is allocated.
+    **/
+    template <typename Visitor>
+    bool visitLongestPrefix(const ContainerItr begin, const ContainerItr end, Visitor visit);
+
+    /**
+        Call visit(node, length) for every key in the Trie which prefixes
+        key, shortest first, in one walk of key's path (nothing is
+        allocated). As with visitPrefix the empty key is not a prefix.
+        Returns true if visit was called. Requires TrieMutexLocking (or
+        sharded locking) as a restart would repeat the calls.
+    **/
+    template <typename Visitor>
+    bool visitAllPrefixes(const ContainerItr begin, const ContainerItr end, Visitor visit);
+
+    /**
+        Look up count keys, keyAt(i) returning the std::pair of begin/end
+        of the i'th, and call visit(i, node) for each key found (or with
+        prefix, for each key which a key in the Trie prefixes, as
+        visitPrefix).
+
+        Up to batchWidth lookups advance in lockstep. Each step of a
+        lookup starts loading the memory its next step reads (the next
+        node, then that node's segment and children) and moves on to
+        another lookup, so the cache misses of different keys overlap
+        rather than being taken one after another.
+
+        Every shard is locked for the whole batch. With
+        TrieOptimisticLocking the keys are looked up one at a time.
+    **/
+    template <typename KeyAt, typename Visitor>
+    void visitBatch(size_t count, KeyAt keyAt, bool prefix, Visitor visit);
+
+    static const size_t batchWidth = 16;
+
+    /**
+        Erase key [begin, end), returns true if the key was in the Trie.
+    **/
+    bool eraseKey(const ContainerItr begin, const ContainerItr end);
+
+    /**
+        Insert the items [begin, end), keyOf(item) returns an item's key
+        and visit(node, item, allocator) is called on the node of each key
+        (the last of any duplicates wins), see insertKey.
+
+        The items are ordered by key (without copying them) unless they
+        already are. If the trie is empty it is then built in one pass,
+        each key only walks from the prefix it shares with the previous
+        key and each node is allocated once, complete with its final
+        segment and child layout. A trie which already has keys falls back
+        to inserting each item.
+    **/
+    template <typename Itr, typename KeyOf, typename Visitor>
+    void buildKeys(Itr begin, Itr end, KeyOf keyOf, Visitor visit);
+
+    /**
+        Walk the trie in level (breadth first) order for freeze, calling
+        visit(node, labels, count) for each node with the sorted unsigned
+        labels of its children. A path compressed segment is walked as a
+        chain of nodes, one per element. node is the NodeType if the step
+        ends a key, else nullptr.
+        char keys only. An optimistic trie must not have writers running.
+    **/
+    template <typename Visitor>
+    void walkLevelOrder(Visitor visit);
+
+    /**
+        Walk the keys in sorted (unsigned byte) order, calling
+        visit(key, node) with each key (std::string) and the NodeType which
+        ends it.
+        char keys only. An optimistic trie must not have writers running.
+    **/
+    template <typename Visitor>
+    void walkKeys(Visitor visit);
 
 private:
 
-    NodeType* deleteNode(NodeType* node,
-                         const Container& key,
-                         typename Container::const_iterator& itr);
+    typedef typename Container::value_type Element;
+
+    /**
+        An independent sub-trie, see TrieShardedLocking. Each is cache
+        line aligned so that the locks of two shards never share a line.
+    **/
+    struct alignas(64) Shard {
+        // Declared before root so that it outlives the nodes
+        Allocator allocator;
+
+        NodeType root;
+
+        // coarse grain locking for safe shared usage (not used by
+        // TrieOptimisticLocking)
+        typename Locking::Mutex lock;
+
+        // Kept by every insert/erase for stats(false)
+        std::atomic<size_t> keyCount{0};
+        std::atomic<size_t> keyElements{0};
+        std::atomic<size_t> nodeCount{0};
+    };
+
+    /**
+        A key of length elements was added to (or removed from) shard.
+    **/
+    static void countKey(Shard& shard, size_t length, bool added) {
+        if (added) {
+            shard.keyCount.fetch_add(1, std::memory_order_relaxed);
+            shard.keyElements.fetch_add(length, std::memory_order_relaxed);
+        } else {
+            shard.keyCount.fetch_sub(1, std::memory_order_relaxed);
+            shard.keyElements.fetch_sub(length, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+        Match a node's segment against the key elements at itr.
+        itr is moved past the matched elements and the number of matching
+        elements is returned.
+    **/
+    template <typename Itr>
+    static uint32_t matchSegment(const TrieSegmentView<Element>& segment,
+                                 Itr& itr,
+                                 const Itr end);
+
+    /**
+        The optimistic (TrieOptimisticLocking) forms of the operations,
+        see trie_olc.h.
+    **/
+    template <typename Visitor>
+    bool visitOptimistic(const ContainerItr begin,
+                         const ContainerItr end,
+                         bool prefix,
+                         bool longest,
+                         Visitor visit);
+
+    typedef typename Instrumentation::Probe Probe;
 
-    NodeType root;
+    /**
+        Walk key's path in shard (which the caller has locked) calling
+        visit(node, length) on each terminator.
+    **/
+    template <typename Visitor>
+    void walkPrefixes(Shard& shard, const ContainerItr begin, const ContainerItr end, Visitor visit);
+
+    template <typename Visitor>
+    void insertOptimistic(const ContainerItr begin, const ContainerItr end, Visitor visit);
+
+    bool eraseOptimistic(const ContainerItr begin, const ContainerItr end);
+
+    /**
+        Merge child into its only child if the only child can be locked.
+        parent and child must be write locked, child is unlocked (and
+        freed) if the merge happens.
+    **/
+    bool tryMergeNode(Shard& shard, NodeType* parent, NodeType* child);
+
+    /**
+        The sorted, single pass part of buildKeys, with every shard locked
+        and empty.
+    **/
+    template <typename Item, typename KeyOf, typename Visitor>
+    void buildSorted(const std::vector<const Item*>& items, KeyOf& keyOf, Visitor& visit);
+
+    /**
+        Build the nodes for the elements [it, end) of a key, the first
+        node is returned and the last is set through last.
+    **/
+    NodeType* newTail(Shard& shard,
+                      ContainerItr it,
+                      const ContainerItr end,
+                      NodeType*& last);
+
+    /**
+        Split the edge into child after 'length' elements of its segment.
+        A new node takes child's place in parent holding the first part of
+        the edge, child keeps the rest along with its children, terminator
+        and any value. Returns the new node.
+    **/
+    NodeType* splitNode(Shard& shard, NodeType* parent, NodeType* child, uint32_t length);
+
+    /**
+        child has a single child and does not terminate a key, so collapse
+        the pair into one node.
+    **/
+    void mergeNode(Shard& shard, NodeType* parent, NodeType* child);
+
+    bool deleteNode(Shard& shard,
+                    NodeType* node,
+                    ContainerItr itr,
+                    const ContainerItr end);
+
+    static NodeType* newNode(Shard& shard, Element id) {
+        shard.nodeCount.fetch_add(1, std::memory_order_relaxed);
+        return trieNew<NodeType>(shard.allocator, id);
+    }
 
-    // coarse grain locking for safe shared usage
-    std::mutex lock;
+    static void freeNode(Shard& shard, NodeType* node) {
+        shard.nodeCount.fetch_sub(1, std::memory_order_relaxed);
+        node->release(shard.allocator);
+        trieDelete(shard.allocator, node);
+    }
+
+    /**
+        The allocator which really frees, usable once no thread can be
+        reading the trie.
+    **/
+    static auto& getDirectAllocator(Shard& shard) {
+        if constexpr (Locking::optimistic) {
+            return shard.allocator.getUnderlying();
+        } else {
+            return shard.allocator;
+        }
+    }
+
+    /**
+        The shard holding keys which start with *begin, the empty key is
+        in the first shard.
+    **/
+    template <typename Itr>
+    Shard& getShard(Itr begin, Itr end) {
+        if (Locking::shards == 1 || begin == end) {
+            return shards[0];
+        }
+        return shards[std::hash<Element>()(*begin) % Locking::shards];
+    }
+
+    const TrieLayout layout;
+
+    Instrumentation instrumentation;
+
+    Shard shards[Locking::shards];
 };
 
 /**
- * generic Trie which works on a std::vector of K
+ * generic Trie which works on keys of K, a std::vector<K> or any other
+ * contiguous run of K (see TrieKeySpan)
  */
-template <typename K>
-class Trie : public TrieImpl<std::vector<K>, typename std::vector<K>::iterator, TrieNode<K> > {
+template <typename K, typename Policy = DefaultTriePolicy>
+class Trie : public TrieImpl<std::vector<K>,
+                             const K*,
+                             TrieNode<K>,
+                             Policy> {
 public:
 
+    Trie(TrieLayout layout = TrieLayout::Expanded)
+      : TrieImpl<std::vector<K>,
+                 const K*,
+                 TrieNode<K>,
+                 Policy>(layout) {}
+
     /**
         Does a key exist?
-        Pass the start and end of a key to search for.
     **/
-    bool exists(const typename std::vector<K>::iterator begin,
-                const typename std::vector<K>::iterator end);
+    bool exists(TrieKeySpan<K> key);
+
+    /**
+        Pass the start and end of a key to search for (pointers or the
+        iterators of a contiguous container).
+    **/
+    template <typename Itr>
+    bool exists(Itr begin, Itr end) {
+        return exists(TrieKeySpan<K>(begin, end));
+    }
 
     /**
         Insert an item into the Trie
     **/
-    void insert(const std::vector<K>& key);
+    void insert(TrieKeySpan<K> key);
 
     /**
      * Is key prefixed with a key in the Trie?
@@ -64,32 +751,53 @@ public:
      *  prefixFind("ham::small") -> true
      *  prefixFind("hatter") -> false
      */
-    bool prefixExists(const typename std::vector<K>::iterator begin,
-                      const typename std::vector<K>::iterator end);
+    bool prefixExists(TrieKeySpan<K> key);
+
+    template <typename Itr>
+    bool prefixExists(Itr begin, Itr end) {
+        return prefixExists(TrieKeySpan<K>(begin, end));
+    }
 
     /**
      * Erase key from Trie.
      */
-    void erase(const std::vector<K>& key);
+    void erase(TrieKeySpan<K> key);
+
+    /**
+        Insert every key (std::vector<K>) of [begin, end). An empty Trie is
+        built in one pass, quickest if the keys are already sorted.
+    **/
+    template <typename Itr>
+    void bulkInsert(Itr begin, Itr end);
 };
 
 /**
  * char/std::std::string specialisation of Trie
  */
-template <>
-class Trie<char> : public TrieImpl<std::string, const char*, TrieNode<char> > {
+template <typename Policy>
+class Trie<char, Policy> : public TrieImpl<std::string,
+                                           const char*,
+                                           TrieNode<char>,
+                                           Policy> {
 public:
 
+    Trie(TrieLayout layout = TrieLayout::Expanded)
+      : TrieImpl<std::string, const char*, TrieNode<char>, Policy>(layout) {}
+
     /**
         Does a key exist?
         Pass the start and end of a key to search for.
     **/
     bool exists(const char* begin, const char* end);
 
+    bool exists(std::string_view key) {
+        return exists(key.data(), key.data() + key.size());
+    }
+
     /**
         Insert an item into the Trie
     **/
-    void insert(const std::string& key);
+    void insert(std::string_view key);
 
     /**
      * Is key prefixed with a key in the Trie?
@@ -100,32 +808,92 @@ public:
      */
     bool prefixExists(const char* begin, const char* end);
 
+    bool prefixExists(std::string_view key) {
+        return prefixExists(key.data(), key.data() + key.size());
+    }
+
+    /**
+        exists for each key (std::string) of the random access range
+        [begin, end), results[i] being the answer for the i'th. The
+        lookups are interleaved so their cache misses overlap
+        (TrieImpl::visitBatch), much quicker than a loop of exists on a
+        trie larger than the cache.
+        Returns how many exist.
+    **/
+    template <typename Itr>
+    size_t existsBatch(Itr begin, Itr end, bool* results);
+
+    /**
+        prefixExists for each key of [begin, end), see existsBatch.
+    **/
+    template <typename Itr>
+    size_t prefixExistsBatch(Itr begin, Itr end, bool* results);
+
     /**
      * Erase key from Trie.
      */
-    void erase(const std::string& key);
+    void erase(std::string_view key);
+
+    /**
+        Insert every key (std::string) of [begin, end). An empty Trie is
+        built in one pass, quickest if the keys are already sorted.
+    **/
+    template <typename Itr>
+    void bulkInsert(Itr begin, Itr end);
+
+    /**
+        Copy the Trie into a read only succinct FrozenTrie (trie_louds.h).
+    **/
+    FrozenTrie freeze();
+
+    /**
+        Copy the Trie into a read only DoubleArrayTrie (trie_darray.h).
+    **/
+    DoubleArrayTrie buildDoubleArray();
+
+    /**
+        Write the Trie to a file which DoubleArrayTrie::open maps and
+        queries without loading it (trie_darray.h).
+    **/
+    void save(const std::string& path) {
+        buildDoubleArray().save(path);
+    }
+
+    /**
+        Compile the keys into an AhoCorasick scanner (trie_aho.h).
+    **/
+    AhoCorasick buildAhoCorasick();
 };
 
 /**
- * generic Trie map which works on a std::vector of K mapped to V
+ * generic Trie map which works on keys of K (see Trie) mapped to V
  */
-template <typename K, typename V>
+template <typename K, typename V, typename Policy = DefaultTriePolicy>
 class TrieMap : public TrieImpl<std::vector<K>,
-                                typename std::vector<K>::iterator,
-                                TrieMapNode<K, V> >  {
+                                const K*,
+                                TrieMapNode<K, V>,
+                                Policy>  {
 public:
 
+    typedef TrieMapNode<K, V> Node;
+
+    TrieMap(TrieLayout layout = TrieLayout::Expanded)
+      : TrieImpl<std::vector<K>,
+                 const K*,
+                 Node,
+                 Policy>(layout) {}
+
     class iterator {
     public:
 
-        iterator(const iterator&);
+        iterator(const iterator&) = default;
 
         V& operator*() const {
             return node->getReferenceValue();
         }
 
         friend bool operator==(const iterator& a, const iterator& b) {
-            return b.node->getId() == a.node->getId();
+            return a.node == b.node;
         }
 
         friend bool operator!=(const iterator& a, const iterator& b) {
@@ -134,11 +902,11 @@ public:
 
     private:
 
-        friend class TrieMap<K, V>;
-        iterator(TrieMapNode<char, V>* n)
+        friend class TrieMap<K, V, Policy>;
+        iterator(Node* n)
           : node(n) {}
 
-        TrieMapNode<char, V>* node;
+        Node* node;
     };
 
     iterator end() {
@@ -146,14 +914,23 @@ public:
     }
 
     /**
-        Find key (begin/end) return iterator to value
+        Find key return iterator to value
     **/
-    iterator find(const typename std::vector<K>::iterator begin,
-                  const typename std::vector<K>::iterator end);
+    iterator find(TrieKeySpan<K> key);
+
+    /**
+        find for the key (begin/end), pointers or the iterators of a
+        contiguous container.
+    **/
+    template <typename Itr>
+    iterator find(Itr begin, Itr end) {
+        return find(TrieKeySpan<K>(begin, end));
+    }
+
     /**
         Insert key with value
     **/
-    void insert(const std::vector<K>& key, V value);
+    void insert(TrieKeySpan<K> key, V value);
 
     /**
      * Is key prefixed with a key in the Trie?
@@ -162,28 +939,85 @@ public:
      *  prefixFind("ham::small") -> true, 99
      *  prefixFind("hatter") -> false
      */
-    iterator prefixFind(const typename std::vector<K>::iterator begin,
-                        const typename std::vector<K>::iterator end);
+    iterator prefixFind(TrieKeySpan<K> key);
+
+    template <typename Itr>
+    iterator prefixFind(Itr begin, Itr end) {
+        return prefixFind(TrieKeySpan<K>(begin, end));
+    }
+
+    /**
+     * Find the longest key in the TrieMap which prefixes key.
+     *  insert("ham", 99), insert("hamster", 101)
+     *  longestPrefixFind("hamsters") -> 101
+     *  longestPrefixFind("hamper") -> 99
+     */
+    iterator longestPrefixFind(TrieKeySpan<K> key);
+
+    template <typename Itr>
+    iterator longestPrefixFind(Itr begin, Itr end) {
+        return longestPrefixFind(TrieKeySpan<K>(begin, end));
+    }
+
+    /**
+        Call visit(length, value) for every key in the TrieMap which
+        prefixes key, shortest first, length being the prefix's length.
+        The map is locked for the walk, visit must not call back into it.
+    **/
+    template <typename Visitor>
+    void allPrefixes(TrieKeySpan<K> key, Visitor visit);
+
+    template <typename Itr, typename Visitor>
+    void allPrefixes(Itr begin, Itr end, Visitor visit) {
+        allPrefixes(TrieKeySpan<K>(begin, end), visit);
+    }
 
     /**
      * Erase key from TrieMap.
      */
-    void erase(const std::vector<K>& key);
+    void erase(TrieKeySpan<K> key);
+
+    /**
+        Insert every key/value (std::pair<std::vector<K>, V>) of
+        [begin, end). An empty TrieMap is built in one pass, quickest if
+        the pairs are already sorted by key.
+    **/
+    template <typename Itr>
+    void bulkInsert(Itr begin, Itr end);
 };
 
+/**
+    The node of a TrieMap<char, V, Policy>. An optimistic reader may read
+    a node as a writer changes it, so could follow a value pointer to a
+    slot not yet allocated or already freed. With TrieOptimisticLocking
+    every node holds its value inline.
+**/
+template <typename V, typename Policy>
+using TrieCharMapNode = TrieMapNode<char, V, Policy::Locking::optimistic ||
+                                             sizeof(V) <= sizeof(V*)>;
+
 /**
  * specialised Trie map for char which works on a std::string mapped to V
  */
-template <typename V>
-class TrieMap<char, V> : public TrieImpl<std::string,
-                                         char*,
-                                         TrieMapNode<char, V> >  {
+template <typename V, typename Policy>
+class TrieMap<char, V, Policy> : public TrieImpl<std::string,
+                                                 const char*,
+                                                 TrieCharMapNode<V, Policy>,
+                                                 Policy>  {
 public:
 
+    static_assert(!Policy::Locking::optimistic || std::is_trivially_copyable<V>::value,
+                  "TrieOptimisticLocking requires a trivially copyable value");
+
+    typedef TrieCharMapNode<V, Policy> Node;
+
+    TrieMap(TrieLayout layout = TrieLayout::Expanded)
+      : TrieImpl<std::string, const char*, Node, Policy>(layout) {}
+
     class iterator {
     public:
 
-        iterator(const iterator&);
+        iterator(const iterator&) = default;
 
         V& operator*() const {
             return node->getReferenceValue();
@@ -199,11 +1033,11 @@ public:
 
     private:
 
-        friend class TrieMap<char, V>;
-        iterator(TrieMapNode<char, V>* n)
+        friend class TrieMap<char, V, Policy>;
+        iterator(Node* n)
           : node(n) {}
 
-        TrieMapNode<char, V>* node;
+        Node* node;
     };
 
     iterator end() {
@@ -216,10 +1050,14 @@ public:
     **/
     iterator find(const char* begin, const char* end);
 
+    iterator find(std::string_view key) {
+        return find(key.data(), key.data() + key.size());
+    }
+
     /**
         Insert key with value
     **/
-    void insert(const std::string& key, V value);
+    void insert(std::string_view key, V value);
 
     /**
      * Is key prefixed with a key in the Trie?
@@ -230,10 +1068,117 @@ public:
      */
     iterator prefixFind(const char* begin, const char* end);
 
+    iterator prefixFind(std::string_view key) {
+        return prefixFind(key.data(), key.data() + key.size());
+    }
+
+    /**
+        Find key/value, copying the value out. Unlike find this is safe
+        with TrieOptimisticLocking.
+        Return true if found and returns value via 3rd parameter
+    **/
+    bool findValue(const char* begin, const char* end, V& value);
+
+    bool findValue(std::string_view key, V& value) {
+        return findValue(key.data(), key.data() + key.size(), value);
+    }
+
+    /**
+        prefixFind copying the value out, see findValue.
+    **/
+    bool prefixFindValue(const char* begin, const char* end, V& value);
+
+    bool prefixFindValue(std::string_view key, V& value) {
+        return prefixFindValue(key.data(), key.data() + key.size(), value);
+    }
+
+    /**
+        findValue for each key (std::string) of [begin, end), found[i]
+        and values[i] being the answer for the i'th (values[i] is left
+        alone if not found). See Trie<char>::existsBatch.
+        Returns how many were found.
+    **/
+    template <typename Itr>
+    size_t findBatch(Itr begin, Itr end, V* values, bool* found);
+
+    /**
+     * Find the longest key in the TrieMap which prefixes key.
+     *  insert("ham", 99), insert("hamster", 101)
+     *  longestPrefixFind("hamsters") -> 101
+     *  longestPrefixFind("hamper") -> 99
+     */
+    iterator longestPrefixFind(const char* begin, const char* end);
+
+    iterator longestPrefixFind(std::string_view key) {
+        return longestPrefixFind(key.data(), key.data() + key.size());
+    }
+
+    /**
+        longestPrefixFind copying the value out, see findValue. length
+        (if given) is set to the length of the matching key.
+    **/
+    bool longestPrefixFindValue(const char* begin,
+                                const char* end,
+                                V& value,
+                                size_t* length = nullptr);
+
+    bool longestPrefixFindValue(std::string_view key, V& value, size_t* length = nullptr) {
+        return longestPrefixFindValue(key.data(), key.data() + key.size(), value, length);
+    }
+
+    /**
+        Call visit(length, value) for every key in the TrieMap which
+        prefixes key, shortest first, length being the prefix's length.
+        The map is locked for the walk, visit must not call back into it.
+        Not supported with TrieOptimisticLocking.
+    **/
+    template <typename Visitor>
+    void allPrefixes(const char* begin, const char* end, Visitor visit);
+
+    template <typename Visitor>
+    void allPrefixes(std::string_view key, Visitor visit) {
+        allPrefixes(key.data(), key.data() + key.size(), visit);
+    }
+
     /**
      * Erase key from TrieMap.
      */
-    void erase(const std::string& key);
+    void erase(std::string_view key);
+
+    /**
+        Insert every key/value (std::pair<std::string, V>) of [begin, end).
+        An empty TrieMap is built in one pass, quickest if the pairs are
+        already sorted by key.
+    **/
+    template <typename Itr>
+    void bulkInsert(Itr begin, Itr end);
+
+    /**
+        Copy the TrieMap into a read only succinct FrozenTrieMap
+        (trie_louds.h), the values are copied.
+    **/
+    FrozenTrieMap<V> freeze();
+
+    /**
+        Copy the TrieMap into a read only DoubleArrayTrieMap
+        (trie_darray.h), the values are copied.
+    **/
+    DoubleArrayTrieMap<V> buildDoubleArray();
+
+    /**
+        Write the TrieMap to a file which DoubleArrayTrieMap<V>::open maps
+        and queries without loading it (trie_darray.h). V must be
+        trivially copyable.
+    **/
+    void save(const std::string& path) {
+        buildDoubleArray().save(path);
+    }
+
+    /**
+        Compile the keys into an AhoCorasickMap scanner (trie_aho.h), the
+        values are copied.
+    **/
+    AhoCorasickMap<V> buildAhoCorasick();
 };
 
 #include "trie.cc"
\ No newline at end of file
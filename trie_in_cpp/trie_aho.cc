@@ -0,0 +1,113 @@
+/**
+ * Build the trie of the keys as rows of classCount transitions, then
+ * visit it breadth first so that a state's failure state (always
+ * shallower) is complete before the state itself. A missing transition
+ * becomes the failure state's transition on the same class.
+ */
+inline void AhoCorasick::build(const std::vector<std::string>& keys) {
+    this->keys = keys;
+
+    std::fill(std::begin(classes), std::end(classes), 0);
+    for (const std::string& key : keys) {
+        for (char c : key) {
+            classes[static_cast<uint8_t>(c)] = 1;
+        }
+    }
+    classCount = 1;
+    for (uint8_t& c : classes) {
+        if (c) {
+            c = static_cast<uint8_t>(classCount++);
+        }
+    }
+    // Every byte is used, there is no need for a shared class
+    if (classCount > 256) {
+        for (size_t b = 0; b < 256; b++) {
+            classes[b] = static_cast<uint8_t>(b);
+        }
+        classCount = 256;
+    }
+
+    // The goto trie, 0 is "no transition" as the root is nobody's child
+    std::vector<uint32_t> next(classCount, 0);
+    outputs.assign(1, Output{none, none});
+    for (uint32_t k = 0; k < keys.size(); k++) {
+        if (keys[k].empty()) {
+            continue;
+        }
+        uint32_t state = 0;
+        for (char c : keys[k]) {
+            const size_t slot = state * classCount + classes[static_cast<uint8_t>(c)];
+            if (!next[slot]) {
+                next[slot] = static_cast<uint32_t>(outputs.size());
+                outputs.push_back(Output{none, none});
+                next.resize(next.size() + classCount, 0);
+            }
+            state = next[slot];
+        }
+        outputs[state].key = k;
+    }
+
+    // Breadth first, resolving each row against its failure state's row
+    const uint32_t states = static_cast<uint32_t>(outputs.size());
+    std::vector<uint32_t> fail(states, 0);
+    std::vector<uint32_t> queue;
+    queue.reserve(states);
+    for (size_t c = 0; c < classCount; c++) {
+        if (next[c]) {
+            queue.push_back(next[c]);
+        }
+    }
+    for (size_t q = 0; q < queue.size(); q++) {
+        const uint32_t state = queue[q];
+        const uint32_t failure = fail[state];
+        outputs[state].link = outputs[failure].key != none ? failure : outputs[failure].link;
+        for (size_t c = 0; c < classCount; c++) {
+            uint32_t& child = next[state * classCount + c];
+            const uint32_t failureNext = next[failure * classCount + c];
+            if (child) {
+                fail[child] = failureNext;
+                queue.push_back(child);
+            } else {
+                child = failureNext;
+            }
+        }
+    }
+
+    if (next.size() > outputFlag) {
+        throw std::length_error("AhoCorasick: too many states");
+    }
+
+    // Premultiply the rows and flag the states which report something
+    transitions.resize(next.size());
+    for (size_t i = 0; i < next.size(); i++) {
+        const uint32_t state = next[i];
+        const Output& output = outputs[state];
+        transitions[i] = static_cast<uint32_t>(state * classCount) |
+                         (output.key != none || output.link != none ? outputFlag : 0);
+    }
+}
+
+template <typename Visitor>
+void AhoCorasick::scanIndexes(Scanner& scanner, const char* begin, const char* end, Visitor visit) const {
+    const uint32_t* table = transitions.data();
+    const uint64_t base = scanner.offset;
+    uint32_t row = scanner.state;
+    for (const char* p = begin; p != end; p++) {
+        const uint32_t entry = table[row + classes[static_cast<uint8_t>(*p)]];
+        row = entry & ~outputFlag;
+        if (entry & outputFlag) {
+            // offset of the byte after the match
+            const uint64_t matchEnd = base + (p - begin) + 1;
+            for (uint32_t state = static_cast<uint32_t>(row / classCount);
+                 state != none;
+                 state = outputs[state].link) {
+                const uint32_t key = outputs[state].key;
+                if (key != none) {
+                    visit(matchEnd - keys[key].size(), key);
+                }
+            }
+        }
+    }
+    scanner.state = row;
+    scanner.offset = base + (end - begin);
+}
@@ -0,0 +1,174 @@
+/**
+    Aho-Corasick multi-pattern scanner.
+
+    Trie<char>::buildAhoCorasick() and TrieMap<char, V>::buildAhoCorasick()
+    compile the keys into an automaton which finds every occurrence of
+    every key in a text in one pass, however many keys there are.
+
+    The automaton is the trie of the keys with failure links (the state of
+    the longest proper suffix of the text so far which is also on a key's
+    path) resolved into a complete transition table, so each byte of text
+    is one table lookup and never backtracks. Output links chain each state
+    to the nearest state on its failure path which ends a key, so every
+    key ending at a position is reported.
+
+    To keep the table small the bytes are mapped to classes first: each
+    byte used by a key has its own class and every other byte shares class
+    0. The table is states x classes entries of 4 bytes, fine for keyword
+    sets but a dictionary of long keys will be large.
+
+    Text can be scanned in chunks, a Scanner carries the state (and the
+    stream offset) from one chunk to the next. The automaton is read only
+    so any number of threads may scan with their own Scanner.
+
+    The empty key is ignored, it would match at every offset.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class AhoCorasick {
+public:
+
+    /**
+        The position in a stream of text, pass the same Scanner to each
+        scan of consecutive chunks.
+    **/
+    class Scanner {
+    public:
+        Scanner()
+          : state(0),
+            offset(0) {}
+
+        /**
+            Start a new stream.
+        **/
+        void reset() {
+            state = 0;
+            offset = 0;
+        }
+
+        /**
+            Bytes scanned so far.
+        **/
+        uint64_t getOffset() const {
+            return offset;
+        }
+
+    private:
+        friend class AhoCorasick;
+        uint32_t state;
+        uint64_t offset;
+    };
+
+    /**
+        An automaton which matches nothing.
+    **/
+    AhoCorasick() {
+        build(std::vector<std::string>());
+    }
+
+    /**
+        Replace the automaton with one for keys, which must be unique.
+    **/
+    void build(const std::vector<std::string>& keys);
+
+    /**
+        Scan [begin, end) as the next chunk of scanner's stream, calling
+        visit(offset, key) for every occurrence of every key, offset being
+        the stream position of the key's first byte (which may be in an
+        earlier chunk). Matches are reported in order of where they end,
+        those ending at the same byte longest first.
+    **/
+    template <typename Visitor>
+    void scan(Scanner& scanner, const char* begin, const char* end, Visitor visit) const {
+        scanIndexes(scanner, begin, end, [this, &visit](uint64_t offset, uint32_t index) {
+            visit(offset, keys[index]);
+        });
+    }
+
+    size_t getStateCount() const {
+        return outputs.size();
+    }
+
+    size_t getClassCount() const {
+        return classCount;
+    }
+
+    /**
+        Bytes used by the automaton (excluding the keys).
+    **/
+    size_t getMemoryBytes() const {
+        return transitions.size() * sizeof(uint32_t) +
+               outputs.size() * sizeof(Output) + sizeof(classes);
+    }
+
+protected:
+
+    /**
+        As scan, calling visit(offset, index) with the key's number.
+    **/
+    template <typename Visitor>
+    void scanIndexes(Scanner& scanner, const char* begin, const char* end, Visitor visit) const;
+
+    std::vector<std::string> keys;
+
+private:
+
+    // A transition entry is the next state's row (state x classCount)
+    // with outputFlag set if that state has anything to report.
+    static const uint32_t outputFlag = 0x80000000;
+    static const uint32_t none = UINT32_MAX;
+
+    struct Output {
+        // the key which ends at this state or none
+        uint32_t key;
+        // the next state on the failure path which ends a key or none
+        uint32_t link;
+    };
+
+    uint8_t classes[256];
+    size_t classCount;
+    std::vector<uint32_t> transitions;
+    std::vector<Output> outputs;
+};
+
+/**
+    An AhoCorasick which reports each key's value.
+**/
+template <typename V>
+class AhoCorasickMap : public AhoCorasick {
+public:
+
+    /**
+        As AhoCorasick::build, values[i] is the value of keys[i].
+    **/
+    void build(const std::vector<std::string>& keys, std::vector<V> values) {
+        AhoCorasick::build(keys);
+        this->values = std::move(values);
+    }
+
+    /**
+        As AhoCorasick::scan, calling visit(offset, key, value).
+    **/
+    template <typename Visitor>
+    void scan(Scanner& scanner, const char* begin, const char* end, Visitor visit) const {
+        this->scanIndexes(scanner, begin, end, [this, &visit](uint64_t offset, uint32_t index) {
+            visit(offset, this->keys[index], values[index]);
+        });
+    }
+
+private:
+    std::vector<V> values;
+};
+
+#include "utilities/trie_aho.cc"
@@ -0,0 +1,85 @@
+inline TrieArenaAllocator::TrieArenaAllocator(size_t slabSize)
+  : slabSize(slabSize),
+    freeLists(),
+    cursor(nullptr),
+    limit(nullptr),
+    large(nullptr),
+    reservedBytes(0) {}
+
+inline TrieArenaAllocator::~TrieArenaAllocator() {
+    // No need to visit anything which was allocated, just drop the slabs.
+    for (char* slab : slabs) {
+        ::operator delete(slab);
+    }
+    while (large) {
+        LargeBlock* next = large->next;
+        ::operator delete(large);
+        large = next;
+    }
+}
+
+inline void* TrieArenaAllocator::allocate(size_t bytes) {
+    if (bytes > maxSmall) {
+        LargeBlock* block = static_cast<LargeBlock*>(::operator new(sizeof(LargeBlock) + bytes));
+        block->prev = nullptr;
+        block->next = large;
+        if (large) {
+            large->prev = block;
+        }
+        large = block;
+        reservedBytes += sizeof(LargeBlock) + bytes;
+        return block + 1;
+    }
+
+    const size_t sc = sizeClass(bytes ? bytes : 1);
+    if (freeLists[sc]) {
+        FreeBlock* block = freeLists[sc];
+        freeLists[sc] = block->next;
+        return block;
+    }
+
+    const size_t rounded = sc * granularity;
+    if (static_cast<size_t>(limit - cursor) < rounded) {
+        newSlab(rounded);
+    }
+    void* p = cursor;
+    cursor += rounded;
+    return p;
+}
+
+inline void TrieArenaAllocator::deallocate(void* p, size_t bytes) {
+    if (!p) {
+        return;
+    }
+    if (bytes > maxSmall) {
+        LargeBlock* block = static_cast<LargeBlock*>(p) - 1;
+        if (block->prev) {
+            block->prev->next = block->next;
+        } else {
+            large = block->next;
+        }
+        if (block->next) {
+            block->next->prev = block->prev;
+        }
+        reservedBytes -= sizeof(LargeBlock) + bytes;
+        ::operator delete(block);
+        return;
+    }
+
+    // Keep the block on its class free list for the next allocate
+    const size_t sc = sizeClass(bytes ? bytes : 1);
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = freeLists[sc];
+    freeLists[sc] = block;
+}
+
+inline void TrieArenaAllocator::newSlab(size_t bytes) {
+    // The tail of the current slab is abandoned, it is smaller than the
+    // allocation which did not fit.
+    size_t size = bytes > slabSize ? bytes : slabSize;
+    char* slab = static_cast<char*>(::operator new(size));
+    slabs.push_back(slab);
+    cursor = slab;
+    limit = slab + size;
+    reservedBytes += size;
+}
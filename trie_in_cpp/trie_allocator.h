@@ -0,0 +1,125 @@
+/**
+    Node allocators for the Trie.
+
+    A TrieImpl allocates its nodes, their child layouts and segments
+    through an Allocator chosen by its policy (see DefaultTriePolicy).
+
+    TrieHeapAllocator - every allocation is a separate new/delete, the
+                        trie visits every node when it is destroyed.
+    TrieArenaAllocator - size-class slabs with per class free lists, so
+                         nodes are packed together, erased nodes are
+                         reused and the whole trie is released by
+                         dropping the slabs.
+
+    An allocator provides
+
+        void* allocate(size_t bytes);
+        void deallocate(void* p, size_t bytes);
+        static const bool releasesAll;
+        static const bool threadSafe;
+
+    releasesAll is true if destroying the allocator frees everything
+    allocated from it. threadSafe is true if allocate/deallocate may be
+    called from several threads at once.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+class TrieHeapAllocator {
+public:
+
+    static const bool releasesAll = false;
+    static const bool threadSafe = true;
+
+    void* allocate(size_t bytes) {
+        return ::operator new(bytes);
+    }
+
+    void deallocate(void* p, size_t) {
+        ::operator delete(p);
+    }
+};
+
+class TrieArenaAllocator {
+public:
+
+    static const bool releasesAll = true;
+    static const bool threadSafe = false;
+
+    /**
+        slabSize is the size of each block requested from the heap.
+    **/
+    TrieArenaAllocator(size_t slabSize = 1 << 20);
+
+    TrieArenaAllocator(const TrieArenaAllocator&) = delete;
+    TrieArenaAllocator& operator=(const TrieArenaAllocator&) = delete;
+
+    ~TrieArenaAllocator();
+
+    void* allocate(size_t bytes);
+
+    void deallocate(void* p, size_t bytes);
+
+    /**
+        Bytes obtained from the heap (slabs and large blocks).
+    **/
+    size_t getReservedBytes() const {
+        return reservedBytes;
+    }
+
+private:
+
+    // Allocations are rounded up to a multiple of granularity, each
+    // multiple up to maxSmall is a size class with its own free list.
+    static const size_t granularity = 16;
+    static const size_t maxSmall = 4096;
+    static const size_t classes = maxSmall / granularity + 1;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // Header of an allocation too big for a size class
+    struct alignas(16) LargeBlock {
+        LargeBlock* prev;
+        LargeBlock* next;
+    };
+
+    static size_t sizeClass(size_t bytes) {
+        return (bytes + granularity - 1) / granularity;
+    }
+
+    void newSlab(size_t bytes);
+
+    const size_t slabSize;
+    FreeBlock* freeLists[classes];
+    std::vector<char*> slabs;
+    char* cursor;
+    char* limit;
+    LargeBlock* large;
+    size_t reservedBytes;
+};
+
+/**
+    Construct/destroy a T in memory from an allocator.
+**/
+template <typename T, typename Allocator, typename... Args>
+T* trieNew(Allocator& allocator, Args&&... args) {
+    return new (allocator.allocate(sizeof(T))) T(std::forward<Args>(args)...);
+}
+
+template <typename T, typename Allocator>
+void trieDelete(Allocator& allocator, T* p) {
+    p->~T();
+    allocator.deallocate(p, sizeof(T));
+}
+
+#include "utilities/trie_allocator.cc"
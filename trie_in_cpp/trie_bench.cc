@@ -0,0 +1,1087 @@
+/**
+    Google Benchmark suite for the Trie.
+
+    Each benchmark runs over every dataset of trie_dataset.h at 10K, 100K,
+    1M and 10M keys, for each container:
+
+      container:0 - Trie (TrieMap for Find), Expanded
+      container:1 - Trie (TrieMap), PathCompressed
+      container:2 - std::unordered_set (std::unordered_map)
+      container:3 - std::set (std::map)
+      container:4 - sorted std::vector of the keys (of key, value pairs)
+                    with binary search
+      container:5 - HatTrie (HatTrieMap), trie_hat.h
+
+    so each dataset and size lists the containers one after the other,
+    with the time per op next to bytes_per_key. The standard containers
+    count what they allocate (and the heap bytes of their strings) for
+    bytes_per_key, and report allocations per key as nodes_per_key.
+    prefixExists on the std::set and sorted vector is lower_bound based,
+    on the std::unordered_set a lookup of every prefix of the key. The
+    datasets use fixed seeds so runs can be compared over time.
+
+    IntegerExists and IntegerFind run the Integers dataset alone,
+    IntegerFind as uint64_t keys in a TrieIntMap (trie_int.h, container 0
+    and 1) against std::unordered_map (2) and std::map (3).
+
+        trie_bench --benchmark_filter='Exists/dataset:1/keys:100000'
+        trie_bench --benchmark_out=results.json --benchmark_out_format=json
+
+    The 10M key runs need a few GB of memory and take minutes to set up,
+    --benchmark_filter='keys:(10|100)000/' is a quick run of the smaller
+    sizes. trie_perf.cc keeps the one off comparisons (frozen,
+    double-array, batch, throughput scaling and so on).
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "utilities/trie.h"
+#include "utilities/trie_dataset.h"
+#include "utilities/trie_hat.h"
+#include "utilities/trie_int.h"
+
+static const uint64_t keySeed = 1;
+static const uint64_t probeSeed = 2;
+
+enum class Container {
+    TrieExpanded,
+    TrieCompressed,
+    UnorderedSet,
+    OrderedSet,
+    SortedVector,
+    HatTrie
+};
+
+static TrieDataset datasetOf(const benchmark::State& state) {
+    return static_cast<TrieDataset>(state.range(0));
+}
+
+static Container containerOf(const benchmark::State& state) {
+    return static_cast<Container>(state.range(2));
+}
+
+static TrieLayout layoutOf(Container container) {
+    return container == Container::TrieCompressed ? TrieLayout::PathCompressed : TrieLayout::Expanded;
+}
+
+/**
+    The last value made by make for args, so the benchmarks which share a
+    key set (and Google Benchmark's repeated calls of one benchmark) only
+    build it once. Each T (and Tag) keeps one.
+**/
+template <typename T, typename Tag = T, typename Make>
+static T& cached(const std::vector<int64_t>& args, Make make) {
+    static std::vector<int64_t> madeFor;
+    static std::unique_ptr<T> value;
+    if (!value || madeFor != args) {
+        value.reset();
+        value = make();
+        madeFor = args;
+    }
+    return *value;
+}
+
+/**
+    The container a benchmark runs against, as cached() but only one is
+    kept whatever its type, so the 10M key containers are not all held at
+    once.
+**/
+struct UnderTest {
+    std::shared_ptr<void> value;
+    const std::type_info* type = nullptr;
+    std::vector<int64_t> args;
+};
+
+static UnderTest& underTestSlot() {
+    static UnderTest slot;
+    return slot;
+}
+
+static void releaseUnderTest() {
+    underTestSlot() = UnderTest();
+}
+
+template <typename T, typename Make>
+static T& underTest(const benchmark::State& state, Make make) {
+    UnderTest& slot = underTestSlot();
+    std::vector<int64_t> want = {state.range(0), state.range(1), state.range(2)};
+    if (!slot.value || slot.type != &typeid(T) || slot.args != want) {
+        releaseUnderTest();
+        slot.value = std::shared_ptr<T>(make());
+        slot.type = &typeid(T);
+        slot.args = want;
+    }
+    return *static_cast<T*>(slot.value.get());
+}
+
+typedef std::vector<std::string> Keys;
+
+struct ProbesTag;
+
+static const Keys& datasetKeys(const benchmark::State& state) {
+    return cached<Keys>({state.range(0), state.range(1)}, [&state]() {
+        return std::make_unique<Keys>(trieDatasetKeys(datasetOf(state), state.range(1), keySeed));
+    });
+}
+
+static const Keys& datasetProbes(const benchmark::State& state) {
+    return cached<Keys, ProbesTag>({state.range(0), state.range(1)}, [&state]() {
+        return std::make_unique<Keys>(trieDatasetProbes(datasetOf(state), state.range(1), probeSeed));
+    });
+}
+
+/**
+    Common set up, returns false (and skips the benchmark) if there are
+    no keys.
+**/
+static bool prepare(benchmark::State& state, const Keys& keys) {
+    state.SetLabel(trieDatasetName(datasetOf(state)));
+    if (keys.empty()) {
+        state.SkipWithError("no keys (is /usr/share/dict/words installed?)");
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+static void reportMemory(benchmark::State& state, T& trie) {
+    TrieStats stats = trie.stats();
+    state.counters["bytes_per_key"] = stats.bytesPerKey();
+    state.counters["nodes_per_key"] = stats.keys ? double(stats.nodes) / stats.keys : 0;
+}
+
+/**
+    Bytes and blocks currently allocated through CountingAllocator, the
+    benchmarks are single threaded.
+**/
+static size_t countedBytes = 0;
+static size_t countedAllocations = 0;
+
+template <typename T>
+struct CountingAllocator {
+    typedef T value_type;
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        countedBytes += n * sizeof(T);
+        countedAllocations++;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        countedBytes -= n * sizeof(T);
+        countedAllocations--;
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&) {
+    return false;
+}
+
+/**
+    The heap bytes of a string, 0 when it fits in the string itself.
+**/
+static size_t stringHeapBytes(const std::string& s) {
+    const char* data = s.data();
+    const char* self = reinterpret_cast<const char*>(&s);
+    return (data >= self && data < self + sizeof(s)) ? 0 : s.capacity() + 1;
+}
+
+/**
+    What a standard container holding the keys uses, measured as it is
+    built.
+**/
+struct Footprint {
+    size_t keys = 0;
+    size_t bytes = 0;
+    size_t allocations = 0;
+
+    template <typename Build>
+    void measure(Build build) {
+        const size_t bytesBefore = countedBytes;
+        const size_t allocationsBefore = countedAllocations;
+        build();
+        bytes += countedBytes - bytesBefore;
+        allocations += countedAllocations - allocationsBefore;
+    }
+
+    void report(benchmark::State& state) const {
+        state.counters["bytes_per_key"] = keys ? double(bytes) / keys : 0;
+        state.counters["nodes_per_key"] = keys ? double(allocations) / keys : 0;
+    }
+};
+
+/**
+    bytes_per_key of a HatTrie, nodes_per_key counts its trie nodes and
+    buckets.
+**/
+static void reportHatMemory(benchmark::State& state, const HatTrie& hat) {
+    const size_t keys = hat.size();
+    state.counters["bytes_per_key"] = keys ? double(hat.getMemoryBytes()) / keys : 0;
+    state.counters["nodes_per_key"] = keys ? double(hat.getNodeCount() + hat.getBucketCount()) / keys : 0;
+}
+
+/**
+    The set workloads (Insert, Exists, ExistsMiss, PrefixExists, Erase)
+    against each container. build() fills an empty container with keys.
+**/
+class BenchTrie {
+public:
+    explicit BenchTrie(Container container)
+      : trie(layoutOf(container)),
+        compressed(container == Container::TrieCompressed) {}
+
+    const char* name() const {
+        return compressed ? "Trie compressed" : "Trie";
+    }
+
+    void build(const Keys& keys) {
+        trie.bulkInsert(keys.begin(), keys.end());
+    }
+
+    void insert(const std::string& key) {
+        trie.insert(key);
+    }
+
+    void erase(const std::string& key) {
+        trie.erase(key);
+    }
+
+    bool exists(const std::string& key) {
+        return trie.exists(key.data(), key.data() + key.size());
+    }
+
+    bool prefixExists(const std::string& key) {
+        return trie.prefixExists(key.data(), key.data() + key.size());
+    }
+
+    void reportMemory(benchmark::State& state) {
+        ::reportMemory(state, trie);
+    }
+
+private:
+    Trie<char> trie;
+    const bool compressed;
+};
+
+/**
+    Is a key of the sorted container c a prefix of probe? A key which
+    prefixes probe sorts at or before it, and every key between the two
+    starts with it. So if the key before probe is not a prefix, the only
+    candidates left are the prefixes of what the two have in common.
+**/
+template <typename C, typename LowerBound>
+static bool sortedPrefixExists(const C& c, std::string_view probe, LowerBound lowerBound) {
+    while (!probe.empty()) {
+        auto it = lowerBound(probe);
+        if (it != c.end() && *it == probe) {
+            return true;
+        }
+        if (it == c.begin()) {
+            return false;
+        }
+        --it;
+        const std::string& key = *it;
+        size_t common = 0;
+        while (common < key.size() && common < probe.size() && key[common] == probe[common]) {
+            common++;
+        }
+        if (common == key.size()) {
+            return true;
+        }
+        probe = probe.substr(0, common);
+    }
+    return false;
+}
+
+class BenchUnorderedSet {
+public:
+    explicit BenchUnorderedSet(Container) {}
+
+    const char* name() const {
+        return "std::unordered_set";
+    }
+
+    void build(const Keys& keys) {
+        footprint.measure([&]() {
+            for (auto& key : keys) {
+                set.insert(key);
+            }
+        });
+        footprint.keys = set.size();
+        for (auto& key : set) {
+            footprint.bytes += stringHeapBytes(key);
+        }
+    }
+
+    void insert(const std::string& key) {
+        set.insert(key);
+    }
+
+    void erase(const std::string& key) {
+        set.erase(key);
+    }
+
+    bool exists(const std::string& key) {
+        return set.count(key);
+    }
+
+    bool prefixExists(const std::string& key) {
+        scratch.clear();
+        for (char c : key) {
+            scratch.push_back(c);
+            if (set.count(scratch)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void reportMemory(benchmark::State& state) {
+        footprint.report(state);
+    }
+
+private:
+    std::unordered_set<std::string, std::hash<std::string>, std::equal_to<std::string>,
+                       CountingAllocator<std::string> > set;
+    std::string scratch;
+    Footprint footprint;
+};
+
+class BenchOrderedSet {
+public:
+    explicit BenchOrderedSet(Container) {}
+
+    const char* name() const {
+        return "std::set";
+    }
+
+    void build(const Keys& keys) {
+        footprint.measure([&]() {
+            for (auto& key : keys) {
+                set.insert(key);
+            }
+        });
+        footprint.keys = set.size();
+        for (auto& key : set) {
+            footprint.bytes += stringHeapBytes(key);
+        }
+    }
+
+    void insert(const std::string& key) {
+        set.insert(key);
+    }
+
+    void erase(const std::string& key) {
+        set.erase(key);
+    }
+
+    bool exists(const std::string& key) {
+        return set.count(key);
+    }
+
+    bool prefixExists(const std::string& key) {
+        return sortedPrefixExists(set, key, [this](std::string_view probe) {
+            return set.lower_bound(probe);
+        });
+    }
+
+    void reportMemory(benchmark::State& state) {
+        footprint.report(state);
+    }
+
+private:
+    std::set<std::string, std::less<>, CountingAllocator<std::string> > set;
+    Footprint footprint;
+};
+
+class BenchSortedVector {
+public:
+    explicit BenchSortedVector(Container) {}
+
+    const char* name() const {
+        return "sorted vector";
+    }
+
+    void build(const Keys& keys) {
+        footprint.measure([&]() {
+            sorted.assign(keys.begin(), keys.end());
+        });
+        std::sort(sorted.begin(), sorted.end());
+        footprint.keys = sorted.size();
+        for (auto& key : sorted) {
+            footprint.bytes += stringHeapBytes(key);
+        }
+    }
+
+    void insert(const std::string& key) {
+        auto it = std::lower_bound(sorted.begin(), sorted.end(), key);
+        if (it == sorted.end() || *it != key) {
+            sorted.insert(it, key);
+        }
+    }
+
+    void erase(const std::string& key) {
+        auto it = std::lower_bound(sorted.begin(), sorted.end(), key);
+        if (it != sorted.end() && *it == key) {
+            sorted.erase(it);
+        }
+    }
+
+    bool exists(const std::string& key) {
+        return std::binary_search(sorted.begin(), sorted.end(), key);
+    }
+
+    bool prefixExists(const std::string& key) {
+        return sortedPrefixExists(sorted, key, [this](std::string_view probe) {
+            return std::lower_bound(sorted.begin(), sorted.end(), probe);
+        });
+    }
+
+    void reportMemory(benchmark::State& state) {
+        footprint.report(state);
+    }
+
+private:
+    std::vector<std::string, CountingAllocator<std::string> > sorted;
+    Footprint footprint;
+};
+
+class BenchHatTrie {
+public:
+    explicit BenchHatTrie(Container) {}
+
+    const char* name() const {
+        return "HatTrie";
+    }
+
+    void build(const Keys& keys) {
+        set.bulkInsert(keys.begin(), keys.end());
+    }
+
+    void insert(const std::string& key) {
+        set.insert(key);
+    }
+
+    void erase(const std::string& key) {
+        set.erase(key);
+    }
+
+    bool exists(const std::string& key) {
+        return set.exists(key.data(), key.data() + key.size());
+    }
+
+    bool prefixExists(const std::string& key) {
+        return set.prefixExists(key.data(), key.data() + key.size());
+    }
+
+    void reportMemory(benchmark::State& state) {
+        reportHatMemory(state, set);
+    }
+
+private:
+    HatTrie set;
+};
+
+/**
+    The Find workload against each container, key i maps to i.
+**/
+class BenchTrieMap {
+public:
+    explicit BenchTrieMap(Container container)
+      : map(layoutOf(container)),
+        compressed(container == Container::TrieCompressed) {}
+
+    const char* name() const {
+        return compressed ? "TrieMap compressed" : "TrieMap";
+    }
+
+    void build(const Keys& keys) {
+        std::vector<std::pair<std::string, uint64_t> > items;
+        for (size_t i = 0; i < keys.size(); i++) {
+            items.emplace_back(keys[i], i);
+        }
+        map.bulkInsert(items.begin(), items.end());
+    }
+
+    bool find(const std::string& key, uint64_t& value) {
+        return map.findValue(key.data(), key.data() + key.size(), value);
+    }
+
+    void reportMemory(benchmark::State& state) {
+        ::reportMemory(state, map);
+    }
+
+private:
+    TrieMap<char, uint64_t> map;
+    const bool compressed;
+};
+
+class BenchHatTrieMap {
+public:
+    explicit BenchHatTrieMap(Container) {}
+
+    const char* name() const {
+        return "HatTrieMap";
+    }
+
+    void build(const Keys& keys) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            map.insert(keys[i], i);
+        }
+    }
+
+    bool find(const std::string& key, uint64_t& value) {
+        return map.findValue(key.data(), key.data() + key.size(), value);
+    }
+
+    void reportMemory(benchmark::State& state) {
+        reportHatMemory(state, map);
+    }
+
+private:
+    HatTrieMap<uint64_t> map;
+};
+
+class BenchUnorderedMap {
+public:
+    explicit BenchUnorderedMap(Container) {}
+
+    const char* name() const {
+        return "std::unordered_map";
+    }
+
+    void build(const Keys& keys) {
+        footprint.measure([&]() {
+            for (size_t i = 0; i < keys.size(); i++) {
+                map.emplace(keys[i], i);
+            }
+        });
+        footprint.keys = map.size();
+        for (auto& item : map) {
+            footprint.bytes += stringHeapBytes(item.first);
+        }
+    }
+
+    bool find(const std::string& key, uint64_t& value) {
+        auto it = map.find(key);
+        if (it == map.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void reportMemory(benchmark::State& state) {
+        footprint.report(state);
+    }
+
+private:
+    std::unordered_map<std::string, uint64_t, std::hash<std::string>, std::equal_to<std::string>,
+                       CountingAllocator<std::pair<const std::string, uint64_t> > > map;
+    Footprint footprint;
+};
+
+class BenchOrderedMap {
+public:
+    explicit BenchOrderedMap(Container) {}
+
+    const char* name() const {
+        return "std::map";
+    }
+
+    void build(const Keys& keys) {
+        footprint.measure([&]() {
+            for (size_t i = 0; i < keys.size(); i++) {
+                map.emplace(keys[i], i);
+            }
+        });
+        footprint.keys = map.size();
+        for (auto& item : map) {
+            footprint.bytes += stringHeapBytes(item.first);
+        }
+    }
+
+    bool find(const std::string& key, uint64_t& value) {
+        auto it = map.find(key);
+        if (it == map.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void reportMemory(benchmark::State& state) {
+        footprint.report(state);
+    }
+
+private:
+    std::map<std::string, uint64_t, std::less<>,
+             CountingAllocator<std::pair<const std::string, uint64_t> > > map;
+    Footprint footprint;
+};
+
+class BenchSortedPairs {
+public:
+    explicit BenchSortedPairs(Container) {}
+
+    const char* name() const {
+        return "sorted vector";
+    }
+
+    void build(const Keys& keys) {
+        footprint.measure([&]() {
+            sorted.reserve(keys.size());
+            for (size_t i = 0; i < keys.size(); i++) {
+                sorted.emplace_back(keys[i], i);
+            }
+        });
+        std::sort(sorted.begin(), sorted.end());
+        footprint.keys = sorted.size();
+        for (auto& item : sorted) {
+            footprint.bytes += stringHeapBytes(item.first);
+        }
+    }
+
+    bool find(const std::string& key, uint64_t& value) {
+        auto it = std::lower_bound(sorted.begin(), sorted.end(), key,
+                                   [](const Item& item, const std::string& k) {
+                                       return item.first < k;
+                                   });
+        if (it == sorted.end() || it->first != key) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void reportMemory(benchmark::State& state) {
+        footprint.report(state);
+    }
+
+private:
+    typedef std::pair<std::string, uint64_t> Item;
+
+    std::vector<Item, CountingAllocator<Item> > sorted;
+    Footprint footprint;
+};
+
+/**
+    Call body with a null pointer of the class which runs the benchmark's
+    container, TrieClass for either trie layout.
+**/
+template <typename TrieClass,
+          typename Unordered,
+          typename Ordered,
+          typename Sorted,
+          typename Hat,
+          typename Body>
+static void forContainer(const benchmark::State& state, Body body) {
+    switch (containerOf(state)) {
+    case Container::TrieExpanded:
+    case Container::TrieCompressed:
+        body(static_cast<TrieClass*>(nullptr));
+        return;
+    case Container::UnorderedSet:
+        body(static_cast<Unordered*>(nullptr));
+        return;
+    case Container::OrderedSet:
+        body(static_cast<Ordered*>(nullptr));
+        return;
+    case Container::SortedVector:
+        body(static_cast<Sorted*>(nullptr));
+        return;
+    case Container::HatTrie:
+        body(static_cast<Hat*>(nullptr));
+        return;
+    }
+}
+
+template <typename Body>
+static void forSet(const benchmark::State& state, Body body) {
+    forContainer<BenchTrie, BenchUnorderedSet, BenchOrderedSet, BenchSortedVector, BenchHatTrie>(state,
+                                                                                               body);
+}
+
+template <typename Body>
+static void forMap(const benchmark::State& state, Body body) {
+    forContainer<BenchTrieMap, BenchUnorderedMap, BenchOrderedMap, BenchSortedPairs, BenchHatTrieMap>(
+        state, body);
+}
+
+template <typename C>
+static void setLabel(benchmark::State& state, const C& container) {
+    state.SetLabel(std::string(trieDatasetName(datasetOf(state))) + " " + container.name());
+}
+
+/**
+    The container of the benchmark's type built from the dataset, shared
+    by the lookup benchmarks.
+**/
+template <typename C>
+static C& datasetContainer(benchmark::State& state) {
+    C& container = underTest<C>(state, [&state]() {
+        auto c = std::make_unique<C>(containerOf(state));
+        c->build(datasetKeys(state));
+        return c;
+    });
+    setLabel(state, container);
+    return container;
+}
+
+/**
+    Run one lookup per iteration over the probes, counting the hits.
+**/
+template <typename Lookup>
+static void runLookups(benchmark::State& state, const Keys& probes, Lookup lookup) {
+    size_t i = 0;
+    size_t hits = 0;
+    for (auto _ : state) {
+        bool hit = lookup(probes[i]);
+        benchmark::DoNotOptimize(hit);
+        hits += hit;
+        if (++i == probes.size()) {
+            i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["hit_ratio"] = state.iterations() ? double(hits) / state.iterations() : 0;
+}
+
+static void Insert(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    releaseUnderTest();
+    forSet(state, [&](auto* type) {
+        typedef std::remove_pointer_t<decltype(type)> C;
+        // Each key is inserted into a container holding the keys before
+        // it, the container starts again once all have been inserted
+        auto container = std::make_unique<C>(containerOf(state));
+        setLabel(state, *container);
+        size_t i = 0;
+        for (auto _ : state) {
+            container->insert(keys[i]);
+            if (++i == keys.size()) {
+                state.PauseTiming();
+                container = std::make_unique<C>(containerOf(state));
+                i = 0;
+                state.ResumeTiming();
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+    });
+}
+
+static void Exists(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    forSet(state, [&](auto* type) {
+        auto& container = datasetContainer<std::remove_pointer_t<decltype(type)> >(state);
+        container.reportMemory(state);
+        runLookups(state, keys, [&container](const std::string& key) {
+            return container.exists(key);
+        });
+    });
+}
+
+static void ExistsMiss(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    forSet(state, [&](auto* type) {
+        auto& container = datasetContainer<std::remove_pointer_t<decltype(type)> >(state);
+        runLookups(state, datasetProbes(state), [&container](const std::string& key) {
+            return container.exists(key);
+        });
+    });
+}
+
+static void PrefixExists(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    forSet(state, [&](auto* type) {
+        auto& container = datasetContainer<std::remove_pointer_t<decltype(type)> >(state);
+        runLookups(state, datasetProbes(state), [&container](const std::string& key) {
+            return container.prefixExists(key);
+        });
+    });
+}
+
+static void Find(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    forMap(state, [&](auto* type) {
+        auto& container = datasetContainer<std::remove_pointer_t<decltype(type)> >(state);
+        container.reportMemory(state);
+        uint64_t sum = 0;
+        runLookups(state, keys, [&container, &sum](const std::string& key) {
+            uint64_t value = 0;
+            bool found = container.find(key, value);
+            sum += value;
+            return found;
+        });
+        benchmark::DoNotOptimize(sum);
+    });
+}
+
+static void Erase(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    releaseUnderTest();
+    forSet(state, [&](auto* type) {
+        typedef std::remove_pointer_t<decltype(type)> C;
+        // Erases from a container of its own, refilled once every key is
+        // erased
+        C container(containerOf(state));
+        setLabel(state, container);
+        container.build(keys);
+        size_t i = 0;
+        for (auto _ : state) {
+            container.erase(keys[i]);
+            if (++i == keys.size()) {
+                state.PauseTiming();
+                container.build(keys);
+                i = 0;
+                state.ResumeTiming();
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+    });
+}
+
+/**
+    The Integers dataset in a generic Trie<int>, each key as four 16 bit
+    elements.
+**/
+static void IntegerExists(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    typedef std::vector<std::vector<int> > IntKeys;
+    IntKeys& intKeys = cached<IntKeys>({state.range(0), state.range(1)}, [&keys]() {
+        auto result = std::make_unique<IntKeys>();
+        for (auto& key : keys) {
+            std::vector<int> k;
+            for (size_t i = 0; i + 1 < key.size(); i += 2) {
+                k.push_back((static_cast<uint8_t>(key[i]) << 8) | static_cast<uint8_t>(key[i + 1]));
+            }
+            result->push_back(k);
+        }
+        return result;
+    });
+    Trie<int>& trie = underTest<Trie<int> >(state, [&state, &intKeys]() {
+        auto t = std::make_unique<Trie<int> >(layoutOf(containerOf(state)));
+        t->bulkInsert(intKeys.begin(), intKeys.end());
+        return t;
+    });
+    reportMemory(state, trie);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        std::vector<int>& key = intKeys[i];
+        benchmark::DoNotOptimize(trie.exists(key.begin(), key.end()));
+        if (++i == intKeys.size()) {
+            i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+    A standard map of the IntegerFind keys and what it allocated.
+**/
+template <typename Map>
+struct CountedIntegerMap {
+    Map map;
+    Footprint footprint;
+};
+
+template <typename Map>
+static CountedIntegerMap<Map>* buildIntegerMap(const std::vector<uint64_t>& keys) {
+    auto result = new CountedIntegerMap<Map>();
+    result->footprint.measure([&]() {
+        for (size_t i = 0; i < keys.size(); i++) {
+            result->map.emplace(keys[i], i);
+        }
+    });
+    result->footprint.keys = result->map.size();
+    return result;
+}
+
+/**
+    The Integers dataset as uint64_t keys mapped to their index, found in
+    a TrieIntMap (trie_int.h, container 0 and 1), std::unordered_map
+    (container 2) and std::map (container 3).
+**/
+static void IntegerFind(benchmark::State& state) {
+    const Keys& keys = datasetKeys(state);
+    if (!prepare(state, keys)) {
+        return;
+    }
+    typedef std::vector<uint64_t> IntKeys;
+    IntKeys& intKeys = cached<IntKeys>({state.range(0), state.range(1)}, [&keys]() {
+        auto result = std::make_unique<IntKeys>();
+        for (auto& key : keys) {
+            result->push_back(TrieIntKey<uint64_t>::decode(key.data()));
+        }
+        return result;
+    });
+
+    uint64_t sum = 0;
+    auto run = [&state, &intKeys, &sum](auto find) {
+        size_t i = 0;
+        for (auto _ : state) {
+            uint64_t value = 0;
+            benchmark::DoNotOptimize(find(intKeys[i], value));
+            sum += value;
+            if (++i == intKeys.size()) {
+                i = 0;
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+    };
+
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               CountingAllocator<std::pair<const uint64_t, uint64_t> > > Unordered;
+    typedef std::map<uint64_t, uint64_t, std::less<uint64_t>,
+                     CountingAllocator<std::pair<const uint64_t, uint64_t> > > Ordered;
+    switch (containerOf(state)) {
+    case Container::TrieExpanded:
+    case Container::TrieCompressed: {
+        typedef TrieIntMap<uint64_t, uint64_t> IntMap;
+        IntMap& map = underTest<IntMap>(state, [&state, &intKeys]() {
+            auto m = std::make_unique<IntMap>(layoutOf(containerOf(state)));
+            for (size_t i = 0; i < intKeys.size(); i++) {
+                m->insert(intKeys[i], i);
+            }
+            return m;
+        });
+        state.SetLabel("integers TrieIntMap");
+        reportMemory(state, map);
+        run([&map](uint64_t key, uint64_t& value) {
+            return map.findValue(key, value);
+        });
+        break;
+    }
+    case Container::UnorderedSet: {
+        auto& counted = underTest<CountedIntegerMap<Unordered> >(state, [&intKeys]() {
+            return buildIntegerMap<Unordered>(intKeys);
+        });
+        state.SetLabel("integers std::unordered_map");
+        counted.footprint.report(state);
+        run([&counted](uint64_t key, uint64_t& value) {
+            auto it = counted.map.find(key);
+            if (it == counted.map.end()) {
+                return false;
+            }
+            value = it->second;
+            return true;
+        });
+        break;
+    }
+    default: {
+        auto& counted = underTest<CountedIntegerMap<Ordered> >(state, [&intKeys]() {
+            return buildIntegerMap<Ordered>(intKeys);
+        });
+        state.SetLabel("integers std::map");
+        counted.footprint.report(state);
+        run([&counted](uint64_t key, uint64_t& value) {
+            auto it = counted.map.find(key);
+            if (it == counted.map.end()) {
+                return false;
+            }
+            value = it->second;
+            return true;
+        });
+        break;
+    }
+    }
+    benchmark::DoNotOptimize(sum);
+}
+
+static void allDatasets(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"dataset", "keys", "container"});
+    b->ArgsProduct({
+        {int64_t(TrieDataset::Words),
+         int64_t(TrieDataset::Urls),
+         int64_t(TrieDataset::Binary),
+         int64_t(TrieDataset::Integers),
+         int64_t(TrieDataset::IpPrefixes)},
+        {10000, 100000, 1000000, 10000000},
+        {int64_t(Container::TrieExpanded),
+         int64_t(Container::TrieCompressed),
+         int64_t(Container::UnorderedSet),
+         int64_t(Container::OrderedSet),
+         int64_t(Container::SortedVector),
+         int64_t(Container::HatTrie)}
+    });
+}
+
+static void integerDataset(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"dataset", "keys", "container"});
+    b->ArgsProduct({
+        {int64_t(TrieDataset::Integers)},
+        {10000, 100000, 1000000, 10000000},
+        {int64_t(Container::TrieExpanded),
+         int64_t(Container::TrieCompressed)}
+    });
+}
+
+static void integerMapDataset(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"dataset", "keys", "container"});
+    b->ArgsProduct({
+        {int64_t(TrieDataset::Integers)},
+        {10000, 100000, 1000000, 10000000},
+        {int64_t(Container::TrieExpanded),
+         int64_t(Container::TrieCompressed),
+         int64_t(Container::UnorderedSet),
+         int64_t(Container::OrderedSet)}
+    });
+}
+
+BENCHMARK(Insert)->Apply(allDatasets);
+BENCHMARK(Exists)->Apply(allDatasets);
+BENCHMARK(ExistsMiss)->Apply(allDatasets);
+BENCHMARK(PrefixExists)->Apply(allDatasets);
+BENCHMARK(Find)->Apply(allDatasets);
+BENCHMARK(Erase)->Apply(allDatasets);
+BENCHMARK(IntegerExists)->Apply(integerDataset);
+BENCHMARK(IntegerFind)->Apply(integerMapDataset);
+
+BENCHMARK_MAIN();
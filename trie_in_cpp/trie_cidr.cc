@@ -0,0 +1,114 @@
+template <typename V, typename Policy>
+TrieCidrMap<V, Policy>::TrieCidrMap(size_t addressBytes)
+  : addressBytes(addressBytes),
+    expanded(TrieLayout::Expanded),
+    routes(TrieLayout::PathCompressed),
+    routeCount(0) {
+    if (addressBytes == 0 || addressBytes > maxAddressBytes) {
+        throw std::invalid_argument("TrieCidrMap: unsupported address size");
+    }
+}
+
+template <typename V, typename Policy>
+std::string TrieCidrMap<V, Policy>::routeKey(const uint8_t* prefix, unsigned length) {
+    const size_t bytes = (length + 7) / 8;
+    std::string key(reinterpret_cast<const char*>(prefix), bytes);
+    if (length % 8) {
+        key[bytes - 1] &= static_cast<char>(0xff << (8 - length % 8));
+    }
+    key.push_back(static_cast<char>(length));
+    return key;
+}
+
+template <typename V, typename Policy>
+void TrieCidrMap<V, Policy>::insert(const uint8_t* prefix, unsigned length, V value) {
+    if (length > addressBytes * 8) {
+        throw std::invalid_argument("TrieCidrMap::insert: prefix longer than the address");
+    }
+    const std::string route = routeKey(prefix, length);
+    V existing;
+    if (!routes.findValue(route.data(), route.data() + route.size(), existing)) {
+        routeCount++;
+    }
+    routes.insert(route, value);
+
+    // The zero byte then the whole bytes of the prefix, the last byte
+    // takes every value of its bits past length
+    const size_t bytes = (length + 7) / 8;
+    std::string key(1, '\0');
+    key.append(route, 0, bytes);
+    const unsigned expansions = 1u << (bytes * 8 - length);
+    for (unsigned i = 0; i < expansions; i++) {
+        if (bytes) {
+            key.back() = static_cast<char>(static_cast<uint8_t>(route[bytes - 1]) | i);
+        }
+        Entry entry;
+        if (!expanded.findValue(key.data(), key.data() + key.size(), entry) ||
+            entry.length <= length) {
+            expanded.insert(key, Entry{value, static_cast<uint8_t>(length)});
+        }
+    }
+}
+
+template <typename V, typename Policy>
+bool TrieCidrMap<V, Policy>::erase(const uint8_t* prefix, unsigned length) {
+    if (length > addressBytes * 8) {
+        return false;
+    }
+    const std::string route = routeKey(prefix, length);
+    V existing;
+    if (!routes.findValue(route.data(), route.data() + route.size(), existing)) {
+        return false;
+    }
+    routes.erase(route);
+    routeCount--;
+
+    const size_t bytes = (length + 7) / 8;
+    std::string key(1, '\0');
+    key.append(route, 0, bytes);
+    const unsigned expansions = 1u << (bytes * 8 - length);
+    for (unsigned i = 0; i < expansions; i++) {
+        if (bytes) {
+            key.back() = static_cast<char>(static_cast<uint8_t>(route[bytes - 1]) | i);
+        }
+        Entry entry;
+        if (expanded.findValue(key.data(), key.data() + key.size(), entry) &&
+            entry.length == length) {
+            reassign(key, length);
+        }
+    }
+    return true;
+}
+
+template <typename V, typename Policy>
+void TrieCidrMap<V, Policy>::reassign(const std::string& key, unsigned length) {
+    // Only routes expanded to the same number of bytes share the key
+    const size_t bytes = key.size() - 1;
+    const unsigned shortest = bytes ? static_cast<unsigned>(bytes - 1) * 8 + 1 : 0;
+    const uint8_t* address = reinterpret_cast<const uint8_t*>(key.data() + 1);
+    for (unsigned l = length; l-- > shortest;) {
+        const std::string route = routeKey(address, l);
+        V value;
+        if (routes.findValue(route.data(), route.data() + route.size(), value)) {
+            expanded.insert(key, Entry{value, static_cast<uint8_t>(l)});
+            return;
+        }
+    }
+    expanded.erase(key);
+}
+
+template <typename V, typename Policy>
+bool TrieCidrMap<V, Policy>::find(const uint8_t* address, V& value, unsigned* length) const {
+    char key[1 + maxAddressBytes];
+    key[0] = '\0';
+    std::memcpy(key + 1, address, addressBytes);
+    Entry entry;
+    if (!expanded.longestPrefixFindValue(key, key + 1 + addressBytes, entry)) {
+        return false;
+    }
+    value = entry.value;
+    if (length) {
+        *length = entry.length;
+    }
+    return true;
+}
@@ -0,0 +1,107 @@
+/**
+    A longest prefix match table for IPv4/IPv6 CIDR routes, built on a
+    byte keyed TrieMap<char, ...>.
+
+    A route is an address prefix of any number of bits, the trie works in
+    bytes, so each route is expanded to whole bytes (controlled prefix
+    expansion): a /20 becomes the 16 three byte keys its last 4 bits can
+    take. Where the expansions of two routes overlap the longer route
+    owns the key. A lookup is then one longestPrefixFindValue walk of the
+    address bytes, at most addressBytes node visits.
+
+    Every key starts with one zero byte so that the default route (/0) is
+    the one byte key which prefixes every address, rather than the empty
+    key (which a prefix search does not report).
+
+    The routes themselves are kept as well (keyed by masked prefix bytes
+    plus length) so that erasing a route can hand its expanded keys back
+    to the next longest route.
+
+    Writers must be serialised by the caller. With a Policy of
+    TrieOptimisticLocking lookups may run alongside the writer, V must
+    then be trivially copyable. A lookup copies the expanded key's Entry
+    out word by word and the trie's version check rejects a torn copy
+    (see trieLoadRelaxed).
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "utilities/trie.h"
+
+template <typename V, typename Policy = DefaultTriePolicy>
+class TrieCidrMap {
+public:
+
+    static_assert(!Policy::Locking::optimistic || std::is_trivially_copyable<V>::value,
+                  "TrieCidrMap with TrieOptimisticLocking requires a trivially copyable value");
+
+    static const size_t maxAddressBytes = 16;
+
+    /**
+        addressBytes is 4 for IPv4, 16 for IPv6.
+    **/
+    explicit TrieCidrMap(size_t addressBytes = 4);
+
+    /**
+        Add (or replace) the route prefix/length, prefix is addressBytes
+        long and the bits past length are ignored.
+        Throws std::invalid_argument if length is more than the address.
+    **/
+    void insert(const uint8_t* prefix, unsigned length, V value);
+
+    /**
+        Remove the route prefix/length, returns true if it existed.
+    **/
+    bool erase(const uint8_t* prefix, unsigned length);
+
+    /**
+        Find the longest route matching address (addressBytes long).
+        Returns true and sets value (and length if given) if one does.
+    **/
+    bool find(const uint8_t* address, V& value, unsigned* length = nullptr) const;
+
+    size_t size() const {
+        return routeCount;
+    }
+
+    size_t getAddressBytes() const {
+        return addressBytes;
+    }
+
+private:
+
+    struct Entry {
+        V value;
+        // the length of the route which owns the expanded key
+        uint8_t length;
+    };
+
+    /**
+        The route's key in routes, the masked prefix bytes and the length.
+    **/
+    static std::string routeKey(const uint8_t* prefix, unsigned length);
+
+    /**
+        Give the expanded key (owned by a route of length which has gone)
+        to the longest remaining route of the same byte length covering
+        it, or erase it if there is none.
+    **/
+    void reassign(const std::string& key, unsigned length);
+
+    const size_t addressBytes;
+    // A TrieMap lookup locks or enters an epoch and counts nodes, so is
+    // not const, find is (see the mutable mutex idiom)
+    mutable TrieMap<char, Entry, Policy> expanded;
+    TrieMap<char, V, Policy> routes;
+    size_t routeCount;
+};
+
+#include "utilities/trie_cidr.cc"
@@ -0,0 +1,367 @@
+inline TrieMappedFile::TrieMappedFile(const std::string& path)
+  : base(nullptr),
+    length(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "TrieMappedFile: open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "TrieMappedFile: fstat " + path);
+    }
+    length = st.st_size;
+    if (length) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "TrieMappedFile: mmap " + path);
+        }
+        base = static_cast<const char*>(p);
+    }
+    // the mapping stays valid without the descriptor
+    close(fd);
+}
+
+inline TrieMappedFile::~TrieMappedFile() {
+    if (base) {
+        munmap(const_cast<char*>(base), length);
+    }
+}
+
+/**
+ * Build from the sorted keys. A range of keys which share their first
+ * 'depth' bytes belongs to one state. The state's transitions are the
+ * distinct next bytes of the range (code 0 for the key which ends here),
+ * they are placed at the first base where all of them land on free slots
+ * and each transition's sub-range becomes the child state.
+ *
+ * Free slots are kept on a doubly linked list so the search for a base
+ * only visits free slots.
+ */
+inline void DoubleArrayTrie::build(const std::vector<std::string>& keys) {
+    auto arrays = std::make_shared<Arrays>();
+    std::vector<Unit>& slots = arrays->units;
+    std::vector<char>& suffixes = arrays->tail;
+    slots.assign(1, Unit{0, rootCheck});
+
+    std::vector<int32_t> nextFree(1, 0);
+    std::vector<int32_t> prevFree(1, 0);
+    int32_t freeHead = -1;
+    int32_t freeTail = -1;
+
+    if (keys.size() > maxOffset) {
+        throw std::length_error("DoubleArrayTrie: too many keys");
+    }
+
+    auto reserve = [&](size_t count) {
+        if (count > maxOffset) {
+            throw std::length_error("DoubleArrayTrie: too many states");
+        }
+        while (slots.size() < count) {
+            int32_t slot = static_cast<int32_t>(slots.size());
+            slots.push_back(Unit{0, freeCheck});
+            nextFree.push_back(-1);
+            prevFree.push_back(freeTail);
+            if (freeTail >= 0) {
+                nextFree[freeTail] = slot;
+            } else {
+                freeHead = slot;
+            }
+            freeTail = slot;
+        }
+    };
+
+    auto use = [&](int32_t slot, int32_t owner) {
+        slots[slot].check = owner;
+        if (prevFree[slot] >= 0) {
+            nextFree[prevFree[slot]] = nextFree[slot];
+        } else {
+            freeHead = nextFree[slot];
+        }
+        if (nextFree[slot] >= 0) {
+            prevFree[nextFree[slot]] = prevFree[slot];
+        } else {
+            freeTail = prevFree[slot];
+        }
+    };
+
+    std::vector<uint32_t> codes;
+    auto findBase = [&]() -> int32_t {
+        for (int32_t slot = freeHead;; slot = nextFree[slot]) {
+            if (slot < 0) {
+                // everything is in use, grow
+                slot = static_cast<int32_t>(slots.size());
+                reserve(slots.size() + padding);
+            }
+            if (static_cast<uint32_t>(slot) < codes[0]) {
+                continue;
+            }
+            const int32_t base = slot - static_cast<int32_t>(codes[0]);
+            reserve(base + padding);
+            bool fits = true;
+            for (uint32_t c : codes) {
+                if (slots[base + c].check != freeCheck) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) {
+                return base;
+            }
+        }
+    };
+
+    struct Range {
+        size_t lo;
+        size_t hi;
+        size_t depth;
+        int32_t state;
+    };
+    std::vector<Range> pending;
+    std::vector<Range> children;
+    reserve(padding + 1);
+    if (!keys.empty()) {
+        pending.push_back({0, keys.size(), 0, 0});
+    }
+
+    while (!pending.empty()) {
+        const Range range = pending.back();
+        pending.pop_back();
+
+        if (range.hi - range.lo == 1) {
+            // a unique suffix, the rest of the key goes in the suffixes
+            const std::string& key = keys[range.lo];
+            suffixes.resize((suffixes.size() + alignof(TailHeader) - 1) & ~(alignof(TailHeader) - 1));
+            const size_t offset = suffixes.size();
+            if (offset + sizeof(TailHeader) + (key.size() - range.depth) >= maxOffset) {
+                throw std::length_error("DoubleArrayTrie: tail too large");
+            }
+            TailHeader header{static_cast<uint32_t>(range.lo),
+                              static_cast<uint32_t>(key.size() - range.depth)};
+            suffixes.resize(offset + sizeof(header));
+            std::memcpy(suffixes.data() + offset, &header, sizeof(header));
+            suffixes.insert(suffixes.end(), key.begin() + range.depth, key.end());
+            slots[range.state].base = -static_cast<int32_t>(offset + 1);
+            continue;
+        }
+
+        // the distinct next codes, sorted as the keys are
+        codes.clear();
+        children.clear();
+        for (size_t i = range.lo; i < range.hi; i++) {
+            const std::string& key = keys[i];
+            uint32_t c = key.size() == range.depth ? 0 : code(key[range.depth]);
+            if (codes.empty() || codes.back() != c) {
+                codes.push_back(c);
+                children.push_back({i, i + 1, range.depth + 1, 0});
+            } else {
+                children.back().hi = i + 1;
+            }
+        }
+
+        const int32_t base = findBase();
+        slots[range.state].base = base;
+        for (size_t i = 0; i < codes.size(); i++) {
+            const int32_t slot = base + static_cast<int32_t>(codes[i]);
+            use(slot, range.state);
+            if (codes[i] == 0) {
+                // end of key, base holds the key's number
+                slots[slot].base = static_cast<int32_t>(children[i].lo);
+            } else {
+                children[i].state = slot;
+                pending.push_back(children[i]);
+            }
+        }
+    }
+
+    // Every state's base + code must stay in range
+    int32_t maxBase = 0;
+    for (const Unit& unit : slots) {
+        maxBase = std::max(maxBase, unit.base);
+    }
+    slots.resize(std::max(slots.size(), static_cast<size_t>(maxBase) + padding), Unit{0, freeCheck});
+    slots.shrink_to_fit();
+    suffixes.shrink_to_fit();
+
+    units = slots.data();
+    unitCount = slots.size();
+    tail = suffixes.data();
+    tailBytes = suffixes.size();
+    keyCount = keys.size();
+    storage = std::move(arrays);
+}
+
+inline uint32_t DoubleArrayTrie::findIndex(const char* begin, const char* end) const {
+    const Unit* u = units;
+    int32_t state = 0;
+    for (const char* element = begin; element != end; element++) {
+        const int32_t base = u[state].base;
+        if (base < 0) {
+            const TailHeader* header = tailAt(base);
+            const char* rest = reinterpret_cast<const char*>(header + 1);
+            if (header->length == static_cast<size_t>(end - element) &&
+                std::memcmp(rest, element, header->length) == 0) {
+                return header->index;
+            }
+            return notFound;
+        }
+        const int32_t next = base + static_cast<int32_t>(code(*element));
+        if (u[next].check != state) {
+            return notFound;
+        }
+        state = next;
+    }
+
+    const int32_t base = u[state].base;
+    if (base < 0) {
+        const TailHeader* header = tailAt(base);
+        return header->length == 0 ? header->index : notFound;
+    }
+    return u[base].check == state ? static_cast<uint32_t>(u[base].base) : notFound;
+}
+
+inline uint32_t DoubleArrayTrie::findPrefixIndex(const char* begin, const char* end) const {
+    const Unit* u = units;
+    int32_t state = 0;
+    for (const char* element = begin; element != end;) {
+        int32_t base = u[state].base;
+        if (base < 0) {
+            // the one key below state, a prefix if its (non empty) rest is
+            const TailHeader* header = tailAt(base);
+            const char* rest = reinterpret_cast<const char*>(header + 1);
+            if (header->length > 0 &&
+                header->length <= static_cast<size_t>(end - element) &&
+                std::memcmp(rest, element, header->length) == 0) {
+                return header->index;
+            }
+            return notFound;
+        }
+        const int32_t next = base + static_cast<int32_t>(code(*element));
+        if (u[next].check != state) {
+            return notFound;
+        }
+        state = next;
+        element++;
+
+        // does a key end here?
+        base = u[state].base;
+        if (base < 0) {
+            const TailHeader* header = tailAt(base);
+            if (header->length == 0) {
+                return header->index;
+            }
+        } else if (u[base].check == state) {
+            return static_cast<uint32_t>(u[base].base);
+        }
+    }
+    return notFound;
+}
+
+inline void DoubleArrayTrie::saveFile(const std::string& path,
+                                      const void* values,
+                                      size_t valueSize,
+                                      size_t valueCount) const {
+    auto align = [](uint64_t offset) {
+        return (offset + 7) & ~uint64_t(7);
+    };
+
+    FileHeader h = {};
+    std::memcpy(h.magic, "JWWTRIE", sizeof(h.magic));
+    h.version = fileVersion;
+    h.endian = endianMarker;
+    h.keyCount = keyCount;
+    h.unitsOffset = align(sizeof(FileHeader));
+    h.unitCount = unitCount;
+    h.tailOffset = h.unitsOffset + unitCount * sizeof(Unit);
+    h.tailBytes = tailBytes;
+    h.valuesOffset = align(h.tailOffset + tailBytes);
+    h.valueSize = valueSize;
+    h.valueCount = valueCount;
+
+    const std::string temporary = path + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    auto write = [&file](uint64_t offset, const void* p, size_t bytes) {
+        if (!file) {
+            return;
+        }
+        // zero fill up to the (aligned) section start
+        static const char zeros[8] = {};
+        file.write(zeros, offset - file.tellp());
+        file.write(static_cast<const char*>(p), bytes);
+    };
+    write(0, &h, sizeof(h));
+    write(h.unitsOffset, units, unitCount * sizeof(Unit));
+    write(h.tailOffset, tail, tailBytes);
+    write(h.valuesOffset, values, valueCount * valueSize);
+    file.close();
+    if (!file) {
+        int error = errno;
+        std::remove(temporary.c_str());
+        throw std::system_error(error, std::generic_category(), "DoubleArrayTrie::save " + temporary);
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        int error = errno;
+        std::remove(temporary.c_str());
+        throw std::system_error(error, std::generic_category(), "DoubleArrayTrie::save " + path);
+    }
+}
+
+inline std::shared_ptr<const TrieMappedFile> DoubleArrayTrie::openFile(const std::string& path) {
+    auto file = std::make_shared<const TrieMappedFile>(path);
+    auto invalid = [&path](const char* why) {
+        return std::runtime_error("DoubleArrayTrie::open " + path + ": " + why);
+    };
+    if (file->size() < sizeof(FileHeader)) {
+        throw invalid("too small");
+    }
+    const FileHeader& h = header(*file);
+    if (std::memcmp(h.magic, "JWWTRIE", sizeof(h.magic)) != 0) {
+        throw invalid("not a trie file");
+    }
+    if (h.endian != endianMarker) {
+        throw invalid("written with the other byte order");
+    }
+    if (h.version != fileVersion) {
+        throw invalid("unsupported version");
+    }
+
+    // Each section must lie within the file (written without overflow)
+    auto fits = [&file](uint64_t offset, uint64_t count, uint64_t size) {
+        return offset <= file->size() &&
+               (size == 0 || count <= (file->size() - offset) / size);
+    };
+    if (h.unitsOffset % alignof(Unit) || h.tailOffset % alignof(TailHeader) ||
+        h.valuesOffset % 8 || h.unitCount < padding ||
+        !fits(h.unitsOffset, h.unitCount, sizeof(Unit)) ||
+        !fits(h.tailOffset, h.tailBytes, 1) ||
+        !fits(h.valuesOffset, h.valueCount, h.valueSize)) {
+        throw invalid("truncated or corrupt");
+    }
+
+    units = reinterpret_cast<const Unit*>(file->data() + h.unitsOffset);
+    unitCount = h.unitCount;
+    tail = file->data() + h.tailOffset;
+    tailBytes = h.tailBytes;
+    keyCount = h.keyCount;
+    storage = file;
+    return file;
+}
+
+template <typename V>
+DoubleArrayTrieMap<V> DoubleArrayTrieMap<V>::open(const std::string& path) {
+    static_assert(std::is_trivially_copyable<V>::value && alignof(V) <= 8,
+                  "DoubleArrayTrieMap::open requires a trivially copyable V");
+    DoubleArrayTrieMap darray;
+    auto file = darray.openFile(path);
+    const FileHeader& h = header(*file);
+    if (h.valueSize != sizeof(V) || h.valueCount != darray.getKeyCount()) {
+        throw std::runtime_error("DoubleArrayTrieMap::open " + path + ": no values of this type");
+    }
+    darray.values = reinterpret_cast<const V*>(file->data() + h.valuesOffset);
+    darray.valueCount = h.valueCount;
+    darray.valueStorage = std::move(file);
+    return darray;
+}
@@ -0,0 +1,323 @@
+/**
+    Double-array trie, a compact read only alternative to the pointer
+    nodes for char keys.
+
+    Trie<char>::buildDoubleArray() and TrieMap<char, V>::buildDoubleArray()
+    copy a trie into a DoubleArrayTrie/DoubleArrayTrieMap.
+
+    Each state s has a base and a check. The transition from s on byte b
+    goes to t = base[s] + code(b) and is valid if check[t] == s, so each
+    step is two reads from the same slot (base and check are interleaved)
+    and one compare. code(b) is the unsigned byte + 1, code 0 is the end
+    of key transition which marks a state as ending a key.
+
+    Tail compression: once only one key remains below a state the rest of
+    that key is not spread over more states, it is stored in the tail
+    array and the state's base points at it (as a negative number).
+
+    Keys are numbered in sorted order, a DoubleArrayTrieMap keeps the
+    values in that order.
+
+    Nothing in the arrays is a pointer, so save() writes them to a file
+    which open() maps (mmap) and queries in place: opening is O(1) and
+    pages are read from the page cache as lookups touch them. The file is
+
+      - FileHeader: magic, version, an endian marker and the offset and
+        size of each section
+      - the units (8 byte aligned)
+      - the tail
+      - the values of a DoubleArrayTrieMap (8 byte aligned)
+
+    open() checks the header and that each section lies within the file
+    but trusts the arrays themselves, only open files which save() wrote.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+    A read only mmap of a whole file, unmapped when destroyed.
+    Throws std::system_error if the file cannot be opened or mapped.
+**/
+class TrieMappedFile {
+public:
+
+    explicit TrieMappedFile(const std::string& path);
+
+    TrieMappedFile(const TrieMappedFile&) = delete;
+    TrieMappedFile& operator=(const TrieMappedFile&) = delete;
+
+    ~TrieMappedFile();
+
+    const char* data() const {
+        return base;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const char* base;
+    size_t length;
+};
+
+class DoubleArrayTrie {
+public:
+
+    /**
+        An empty double-array trie.
+    **/
+    DoubleArrayTrie() {
+        build(std::vector<std::string>());
+    }
+
+    /**
+        Does a key exist?
+        Pass the start and end of a key to search for.
+    **/
+    bool exists(const char* begin, const char* end) const {
+        return findIndex(begin, end) != notFound;
+    }
+
+    /**
+     * Is key prefixed with a key in the Trie? (See Trie::prefixExists)
+     */
+    bool prefixExists(const char* begin, const char* end) const {
+        return findPrefixIndex(begin, end) != notFound;
+    }
+
+    /**
+        Replace the contents with keys, which must be sorted (as
+        std::string orders them) and unique.
+        Throws std::length_error if the states, tail or key numbers do not
+        fit the int32_t units.
+    **/
+    void build(const std::vector<std::string>& keys);
+
+    size_t getKeyCount() const {
+        return keyCount;
+    }
+
+    size_t getStateCount() const {
+        return unitCount;
+    }
+
+    /**
+        Bytes used by the arrays.
+    **/
+    size_t getMemoryBytes() const {
+        return unitCount * sizeof(Unit) + tailBytes;
+    }
+
+    /**
+        Write the arrays to path (see the top of this file). The file is
+        written beside path and renamed over it, so a reader never maps a
+        partial file. Throws std::system_error on failure.
+    **/
+    void save(const std::string& path) const {
+        saveFile(path, nullptr, 0, 0);
+    }
+
+    /**
+        Map a file written by save (or DoubleArrayTrieMap::save).
+        Throws std::system_error if it cannot be mapped and
+        std::runtime_error if it is not a trie file of this version.
+    **/
+    static DoubleArrayTrie open(const std::string& path) {
+        DoubleArrayTrie darray;
+        darray.openFile(path);
+        return darray;
+    }
+
+protected:
+
+    static const uint32_t fileVersion = 1;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        // endianMarker as written, a file from a machine of the other
+        // byte order reads differently
+        uint32_t endian;
+        uint64_t keyCount;
+        uint64_t unitsOffset;
+        uint64_t unitCount;
+        uint64_t tailOffset;
+        uint64_t tailBytes;
+        uint64_t valuesOffset;
+        uint64_t valueSize;
+        uint64_t valueCount;
+    };
+
+    static const uint32_t notFound = UINT32_MAX;
+
+    /**
+        The number (sorted position) of key or notFound.
+    **/
+    uint32_t findIndex(const char* begin, const char* end) const;
+
+    /**
+        The number of the first key which prefixes key or notFound.
+    **/
+    uint32_t findPrefixIndex(const char* begin, const char* end) const;
+
+    /**
+        Write the file with valueCount values of valueSize bytes.
+    **/
+    void saveFile(const std::string& path,
+                  const void* values,
+                  size_t valueSize,
+                  size_t valueCount) const;
+
+    /**
+        Map path and use its arrays, returns the mapping and its header
+        so a DoubleArrayTrieMap can find its values.
+    **/
+    std::shared_ptr<const TrieMappedFile> openFile(const std::string& path);
+
+    static const FileHeader& header(const TrieMappedFile& file) {
+        return *reinterpret_cast<const FileHeader*>(file.data());
+    }
+
+private:
+
+    static const uint32_t endianMarker = 0x01020304;
+
+    struct Unit {
+        // >= 0 the base of the state's transitions
+        // < 0 the state's key continues in the tail at -(base + 1)
+        // for an end of key state, the key's number
+        int32_t base;
+        // the state which owns this slot, freeCheck if none
+        int32_t check;
+    };
+
+    /**
+        A tail entry is the key's number, the length of the rest of the
+        key and then that many bytes.
+    **/
+    struct TailHeader {
+        uint32_t index;
+        uint32_t length;
+    };
+
+    static uint32_t code(char c) {
+        return static_cast<uint8_t>(c) + 1;
+    }
+
+    // Slots past the last base so that base + code is always in range
+    static const size_t padding = 257;
+
+    // States, bases, key numbers and tail offsets are all int32_t
+    static const size_t maxOffset = INT32_MAX;
+
+    const TailHeader* tailAt(int32_t base) const {
+        return reinterpret_cast<const TailHeader*>(tail + -(base + 1));
+    }
+
+    /**
+        The arrays built by build, owned by storage.
+    **/
+    struct Arrays {
+        std::vector<Unit> units;
+        std::vector<char> tail;
+    };
+
+    // check of the root, which no other state can match
+    static const int32_t rootCheck = -2;
+    static const int32_t freeCheck = -1;
+
+    // Keeps the arrays alive, the Arrays from build or a TrieMappedFile.
+    // Nothing is modified after build so copies share it.
+    std::shared_ptr<const void> storage;
+    const Unit* units;
+    size_t unitCount;
+    const char* tail;
+    size_t tailBytes;
+    size_t keyCount;
+};
+
+/**
+    A DoubleArrayTrie with a value per key.
+**/
+template <typename V>
+class DoubleArrayTrieMap : public DoubleArrayTrie {
+public:
+
+    /**
+        Find key, returns a pointer to its value or nullptr.
+    **/
+    const V* find(const char* begin, const char* end) const {
+        uint32_t index = findIndex(begin, end);
+        return index == notFound ? nullptr : values + index;
+    }
+
+    /**
+        Find the first key which prefixes key, see TrieMap::prefixFind.
+    **/
+    const V* prefixFind(const char* begin, const char* end) const {
+        uint32_t index = findPrefixIndex(begin, end);
+        return index == notFound ? nullptr : values + index;
+    }
+
+    /**
+        As DoubleArrayTrie::build, values[i] is the value of keys[i].
+    **/
+    void build(const std::vector<std::string>& keys, std::vector<V> values) {
+        DoubleArrayTrie::build(keys);
+        auto owned = std::make_shared<const std::vector<V> >(std::move(values));
+        this->values = owned->data();
+        valueCount = owned->size();
+        valueStorage = std::move(owned);
+    }
+
+    /**
+        As DoubleArrayTrie::save, with the values. V must be trivially
+        copyable, the values are written as they are in memory.
+    **/
+    void save(const std::string& path) const {
+        static_assert(std::is_trivially_copyable<V>::value && alignof(V) <= 8,
+                      "DoubleArrayTrieMap::save requires a trivially copyable V");
+        saveFile(path, values, sizeof(V), getValueCount());
+    }
+
+    /**
+        Map a file written by DoubleArrayTrieMap<V>::save, see
+        DoubleArrayTrie::open. Throws std::runtime_error if the file's
+        values are not V sized or there is not one per key.
+    **/
+    static DoubleArrayTrieMap open(const std::string& path);
+
+    size_t getValueCount() const {
+        return valueCount;
+    }
+
+private:
+
+    // Keeps the values alive, a std::vector<V> or a TrieMappedFile
+    std::shared_ptr<const void> valueStorage;
+    const V* values = nullptr;
+    size_t valueCount = 0;
+};
+
+#include "utilities/trie_darray.cc"
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <unordered_set>
+
+/**
+ * Only the std::mt19937_64 engine is used for randomness. Its output is
+ * fixed by the standard, the distributions and std::shuffle are not (they
+ * differ between standard libraries), so those are done by hand here.
+ */
+
+inline const char* trieDatasetName(TrieDataset dataset) {
+    switch (dataset) {
+    case TrieDataset::Words:
+        return "words";
+    case TrieDataset::Urls:
+        return "urls";
+    case TrieDataset::Binary:
+        return "binary";
+    case TrieDataset::Integers:
+        return "integers";
+    case TrieDataset::IpPrefixes:
+        return "ip_prefixes";
+    }
+    return "unknown";
+}
+
+/**
+    FNV-1a, to spot duplicates without keeping a second copy of the keys.
+**/
+inline uint64_t trieDatasetHash(const std::string& key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : key) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+inline void trieDatasetShuffle(std::vector<std::string>& keys, std::mt19937_64& gen) {
+    for (size_t i = keys.size(); i > 1; i--) {
+        std::swap(keys[i - 1], keys[gen() % i]);
+    }
+}
+
+/**
+    Call next(gen) until count keys with different hashes have been made
+    (a key which collides with another's hash is dropped, which is as
+    deterministic as keeping it).
+**/
+template <typename Next>
+std::vector<std::string> trieDatasetUnique(size_t count, uint64_t seed, Next next) {
+    std::mt19937_64 gen(seed);
+    std::unordered_set<uint64_t> seen;
+    std::vector<std::string> keys;
+    seen.reserve(count);
+    keys.reserve(count);
+    while (keys.size() < count) {
+        std::string key = next(gen);
+        if (seen.insert(trieDatasetHash(key)).second) {
+            keys.push_back(std::move(key));
+        }
+    }
+    return keys;
+}
+
+/**
+    A pronounceable word of syllables, for host names and paths.
+**/
+inline std::string trieDatasetWord(std::mt19937_64& gen, size_t syllables) {
+    static const char* consonants = "bcdfghjklmnprstvwz";
+    static const char* vowels = "aeiou";
+    std::string word;
+    for (size_t i = 0; i < syllables; i++) {
+        word.push_back(consonants[gen() % 18]);
+        word.push_back(vowels[gen() % 5]);
+    }
+    return word;
+}
+
+/**
+    An index in [0, n) where small indexes are much more likely, as the
+    product of three uniform draws.
+**/
+inline size_t trieDatasetSkewed(std::mt19937_64& gen, size_t n) {
+    double product = 1;
+    for (int i = 0; i < 3; i++) {
+        product *= (gen() >> 11) * (1.0 / 9007199254740992.0);
+    }
+    return static_cast<size_t>(product * n);
+}
+
+/**
+    The words of /usr/share/dict/words, sorted and unique.
+**/
+inline std::vector<std::string> trieDatasetDictionary() {
+    std::ifstream file("/usr/share/dict/words");
+    std::vector<std::string> dict;
+    std::string line;
+    while (std::getline(file, line)) {
+        dict.push_back(line);
+    }
+    std::sort(dict.begin(), dict.end());
+    dict.erase(std::unique(dict.begin(), dict.end()), dict.end());
+    return dict;
+}
+
+inline std::vector<std::string> trieDatasetWords(size_t count, uint64_t seed) {
+    std::vector<std::string> dict = trieDatasetDictionary();
+    if (dict.empty()) {
+        return dict;
+    }
+
+    // A shuffle of the whole list, so fewer keys than words are a
+    // sample of it rather than its alphabetical start
+    std::mt19937_64 gen(seed);
+    trieDatasetShuffle(dict, gen);
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        keys.push_back(i < dict.size() ? dict[i]
+                                       : dict[i % dict.size()] + "-" + std::to_string(i / dict.size()));
+    }
+    if (count > dict.size()) {
+        trieDatasetShuffle(keys, gen);
+    }
+    return keys;
+}
+
+/**
+    Dictionary words with one letter changed and a 'q' appended, so they
+    share a prefix with a word but are (almost) never one.
+**/
+inline std::vector<std::string> trieDatasetWordProbes(size_t count, uint64_t seed) {
+    std::vector<std::string> dict = trieDatasetDictionary();
+    if (dict.empty()) {
+        return dict;
+    }
+
+    std::mt19937_64 gen(seed);
+    std::vector<std::string> probes;
+    probes.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        std::string word = dict[gen() % dict.size()];
+        if (!word.empty()) {
+            word[gen() % word.size()] = static_cast<char>('a' + gen() % 26);
+        }
+        word.push_back('q');
+        probes.push_back(std::move(word));
+    }
+    return probes;
+}
+
+inline std::vector<std::string> trieDatasetUrls(size_t count, uint64_t seed) {
+    // The same hosts and path words for every seed, so keys and probes
+    // share prefixes
+    std::mt19937_64 vocabulary(1);
+    static const char* domains[] = {".com", ".org", ".net", ".co.uk"};
+    std::vector<std::string> hosts;
+    for (int i = 0; i < 5000; i++) {
+        hosts.push_back("https://www." + trieDatasetWord(vocabulary, 2 + vocabulary() % 3) +
+                        domains[vocabulary() % 4]);
+    }
+    std::vector<std::string> paths;
+    for (int i = 0; i < 300; i++) {
+        paths.push_back(trieDatasetWord(vocabulary, 1 + vocabulary() % 4));
+    }
+
+    std::vector<std::string> keys = trieDatasetUnique(count, seed, [&](std::mt19937_64& gen) {
+        std::string url = hosts[trieDatasetSkewed(gen, hosts.size())];
+        size_t depth = 1 + gen() % 4;
+        for (size_t i = 0; i < depth; i++) {
+            url += "/" + paths[trieDatasetSkewed(gen, paths.size())];
+        }
+        if (gen() % 2) {
+            url += "/" + std::to_string(gen() % 100000);
+        } else {
+            url += "?id=" + std::to_string(gen() % 10000000);
+        }
+        return url;
+    });
+    return keys;
+}
+
+inline std::vector<std::string> trieDatasetBinary(size_t count, uint64_t seed) {
+    return trieDatasetUnique(count, seed, [](std::mt19937_64& gen) {
+        std::string key(8 + gen() % 25, '\0');
+        for (char& c : key) {
+            c = static_cast<char>(gen());
+        }
+        return key;
+    });
+}
+
+inline std::string trieDatasetBigEndian(uint64_t value, size_t bytes) {
+    std::string key(bytes, '\0');
+    for (size_t i = 0; i < bytes; i++) {
+        key[i] = static_cast<char>(value >> (8 * (bytes - 1 - i)));
+    }
+    return key;
+}
+
+inline std::vector<std::string> trieDatasetIntegers(size_t count, uint64_t seed) {
+    return trieDatasetUnique(count, seed, [](std::mt19937_64& gen) {
+        return trieDatasetBigEndian(gen(), 8);
+    });
+}
+
+inline std::vector<std::string> trieDatasetIpPrefixes(size_t count, uint64_t seed) {
+    // A routing table is mostly /24s, then shorter aggregates and a few
+    // longer more specifics
+    return trieDatasetUnique(count, seed, [](std::mt19937_64& gen) {
+        const unsigned pick = gen() % 100;
+        unsigned length = 24;
+        if (pick >= 60 && pick < 80) {
+            length = 16 + gen() % 8;
+        } else if (pick >= 80 && pick < 90) {
+            length = 25 + gen() % 8;
+        } else if (pick >= 90) {
+            length = 8 + gen() % 8;
+        }
+        const uint32_t address = static_cast<uint32_t>(gen() & (uint64_t(0xffffffff) << (32 - length)));
+        return trieDatasetBigEndian(address, 4).substr(0, (length + 7) / 8);
+    });
+}
+
+inline std::vector<std::string> trieDatasetKeys(TrieDataset dataset, size_t count, uint64_t seed) {
+    switch (dataset) {
+    case TrieDataset::Words:
+        return trieDatasetWords(count, seed);
+    case TrieDataset::Urls:
+        return trieDatasetUrls(count, seed);
+    case TrieDataset::Binary:
+        return trieDatasetBinary(count, seed);
+    case TrieDataset::Integers:
+        return trieDatasetIntegers(count, seed);
+    case TrieDataset::IpPrefixes:
+        return trieDatasetIpPrefixes(count, seed);
+    }
+    return std::vector<std::string>();
+}
+
+inline std::vector<std::string> trieDatasetProbes(TrieDataset dataset, size_t count, uint64_t seed) {
+    if (dataset == TrieDataset::Words) {
+        return trieDatasetWordProbes(count, seed);
+    }
+    if (dataset == TrieDataset::IpPrefixes) {
+        std::mt19937_64 gen(seed);
+        std::vector<std::string> addresses;
+        addresses.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            addresses.push_back(trieDatasetBigEndian(static_cast<uint32_t>(gen()), 4));
+        }
+        return addresses;
+    }
+    return trieDatasetKeys(dataset, count, seed);
+}
@@ -0,0 +1,53 @@
+/**
+    Deterministic key sets for benchmarking the Trie (trie_bench.cc).
+
+    Every dataset is generated from a seed, so the same count and seed
+    give the same keys (in the same order) on every run and machine.
+
+      Words      - a sample of /usr/share/dict/words, past the end of
+                   the file each word is reused with a numbered suffix
+      Urls       - URLs over a skewed set of hosts and paths, so keys
+                   share long prefixes
+      Binary     - 8 to 32 random bytes, all 256 byte values
+      Integers   - random 64 bit integers as 8 big endian bytes
+      IpPrefixes - IPv4 route prefixes (mostly /24) as the bytes covered
+                   by the prefix length
+
+    Keys are unique and shuffled.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TrieDataset {
+    Words,
+    Urls,
+    Binary,
+    Integers,
+    IpPrefixes
+};
+
+const char* trieDatasetName(TrieDataset dataset);
+
+/**
+    count unique keys of dataset. Words returns nothing if there is no
+    dictionary file.
+**/
+std::vector<std::string> trieDatasetKeys(TrieDataset dataset, size_t count, uint64_t seed);
+
+/**
+    count keys to look up in a trie of trieDatasetKeys(dataset, ...),
+    drawn from the same distribution with another seed. They mostly miss
+    but share prefixes with the keys. Words gives dictionary words with
+    a letter changed and a 'q' appended, so they miss too. IpPrefixes
+    gives full 4 byte addresses, the lookups a route table sees.
+**/
+std::vector<std::string> trieDatasetProbes(TrieDataset dataset, size_t count, uint64_t seed);
+
+#include "utilities/trie_dataset.cc"
@@ -0,0 +1,442 @@
+#include <functional>
+#include <new>
+#include <string_view>
+#include <vector>
+
+/**
+ * An entry is the suffix length (7 bits per byte, the top bit set on all
+ * but the last byte), the suffix bytes then valueBytes of value. Blocks
+ * are allocated to fit exactly, realloc'd as entries come and go.
+ */
+
+inline size_t hatLengthBytes(size_t length) {
+    size_t bytes = 1;
+    while (length >= 0x80) {
+        length >>= 7;
+        bytes++;
+    }
+    return bytes;
+}
+
+inline char* hatWriteLength(char* p, size_t length) {
+    while (length >= 0x80) {
+        *p++ = static_cast<char>(length | 0x80);
+        length >>= 7;
+    }
+    *p++ = static_cast<char>(length);
+    return p;
+}
+
+inline size_t hatReadLength(const char*& p) {
+    size_t length = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        byte = static_cast<uint8_t>(*p++);
+        length |= size_t(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return length;
+}
+
+inline uint64_t hatLengthBit(size_t length) {
+    return uint64_t(1) << (length < 63 ? length : 63);
+}
+
+inline HatTrie::HatTrie(size_t valueBytes, size_t burstSize)
+  : valueBytes(valueBytes),
+    root(nullptr),
+    burstSize(burstSize ? burstSize : 1),
+    keyCount(0),
+    nodeCount(0),
+    bucketCount(0),
+    slotBytes(0) {}
+
+inline HatTrie::~HatTrie() {
+    if (root) {
+        freeNode(root);
+    }
+}
+
+inline size_t HatTrie::slotOf(const Bucket* bucket, const char* key, size_t length) {
+    return std::hash<std::string_view>()(std::string_view(key, length)) & (bucket->slotCount - 1);
+}
+
+inline char* HatTrie::bucketFind(const Bucket* bucket, const char* key, size_t length) const {
+    char* slot = bucket->slots()[slotOf(bucket, key, length)];
+    if (!slot) {
+        return nullptr;
+    }
+    const char* p = slot + sizeof(uint32_t);
+    const char* end = p + blockSize(slot);
+    while (p < end) {
+        const size_t entryLength = hatReadLength(p);
+        if (entryLength == length && std::memcmp(p, key, length) == 0) {
+            return const_cast<char*>(p + length);
+        }
+        p += entryLength + valueBytes;
+    }
+    return nullptr;
+}
+
+inline char* HatTrie::append(char*& slot, const char* key, size_t length, const char* value) {
+    const uint32_t oldSize = slot ? blockSize(slot) : 0;
+    const size_t entryBytes = hatLengthBytes(length) + length + valueBytes;
+    const uint32_t newSize = static_cast<uint32_t>(oldSize + entryBytes);
+    char* block = static_cast<char*>(std::realloc(slot, sizeof(uint32_t) + newSize));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    slotBytes += entryBytes + (slot ? 0 : sizeof(uint32_t));
+    slot = block;
+    std::memcpy(block, &newSize, sizeof(newSize));
+
+    char* p = hatWriteLength(block + sizeof(uint32_t) + oldSize, length);
+    std::memcpy(p, key, length);
+    p += length;
+    if (value) {
+        std::memcpy(p, value, valueBytes);
+    } else {
+        std::memset(p, 0, valueBytes);
+    }
+    return p;
+}
+
+template <typename F>
+void HatTrie::forEachEntry(const Bucket* bucket, F f) const {
+    for (uint32_t s = 0; s < bucket->slotCount; s++) {
+        const char* slot = bucket->slots()[s];
+        if (!slot) {
+            continue;
+        }
+        const char* p = slot + sizeof(uint32_t);
+        const char* end = p + blockSize(slot);
+        while (p < end) {
+            const size_t length = hatReadLength(p);
+            f(p, length, p + length);
+            p += length + valueBytes;
+        }
+    }
+}
+
+inline HatTrie::Bucket* HatTrie::newBucket(uint32_t slotCount) {
+    const size_t bytes = sizeof(Bucket) + slotCount * sizeof(char*);
+    void* memory = ::operator new(bytes);
+    std::memset(memory, 0, bytes);
+    Bucket* bucket = new (memory) Bucket();
+    bucket->isBucket = true;
+    bucket->slotCount = slotCount;
+    bucketCount++;
+    slotBytes += slotCount * sizeof(char*);
+    return bucket;
+}
+
+inline void HatTrie::freeBucket(Bucket* bucket) {
+    char** slots = bucket->slots();
+    for (uint32_t s = 0; s < bucket->slotCount; s++) {
+        if (slots[s]) {
+            slotBytes -= sizeof(uint32_t) + blockSize(slots[s]);
+            std::free(slots[s]);
+        }
+    }
+    slotBytes -= bucket->slotCount * sizeof(char*);
+    bucket->~Bucket();
+    ::operator delete(bucket);
+    bucketCount--;
+}
+
+inline HatTrie::TrieNode* HatTrie::newNode() {
+    void* memory = ::operator new(nodeBytes());
+    std::memset(memory, 0, nodeBytes());
+    TrieNode* node = new (memory) TrieNode();
+    node->isBucket = false;
+    nodeCount++;
+    return node;
+}
+
+inline void HatTrie::freeNode(Node* node) {
+    if (node->isBucket) {
+        freeBucket(static_cast<Bucket*>(node));
+        return;
+    }
+    TrieNode* trieNode = static_cast<TrieNode*>(node);
+    for (Node* child : trieNode->children) {
+        if (child) {
+            freeNode(child);
+        }
+    }
+    trieNode->~TrieNode();
+    ::operator delete(trieNode);
+    nodeCount--;
+}
+
+/**
+ * The blocks of the doubled slots are sized first, then each entry is
+ * copied (as is) to its new block, so each block is allocated once.
+ */
+inline HatTrie::Bucket* HatTrie::grow(Node** link) {
+    Bucket* bucket = static_cast<Bucket*>(*link);
+    Bucket* bigger = newBucket(bucket->slotCount * 2);
+    char** slots = bigger->slots();
+    std::vector<uint32_t> sizes(bigger->slotCount, 0);
+    forEachEntry(bucket, [&](const char* key, size_t length, const char*) {
+        sizes[slotOf(bigger, key, length)] += hatLengthBytes(length) + length + valueBytes;
+    });
+    std::vector<uint32_t> used(bigger->slotCount, 0);
+    for (uint32_t s = 0; s < bigger->slotCount; s++) {
+        if (sizes[s]) {
+            slots[s] = static_cast<char*>(std::malloc(sizeof(uint32_t) + sizes[s]));
+            if (!slots[s]) {
+                freeBucket(bigger);
+                throw std::bad_alloc();
+            }
+            std::memcpy(slots[s], &sizes[s], sizeof(uint32_t));
+            slotBytes += sizeof(uint32_t) + sizes[s];
+        }
+    }
+    forEachEntry(bucket, [&](const char* key, size_t length, const char*) {
+        const size_t s = slotOf(bigger, key, length);
+        const size_t entryBytes = hatLengthBytes(length) + length + valueBytes;
+        std::memcpy(slots[s] + sizeof(uint32_t) + used[s], key - hatLengthBytes(length), entryBytes);
+        used[s] += entryBytes;
+    });
+
+    bigger->keyCount = bucket->keyCount;
+    bigger->lengths = bucket->lengths;
+    freeBucket(bucket);
+    *link = bigger;
+    return bigger;
+}
+
+inline void HatTrie::burst(Node** link) {
+    Bucket* bucket = static_cast<Bucket*>(*link);
+    TrieNode* node = newNode();
+
+    // The bytes every key starts with become the node's prefix
+    const char* first = nullptr;
+    size_t common = maxPrefix;
+    forEachEntry(bucket, [&](const char* key, size_t length, const char*) {
+        if (!first) {
+            first = key;
+        }
+        size_t i = 0;
+        while (i < common && i < length && key[i] == first[i]) {
+            i++;
+        }
+        common = i;
+    });
+    node->prefixLength = static_cast<uint8_t>(common);
+    std::memcpy(node->prefix, first, common);
+
+    forEachEntry(bucket, [&](const char* key, size_t length, const char* value) {
+        if (length == common) {
+            node->hasKey = true;
+            std::memcpy(node->value(), value, valueBytes);
+            return;
+        }
+        Node*& child = node->children[static_cast<uint8_t>(key[common])];
+        if (!child) {
+            child = newBucket(initialSlots);
+        }
+        Bucket* childBucket = static_cast<Bucket*>(child);
+        if (childBucket->keyCount >= childBucket->slotCount * maxLoad) {
+            childBucket = grow(&child);
+        }
+        const char* rest = key + common + 1;
+        const size_t restLength = length - common - 1;
+        append(childBucket->slots()[slotOf(childBucket, rest, restLength)], rest, restLength, value);
+        childBucket->keyCount++;
+        childBucket->lengths |= hatLengthBit(restLength);
+    });
+    freeBucket(bucket);
+    *link = node;
+}
+
+inline bool HatTrie::skipPrefix(const TrieNode* node, const char*& p, const char* end) {
+    const size_t length = node->prefixLength;
+    if (size_t(end - p) < length || std::memcmp(p, node->prefix, length) != 0) {
+        return false;
+    }
+    p += length;
+    return true;
+}
+
+inline void HatTrie::split(Node** link, size_t at) {
+    TrieNode* node = static_cast<TrieNode*>(*link);
+    TrieNode* parent = newNode();
+    parent->prefixLength = static_cast<uint8_t>(at);
+    std::memcpy(parent->prefix, node->prefix, at);
+    parent->children[static_cast<uint8_t>(node->prefix[at])] = node;
+
+    const size_t rest = node->prefixLength - at - 1;
+    std::memmove(node->prefix, node->prefix + at + 1, rest);
+    node->prefixLength = static_cast<uint8_t>(rest);
+    *link = parent;
+}
+
+inline char* HatTrie::findKey(const char* begin, const char* end) const {
+    const Node* node = root;
+    const char* p = begin;
+    while (node && !node->isBucket) {
+        TrieNode* trieNode = const_cast<TrieNode*>(static_cast<const TrieNode*>(node));
+        if (!skipPrefix(trieNode, p, end)) {
+            return nullptr;
+        }
+        if (p == end) {
+            return trieNode->hasKey ? trieNode->value() : nullptr;
+        }
+        node = trieNode->children[static_cast<uint8_t>(*p++)];
+    }
+    if (!node) {
+        return nullptr;
+    }
+    return bucketFind(static_cast<const Bucket*>(node), p, end - p);
+}
+
+inline char* HatTrie::prefixFindKey(const char* begin, const char* end) const {
+    const Node* node = root;
+    const char* p = begin;
+    while (node && !node->isBucket) {
+        TrieNode* trieNode = const_cast<TrieNode*>(static_cast<const TrieNode*>(node));
+        // every key from here on is at least as long as the prefix
+        if (!skipPrefix(trieNode, p, end)) {
+            return nullptr;
+        }
+        // the empty key prefixes nothing
+        if (p != begin && trieNode->hasKey) {
+            return trieNode->value();
+        }
+        if (p == end) {
+            return nullptr;
+        }
+        node = trieNode->children[static_cast<uint8_t>(*p++)];
+    }
+    if (!node) {
+        return nullptr;
+    }
+
+    // Look up each prefix of the rest of key, shortest first, skipping
+    // the lengths no suffix in the bucket has
+    const Bucket* bucket = static_cast<const Bucket*>(node);
+    const size_t remaining = end - p;
+    for (size_t length = p == begin ? 1 : 0; length <= remaining; length++) {
+        if (!(bucket->lengths & hatLengthBit(length))) {
+            continue;
+        }
+        if (char* value = bucketFind(bucket, p, length)) {
+            return value;
+        }
+    }
+    return nullptr;
+}
+
+inline char* HatTrie::insertKey(const char* begin, const char* end, bool& added) {
+    Node** link = &root;
+    const char* p = begin;
+    while (true) {
+        if (!*link) {
+            *link = newBucket(initialSlots);
+        }
+        if (!(*link)->isBucket) {
+            TrieNode* trieNode = static_cast<TrieNode*>(*link);
+            size_t matched = 0;
+            while (matched < trieNode->prefixLength && p + matched != end &&
+                   p[matched] == trieNode->prefix[matched]) {
+                matched++;
+            }
+            if (matched < trieNode->prefixLength) {
+                split(link, matched);
+                continue;
+            }
+            p += matched;
+            if (p == end) {
+                added = !trieNode->hasKey;
+                if (added) {
+                    trieNode->hasKey = true;
+                    std::memset(trieNode->value(), 0, valueBytes);
+                    keyCount++;
+                }
+                return trieNode->value();
+            }
+            link = &trieNode->children[static_cast<uint8_t>(*p++)];
+            continue;
+        }
+
+        Bucket* bucket = static_cast<Bucket*>(*link);
+        const size_t length = end - p;
+        if (char* value = bucketFind(bucket, p, length)) {
+            added = false;
+            return value;
+        }
+        if (bucket->keyCount >= burstSize) {
+            burst(link);
+            continue;
+        }
+        if (bucket->keyCount >= bucket->slotCount * maxLoad) {
+            bucket = grow(link);
+        }
+        char* value = append(bucket->slots()[slotOf(bucket, p, length)], p, length, nullptr);
+        bucket->keyCount++;
+        bucket->lengths |= hatLengthBit(length);
+        keyCount++;
+        added = true;
+        return value;
+    }
+}
+
+inline void HatTrie::erase(const std::string& key) {
+    const char* p = key.data();
+    const char* end = key.data() + key.size();
+    Node* node = root;
+    while (node && !node->isBucket) {
+        TrieNode* trieNode = static_cast<TrieNode*>(node);
+        if (!skipPrefix(trieNode, p, end)) {
+            return;
+        }
+        if (p == end) {
+            if (trieNode->hasKey) {
+                trieNode->hasKey = false;
+                keyCount--;
+            }
+            return;
+        }
+        node = trieNode->children[static_cast<uint8_t>(*p++)];
+    }
+    if (!node) {
+        return;
+    }
+
+    Bucket* bucket = static_cast<Bucket*>(node);
+    const size_t length = end - p;
+    char*& slot = bucket->slots()[slotOf(bucket, p, length)];
+    if (!slot) {
+        return;
+    }
+    char* entry = slot + sizeof(uint32_t);
+    char* blockEnd = entry + blockSize(slot);
+    while (entry < blockEnd) {
+        const char* q = entry;
+        const size_t entryLength = hatReadLength(q);
+        const size_t entryBytes = (q - entry) + entryLength + valueBytes;
+        if (entryLength == length && std::memcmp(q, p, length) == 0) {
+            std::memmove(entry, entry + entryBytes, blockEnd - entry - entryBytes);
+            const uint32_t newSize = static_cast<uint32_t>(blockSize(slot) - entryBytes);
+            slotBytes -= entryBytes;
+            if (newSize == 0) {
+                std::free(slot);
+                slot = nullptr;
+                slotBytes -= sizeof(uint32_t);
+            } else {
+                std::memcpy(slot, &newSize, sizeof(newSize));
+                // shrinking, a failed realloc leaves the block as it was
+                if (char* block = static_cast<char*>(std::realloc(slot, sizeof(uint32_t) + newSize))) {
+                    slot = block;
+                }
+            }
+            bucket->keyCount--;
+            keyCount--;
+            return;
+        }
+        entry += entryBytes;
+    }
+}
@@ -0,0 +1,309 @@
+/**
+    HAT-trie (Askitis and Sinha), a burst trie of array hash buckets for
+    large sets of string keys.
+
+    The upper levels are trie nodes of 256 children, one per byte. Below
+    them every key lives in a bucket, an array hash of the key's
+    remaining suffix: each slot of a bucket is one contiguous block of
+    entries (length, suffix bytes, value bytes), so a lookup is a walk of
+    a few trie nodes, one hash and a scan of one block, rather than a node
+    per byte. A bucket doubles its slots as it fills and once it holds
+    burstSize keys it bursts: it is replaced by a trie node whose children
+    are new buckets of the keys by their first byte (a key which ends at
+    the node is kept in the node itself). Everything starts as one bucket.
+
+    A trie node made by a burst skips the bytes which every key of the
+    bucket started with (up to maxPrefix), so keys with a long common
+    start (https://www.) are not a chain of single child nodes. An insert
+    which differs within those bytes splits the node.
+
+    HatTrie and HatTrieMap<V> have the exists/prefixExists/insert/erase
+    and findValue/prefixFindValue surface of Trie<char> and
+    TrieMap<char, V>. Entries move as their blocks grow, so there is no
+    find returning an iterator, values are copied out and V must be
+    trivially copyable. Erase leaves buckets and trie nodes in place.
+
+    Not thread safe, the caller must serialise writers with readers.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+class HatTrie {
+public:
+
+    static const size_t defaultBurstSize = 16384;
+
+    /**
+        burstSize is how many keys a bucket holds before it bursts.
+    **/
+    explicit HatTrie(size_t burstSize = defaultBurstSize)
+      : HatTrie(0, burstSize) {}
+
+    HatTrie(const HatTrie&) = delete;
+    HatTrie& operator=(const HatTrie&) = delete;
+
+    ~HatTrie();
+
+    /**
+        Does a key exist?
+        Pass the start and end of a key to search for.
+    **/
+    bool exists(const char* begin, const char* end) const {
+        return findKey(begin, end) != nullptr;
+    }
+
+    /**
+     * Is key prefixed with a key in the HatTrie? (See Trie::prefixExists)
+     */
+    bool prefixExists(const char* begin, const char* end) const {
+        return prefixFindKey(begin, end) != nullptr;
+    }
+
+    /**
+        Insert an item into the HatTrie
+    **/
+    void insert(const std::string& key) {
+        bool added;
+        insertKey(key.data(), key.data() + key.size(), added);
+    }
+
+    /**
+     * Erase key from HatTrie.
+     */
+    void erase(const std::string& key);
+
+    /**
+        Insert every key (std::string) of [begin, end).
+    **/
+    template <typename Itr>
+    void bulkInsert(Itr begin, Itr end) {
+        for (; begin != end; ++begin) {
+            insert(*begin);
+        }
+    }
+
+    size_t size() const {
+        return keyCount;
+    }
+
+    size_t getNodeCount() const {
+        return nodeCount;
+    }
+
+    size_t getBucketCount() const {
+        return bucketCount;
+    }
+
+    /**
+        Bytes used by the trie nodes, buckets and their blocks.
+    **/
+    size_t getMemoryBytes() const {
+        return nodeCount * nodeBytes() + bucketCount * sizeof(Bucket) + slotBytes;
+    }
+
+protected:
+
+    HatTrie(size_t valueBytes, size_t burstSize);
+
+    /**
+        The value bytes of key (where it would be for a set), nullptr if
+        it is not in the HatTrie.
+    **/
+    char* findKey(const char* begin, const char* end) const;
+
+    /**
+        findKey for the shortest key which prefixes key.
+    **/
+    char* prefixFindKey(const char* begin, const char* end) const;
+
+    /**
+        The value bytes of key, which is added (added set to true) if it
+        is not already in the HatTrie. Valid until the next change.
+    **/
+    char* insertKey(const char* begin, const char* end, bool& added);
+
+    const size_t valueBytes;
+
+private:
+
+    struct Node {
+        bool isBucket;
+    };
+
+    static const size_t maxPrefix = 22;
+
+    /**
+        A trie node, valueBytes of value follow it. Keys reach the node
+        after the prefixLength bytes of prefix.
+    **/
+    struct TrieNode : Node {
+        bool hasKey;
+        uint8_t prefixLength;
+        char prefix[maxPrefix];
+        Node* children[256];
+
+        char* value() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    /**
+        An array hash of key suffixes, slotCount slots follow it (in the
+        same allocation, so a lookup misses on one less line). Each slot
+        is nullptr or a block which starts with a uint32_t of the bytes of
+        entries which follow.
+    **/
+    struct Bucket : Node {
+        uint32_t keyCount;
+        uint32_t slotCount;
+        // bit n set if a suffix of length n (the last bit 63 or more)
+        // has been inserted, the lengths prefixFindKey need look up
+        uint64_t lengths;
+
+        char** slots() {
+            return reinterpret_cast<char**>(this + 1);
+        }
+
+        char* const* slots() const {
+            return reinterpret_cast<char* const*>(this + 1);
+        }
+    };
+
+    static const uint32_t initialSlots = 16;
+    // slots double when a bucket has more than this many keys per slot
+    static const uint32_t maxLoad = 1;
+
+    size_t nodeBytes() const {
+        return sizeof(TrieNode) + valueBytes;
+    }
+
+    static uint32_t blockSize(const char* block) {
+        uint32_t size;
+        std::memcpy(&size, block, sizeof(size));
+        return size;
+    }
+
+    static size_t slotOf(const Bucket* bucket, const char* key, size_t length);
+
+    /**
+        The value bytes of the suffix [key, key + length) in bucket,
+        nullptr if it is not there.
+    **/
+    char* bucketFind(const Bucket* bucket, const char* key, size_t length) const;
+
+    /**
+        Append an entry of suffix and value (or zeroes if nullptr) to the
+        block of slot, returning where its value is.
+    **/
+    char* append(char*& slot, const char* key, size_t length, const char* value);
+
+    /**
+        Call f(key, length, value) for every entry of bucket.
+    **/
+    template <typename F>
+    void forEachEntry(const Bucket* bucket, F f) const;
+
+    Bucket* newBucket(uint32_t slotCount);
+    void freeBucket(Bucket* bucket);
+    TrieNode* newNode();
+    void freeNode(Node* node);
+
+    /**
+        Replace the bucket at link with one of twice the slots.
+    **/
+    Bucket* grow(Node** link);
+
+    /**
+        Replace the bucket at link with a trie node of new buckets.
+    **/
+    void burst(Node** link);
+
+    /**
+        Split the trie node at link after at bytes of its prefix, into a
+        parent of those bytes whose child (at the next byte) is the node.
+    **/
+    void split(Node** link, size_t at);
+
+    /**
+        Step p over the prefix of node, false if [p, end) does not start
+        with it.
+    **/
+    static bool skipPrefix(const TrieNode* node, const char*& p, const char* end);
+
+    Node* root;
+    const size_t burstSize;
+    size_t keyCount;
+    size_t nodeCount;
+    size_t bucketCount;
+    // slot arrays and blocks
+    size_t slotBytes;
+};
+
+/**
+    A HatTrie mapping each key to a V.
+**/
+template <typename V>
+class HatTrieMap : public HatTrie {
+public:
+
+    static_assert(std::is_trivially_copyable<V>::value,
+                  "HatTrieMap copies values byte wise, V must be trivially copyable");
+
+    explicit HatTrieMap(size_t burstSize = defaultBurstSize)
+      : HatTrie(sizeof(V), burstSize) {}
+
+    /**
+        Insert key with value (replacing the value of an existing key)
+    **/
+    void insert(const std::string& key, V value) {
+        bool added;
+        std::memcpy(insertKey(key.data(), key.data() + key.size(), added), &value, sizeof(V));
+    }
+
+    /**
+        Find key/value.
+        Return true if found and returns value via 3rd parameter
+    **/
+    bool findValue(const char* begin, const char* end, V& value) const {
+        return copyOut(findKey(begin, end), value);
+    }
+
+    /**
+        The value of the shortest key which prefixes key, see
+        TrieMap::prefixFind.
+    **/
+    bool prefixFindValue(const char* begin, const char* end, V& value) const {
+        return copyOut(prefixFindKey(begin, end), value);
+    }
+
+    /**
+        Insert every key/value (std::pair<std::string, V>) of [begin, end).
+    **/
+    template <typename Itr>
+    void bulkInsert(Itr begin, Itr end) {
+        for (; begin != end; ++begin) {
+            insert(begin->first, begin->second);
+        }
+    }
+
+private:
+
+    static bool copyOut(const char* bytes, V& value) {
+        if (!bytes) {
+            return false;
+        }
+        std::memcpy(&value, bytes, sizeof(V));
+        return true;
+    }
+};
+
+#include "utilities/trie_hat.cc"
@@ -0,0 +1,94 @@
+#include <cmath>
+#include <limits>
+
+/**
+ * Bucket index of a value v at or above 2^subBucketBits, with top bit
+ * msb: shift = msb - subBucketBits + 1 drops all but the top
+ * subBucketBits bits, leaving sub = v >> shift in [half, 2 * half). The
+ * index is shift * half + sub, so each shift takes the next half buckets
+ * after those of the shift below. Values under 2^subBucketBits are
+ * their own index (shift 0).
+ */
+inline size_t TrieHistogram::indexOf(uint64_t value) {
+    if (value < (uint64_t(1) << subBucketBits)) {
+        return static_cast<size_t>(value);
+    }
+    if (value >> maxBits) {
+        return bucketCount - 1;
+    }
+    const unsigned msb = 63 - __builtin_clzll(value);
+    const unsigned shift = msb - subBucketBits + 1;
+    return shift * halfBucket + static_cast<size_t>(value >> shift);
+}
+
+inline uint64_t TrieHistogram::highestIn(size_t index) {
+    if (index < 2 * halfBucket) {
+        return index;
+    }
+    const unsigned shift = static_cast<unsigned>(index / halfBucket - 1);
+    const uint64_t sub = index - shift * halfBucket;
+    return ((sub + 1) << shift) - 1;
+}
+
+inline void TrieHistogram::record(uint64_t value, uint64_t count) {
+    counts[indexOf(value)] += count;
+    total += count;
+    minValue = value < minValue ? value : minValue;
+    maxValue = value > maxValue ? value : maxValue;
+    sum += double(value) * count;
+    sumSquares += double(value) * value * count;
+}
+
+inline void TrieHistogram::merge(const TrieHistogram& other) {
+    for (size_t i = 0; i < bucketCount; i++) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    minValue = other.minValue < minValue ? other.minValue : minValue;
+    maxValue = other.maxValue > maxValue ? other.maxValue : maxValue;
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+}
+
+inline void TrieHistogram::clear() {
+    counts.fill(0);
+    total = 0;
+    minValue = std::numeric_limits<uint64_t>::max();
+    maxValue = 0;
+    sum = 0;
+    sumSquares = 0;
+}
+
+inline double TrieHistogram::stddev() const {
+    if (total < 2) {
+        return 0;
+    }
+    // sum of (v - mean)^2 is sumSquares - sum * mean
+    const double squares = sumSquares - sum * mean();
+    return squares > 0 ? std::sqrt(squares / (total - 1)) : 0;
+}
+
+inline uint64_t TrieHistogram::percentile(double percentile) const {
+    if (!total) {
+        return 0;
+    }
+    const double target = total * percentile / 100.0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucketCount; i++) {
+        seen += counts[i];
+        if (seen && seen >= target) {
+            // the last bucket also holds everything past 2^maxBits
+            const uint64_t highest = i == bucketCount - 1 ? maxValue : highestIn(i);
+            return highest < maxValue ? highest : maxValue;
+        }
+    }
+    return maxValue;
+}
+
+inline uint64_t TrieHistogram::countBelow(uint64_t value) const {
+    uint64_t below = 0;
+    for (size_t i = 0, end = indexOf(value); i < end; i++) {
+        below += counts[i];
+    }
+    return below;
+}
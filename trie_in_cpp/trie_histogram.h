@@ -0,0 +1,98 @@
+/**
+    A log-linear latency histogram (as HdrHistogram lays out its buckets)
+    for the benchmarks.
+
+    Values below 2^subBucketBits each have a bucket of their own. Above
+    that every power of two is split into 2^(subBucketBits - 1) equal
+    buckets, so a value is recorded to within 1/128 of itself (under 1%)
+    whatever its size. Values of 2^maxBits (about 18 minutes in ns) and
+    above all go into the last bucket, min() and max() stay exact.
+
+    The buckets are a fixed array (about 34KB) so recording never
+    allocates and a run of any length takes the same memory. Each thread
+    records into a histogram of its own and merge() adds them together
+    afterwards.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class TrieHistogram {
+public:
+
+    static const unsigned subBucketBits = 8;
+    static const unsigned maxBits = 40;
+
+    TrieHistogram() {
+        clear();
+    }
+
+    void record(uint64_t value, uint64_t count = 1);
+
+    /**
+        Add every value recorded in other.
+    **/
+    void merge(const TrieHistogram& other);
+
+    void clear();
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t min() const {
+        return total ? minValue : 0;
+    }
+
+    uint64_t max() const {
+        return maxValue;
+    }
+
+    double mean() const {
+        return total ? sum / total : 0;
+    }
+
+    /**
+        The sample standard deviation, 0 with fewer than two values.
+    **/
+    double stddev() const;
+
+    /**
+        The value which percentile (0 to 100) of the recorded values are
+        at or below, as the top of its bucket (and no more than max()).
+        0 if nothing has been recorded.
+    **/
+    uint64_t percentile(double percentile) const;
+
+    /**
+        The number of values recorded below value, to within its bucket.
+    **/
+    uint64_t countBelow(uint64_t value) const;
+
+private:
+
+    static const size_t halfBucket = size_t(1) << (subBucketBits - 1);
+    static const size_t bucketCount = (maxBits - subBucketBits + 2) * halfBucket;
+
+    static size_t indexOf(uint64_t value);
+
+    /**
+        The largest value which is recorded in bucket index.
+    **/
+    static uint64_t highestIn(size_t index);
+
+    std::array<uint64_t, bucketCount> counts;
+    uint64_t total;
+    uint64_t minValue;
+    uint64_t maxValue;
+    // of the exact values, for mean and stddev
+    double sum;
+    double sumSquares;
+};
+
+#include "utilities/trie_histogram.cc"
@@ -0,0 +1,77 @@
+inline uint64_t TrieOpCounters::latencyPercentile(double percentile) const {
+    const double target = operations * percentile / 100.0;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < latencyBuckets; b++) {
+        seen += latency[b];
+        if (seen && seen >= target) {
+            return uint64_t(1) << b;
+        }
+    }
+    return 0;
+}
+
+inline TrieOpCounters TrieCountingInstrumentation::read(TrieOp op) const {
+    TrieOpCounters total;
+    for (auto& s : slots) {
+        const Slot* slot = s.load(std::memory_order_acquire);
+        if (!slot) {
+            continue;
+        }
+        const Counters& c = slot->ops[static_cast<size_t>(op)];
+        total.operations += c.operations.load(std::memory_order_relaxed);
+        total.nodes += c.nodes.load(std::memory_order_relaxed);
+        total.lockWaitNs += c.lockWaitNs.load(std::memory_order_relaxed);
+        total.allocations += c.allocations.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < TrieOpCounters::latencyBuckets; b++) {
+            total.latency[b] += c.latency[b].load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+inline TrieCountingInstrumentation::Slot& TrieCountingInstrumentation::getSlot() {
+    // Only this thread stores to its index, so no other thread can be
+    // allocating the same slot.
+    std::atomic<Slot*>& s = slots[TrieThreadIndex::get()];
+    Slot* slot = s.load(std::memory_order_relaxed);
+    if (!slot) {
+        slot = new Slot();
+        s.store(slot, std::memory_order_release);
+    }
+    return *slot;
+}
+
+inline TrieCountingInstrumentation::Probe::Probe(TrieCountingInstrumentation& owner,
+                                                 TrieOp op,
+                                                 uint64_t operations)
+  : owner(owner),
+    op(op),
+    operations(operations),
+    start(Clock::now()),
+    lockTime(start),
+    nodes(threadCounts().nodes),
+    allocations(threadCounts().allocations) {}
+
+inline TrieCountingInstrumentation::Probe::~Probe() {
+    if (!operations) {
+        return;
+    }
+    const Clock::time_point end = Clock::now();
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() /
+                        operations;
+    const uint64_t waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(lockTime - start).count();
+
+    // bucket b holds [2^(b - 1), 2^b)
+    size_t bucket = 0;
+    while (bucket < TrieOpCounters::latencyBuckets - 1 && (ns >> bucket)) {
+        bucket++;
+    }
+
+    Counters& c = owner.getSlot().ops[static_cast<size_t>(op)];
+    const ThreadCounts& counts = threadCounts();
+    add(c.operations, operations);
+    add(c.nodes, counts.nodes - nodes);
+    add(c.lockWaitNs, waitNs);
+    add(c.allocations, counts.allocations - allocations);
+    add(c.latency[bucket], operations);
+}
@@ -0,0 +1,215 @@
+/**
+    Hot path instrumentation for the Trie.
+
+    The Instrumentation member of a TrieImpl policy decides what the
+    lookups, inserts and erases record.
+
+    TrieNoInstrumentation       - nothing, every hook is an empty inline
+                                  function so the trie compiles exactly as
+                                  without them. The default.
+    TrieCountingInstrumentation - per operation type, the number of
+                                  operations, nodes visited, time waiting
+                                  for the shard lock, allocations and a
+                                  latency histogram.
+
+    Each thread counts into its own cache line aligned slot (indexed by
+    TrieThreadIndex), which only that thread writes, so counting adds no
+    shared writes to the trie. read() adds the slots together.
+
+    Nodes visited and allocations are counted in thread_local totals and
+    an operation takes the difference across itself, so they need nothing
+    passed down the walk. A visitor which calls another instrumented trie
+    has those nodes and allocations counted by both.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "utilities/trie_olc.h"
+
+/**
+    The operations which are instrumented.
+**/
+enum class TrieOp : uint8_t {
+    Find,       // exists, find, findValue
+    PrefixFind, // prefixExists, prefixFind, longestPrefixFind
+    Insert,
+    Erase
+};
+
+/**
+    Policy Instrumentation option: nothing is recorded.
+**/
+struct TrieNoInstrumentation {
+    static const bool enabled = false;
+
+    // The allocator the trie's nodes come from
+    template <typename Allocator>
+    using NodeAllocator = Allocator;
+
+    class Probe {
+    public:
+        Probe(TrieNoInstrumentation&, TrieOp, uint64_t = 1) {}
+
+        void locked() {}
+    };
+
+    static void countNode() {}
+};
+
+/**
+    The counters of one operation type, added up over every thread.
+**/
+struct TrieOpCounters {
+    // latency[b] counts operations taking less than 2^b ns (and at least
+    // 2^(b - 1) ns), the last bucket takes everything longer
+    static const size_t latencyBuckets = 32;
+
+    uint64_t operations = 0;
+    uint64_t nodes = 0;
+    uint64_t lockWaitNs = 0;
+    uint64_t allocations = 0;
+    std::array<uint64_t, latencyBuckets> latency{};
+
+    double nodesPerOperation() const {
+        return operations ? double(nodes) / operations : 0;
+    }
+
+    double allocationsPerOperation() const {
+        return operations ? double(allocations) / operations : 0;
+    }
+
+    double lockWaitPerOperation() const {
+        return operations ? double(lockWaitNs) / operations : 0;
+    }
+
+    /**
+        The upper bound (ns) of the latency bucket which holds the
+        percentile'th (0 to 100) operation, 0 if there are none.
+    **/
+    uint64_t latencyPercentile(double percentile) const;
+};
+
+/**
+    Policy Instrumentation option: count everything, see the top of this
+    file.
+**/
+class TrieCountingInstrumentation {
+public:
+
+    static const bool enabled = true;
+
+    template <typename Allocator>
+    class NodeAllocator : public Allocator {
+    public:
+        void* allocate(size_t bytes) {
+            threadCounts().allocations++;
+            return Allocator::allocate(bytes);
+        }
+    };
+
+    TrieCountingInstrumentation() {}
+
+    TrieCountingInstrumentation(const TrieCountingInstrumentation&) = delete;
+    TrieCountingInstrumentation& operator=(const TrieCountingInstrumentation&) = delete;
+
+    ~TrieCountingInstrumentation() {
+        for (auto& slot : slots) {
+            delete slot.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+        Add up every thread's counters of op. Counting continues while
+        this reads, so the result is not a single instant.
+    **/
+    TrieOpCounters read(TrieOp op) const;
+
+    /**
+        Times one operation, constructed as it starts and destroyed as it
+        ends. locked() marks the shard lock being acquired.
+
+        A batch of lookups is one probe of operations, each counted with
+        the batch's average latency.
+    **/
+    class Probe {
+    public:
+
+        Probe(TrieCountingInstrumentation& owner, TrieOp op, uint64_t operations = 1);
+
+        ~Probe();
+
+        void locked() {
+            lockTime = Clock::now();
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        TrieCountingInstrumentation& owner;
+        const TrieOp op;
+        const uint64_t operations;
+        const Clock::time_point start;
+        Clock::time_point lockTime;
+        const uint64_t nodes;
+        const uint64_t allocations;
+    };
+
+    static void countNode() {
+        threadCounts().nodes++;
+    }
+
+private:
+
+    static const size_t opCount = 4;
+
+    /**
+        Running totals of the calling thread.
+    **/
+    struct ThreadCounts {
+        uint64_t nodes = 0;
+        uint64_t allocations = 0;
+    };
+
+    static ThreadCounts& threadCounts() {
+        thread_local ThreadCounts counts;
+        return counts;
+    }
+
+    /**
+        The counters of one thread, written only by that thread (relaxed
+        load and store rather than a locked add) and read by read().
+    **/
+    struct Counters {
+        std::atomic<uint64_t> operations;
+        std::atomic<uint64_t> nodes;
+        std::atomic<uint64_t> lockWaitNs;
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> latency[TrieOpCounters::latencyBuckets];
+    };
+
+    struct alignas(64) Slot {
+        Counters ops[opCount];
+    };
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+
+    /**
+        The calling thread's slot, allocated on its first operation.
+    **/
+    Slot& getSlot();
+
+    std::atomic<Slot*> slots[TrieThreadIndex::maxThreads] = {};
+};
+
+#include "utilities/trie_instrument.cc"
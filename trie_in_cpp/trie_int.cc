@@ -0,0 +1,173 @@
+#include <cstring>
+
+template <typename K>
+inline void TrieIntKey<K, typename std::enable_if<std::is_integral<K>::value &&
+                                                  !std::is_same<K, bool>::value>::type>::
+encode(K key, char* out) {
+    typedef typename std::make_unsigned<K>::type U;
+    U u = static_cast<U>(key);
+    if (std::is_signed<K>::value) {
+        // negative keys sort before positive ones
+        u ^= U(1) << (sizeof(K) * 8 - 1);
+    }
+    for (size_t i = sizeof(K); i-- > 0;) {
+        out[i] = static_cast<char>(u & 0xff);
+        u = static_cast<U>(u >> 8);
+    }
+}
+
+template <typename K>
+inline K TrieIntKey<K, typename std::enable_if<std::is_integral<K>::value &&
+                                               !std::is_same<K, bool>::value>::type>::
+decode(const char* in) {
+    typedef typename std::make_unsigned<K>::type U;
+    U u = 0;
+    for (size_t i = 0; i < sizeof(K); i++) {
+        u = static_cast<U>((u << 8) | static_cast<uint8_t>(in[i]));
+    }
+    if (std::is_signed<K>::value) {
+        u ^= U(1) << (sizeof(K) * 8 - 1);
+    }
+    return static_cast<K>(u);
+}
+
+template <typename... Ks>
+template <size_t I>
+constexpr size_t TrieIntKey<std::tuple<Ks...> >::offsetOf() {
+    const size_t sizes[] = {TrieIntKey<Ks>::bytes..., 0};
+    size_t offset = 0;
+    for (size_t i = 0; i < I; i++) {
+        offset += sizes[i];
+    }
+    return offset;
+}
+
+template <typename... Ks>
+template <size_t... I>
+inline void TrieIntKey<std::tuple<Ks...> >::encodeAll(const std::tuple<Ks...>& key,
+                                                      char* out,
+                                                      std::index_sequence<I...>) {
+    (TrieIntKey<Ks>::encode(std::get<I>(key), out + offsetOf<I>()), ...);
+}
+
+template <typename... Ks>
+template <size_t... I>
+inline std::tuple<Ks...> TrieIntKey<std::tuple<Ks...> >::decodeAll(const char* in,
+                                                                   std::index_sequence<I...>) {
+    return std::tuple<Ks...>(TrieIntKey<Ks>::decode(in + offsetOf<I>())...);
+}
+
+template <typename... Ks>
+inline void TrieIntKey<std::tuple<Ks...> >::encode(const std::tuple<Ks...>& key, char* out) {
+    encodeAll(key, out, std::index_sequence_for<Ks...>());
+}
+
+template <typename... Ks>
+inline std::tuple<Ks...> TrieIntKey<std::tuple<Ks...> >::decode(const char* in) {
+    return decodeAll(in, std::index_sequence_for<Ks...>());
+}
+
+template <typename K, typename V, typename Policy>
+void TrieIntMap<K, V, Policy>::insert(const K& key, V value) {
+    char bytes[Key::bytes];
+    Key::encode(key, bytes);
+    map.insert(std::string_view(bytes, Key::bytes), value);
+}
+
+template <typename K, typename V, typename Policy>
+typename TrieIntMap<K, V, Policy>::iterator TrieIntMap<K, V, Policy>::find(const K& key) {
+    char bytes[Key::bytes];
+    Key::encode(key, bytes);
+    return map.find(bytes, bytes + Key::bytes);
+}
+
+template <typename K, typename V, typename Policy>
+bool TrieIntMap<K, V, Policy>::findValue(const K& key, V& value) {
+    char bytes[Key::bytes];
+    Key::encode(key, bytes);
+    return map.findValue(bytes, bytes + Key::bytes, value);
+}
+
+template <typename K, typename V, typename Policy>
+template <typename Itr>
+size_t TrieIntMap<K, V, Policy>::findBatch(Itr begin, Itr end, V* values, bool* found) {
+    char bytes[batchKeys * Key::bytes];
+    std::string_view keys[batchKeys];
+    size_t foundCount = 0;
+    while (begin != end) {
+        size_t count = 0;
+        for (; begin != end && count < batchKeys; ++begin, ++count) {
+            Key::encode(*begin, bytes + count * Key::bytes);
+            keys[count] = std::string_view(bytes + count * Key::bytes, Key::bytes);
+        }
+        foundCount += map.findBatch(keys, keys + count, values, found);
+        values += count;
+        found += count;
+    }
+    return foundCount;
+}
+
+template <typename K, typename V, typename Policy>
+void TrieIntMap<K, V, Policy>::erase(const K& key) {
+    char bytes[Key::bytes];
+    Key::encode(key, bytes);
+    map.erase(std::string_view(bytes, Key::bytes));
+}
+
+template <typename K, typename V, typename Policy>
+template <typename Visitor>
+void TrieIntMap<K, V, Policy>::range(const K& low, const K& high, Visitor visit) {
+    char lowBytes[Key::bytes];
+    char highBytes[Key::bytes];
+    Key::encode(low, lowBytes);
+    Key::encode(high, highBytes);
+    // every key is Key::bytes long, so memcmp orders them as the cursor does
+    for (auto c = map.lowerBound(lowBytes, lowBytes + Key::bytes);
+         c.valid() && std::memcmp(c.key().data(), highBytes, Key::bytes) <= 0;
+         c.next()) {
+        visit(Key::decode(c.key().data()), c.value());
+    }
+}
+
+template <typename K, typename V, typename Policy>
+template <typename Visitor>
+void TrieIntMap<K, V, Policy>::forEach(Visitor visit) {
+    for (auto c = map.cursor(); c.valid(); c.next()) {
+        visit(Key::decode(c.key().data()), c.value());
+    }
+}
+
+template <typename K, typename Policy>
+void TrieIntSet<K, Policy>::insert(const K& key) {
+    char bytes[Key::bytes];
+    Key::encode(key, bytes);
+    set.insert(std::string_view(bytes, Key::bytes));
+}
+
+template <typename K, typename Policy>
+bool TrieIntSet<K, Policy>::exists(const K& key) {
+    char bytes[Key::bytes];
+    Key::encode(key, bytes);
+    return set.exists(bytes, bytes + Key::bytes);
+}
+
+template <typename K, typename Policy>
+void TrieIntSet<K, Policy>::erase(const K& key) {
+    char bytes[Key::bytes];
+    Key::encode(key, bytes);
+    set.erase(std::string_view(bytes, Key::bytes));
+}
+
+template <typename K, typename Policy>
+template <typename Visitor>
+void TrieIntSet<K, Policy>::range(const K& low, const K& high, Visitor visit) {
+    char lowBytes[Key::bytes];
+    char highBytes[Key::bytes];
+    Key::encode(low, lowBytes);
+    Key::encode(high, highBytes);
+    for (auto c = set.lowerBound(lowBytes, lowBytes + Key::bytes);
+         c.valid() && std::memcmp(c.key().data(), highBytes, Key::bytes) <= 0;
+         c.next()) {
+        visit(Key::decode(c.key().data()));
+    }
+}
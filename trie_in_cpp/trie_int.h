@@ -0,0 +1,190 @@
+/**
+    Tries keyed by fixed width integers (uint32_t, int64_t, ...) or a
+    std::tuple of them, built on the byte keyed Trie<char> and
+    TrieMap<char, ...>.
+
+    Each key is written as big endian bytes (TrieIntKey), the sign bit of
+    a signed integer flipped, and a tuple is the bytes of its members one
+    after another. Comparing those bytes as unsigned compares the keys,
+    so a cursor over the trie gives the keys in numeric (and for a tuple
+    lexicographic) order and a range scan is a lowerBound and a walk.
+    The byte trie's adaptive nodes are the radix nodes, a uint64_t key is
+    at most 8 node visits, fewer with TrieLayout::PathCompressed.
+
+    Keys are encoded into a buffer on the stack and passed on as a
+    std::string_view, so a lookup never allocates and an insert only
+    allocates trie nodes.
+
+    The locking and value semantics are those of TrieMap<char, V, Policy>.
+    Range scans hold a cursor so are not supported with
+    TrieOptimisticLocking.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "utilities/trie.h"
+
+/**
+    The big endian byte encoding of an integer key K, bytes long.
+**/
+template <typename K, typename Enable = void>
+struct TrieIntKey;
+
+template <typename K>
+struct TrieIntKey<K, typename std::enable_if<std::is_integral<K>::value &&
+                                             !std::is_same<K, bool>::value>::type> {
+    static constexpr size_t bytes = sizeof(K);
+
+    static void encode(K key, char* out);
+
+    static K decode(const char* in);
+};
+
+template <typename... Ks>
+struct TrieIntKey<std::tuple<Ks...> > {
+    static constexpr size_t bytes = (TrieIntKey<Ks>::bytes + ... + 0);
+
+    static void encode(const std::tuple<Ks...>& key, char* out);
+
+    static std::tuple<Ks...> decode(const char* in);
+
+private:
+
+    template <size_t... I>
+    static void encodeAll(const std::tuple<Ks...>& key, char* out, std::index_sequence<I...>);
+
+    template <size_t... I>
+    static std::tuple<Ks...> decodeAll(const char* in, std::index_sequence<I...>);
+
+    /**
+        The offset of member I in the encoding.
+    **/
+    template <size_t I>
+    static constexpr size_t offsetOf();
+};
+
+/**
+    A TrieMap from integer key K to V.
+**/
+template <typename K, typename V, typename Policy = DefaultTriePolicy>
+class TrieIntMap {
+public:
+
+    typedef TrieIntKey<K> Key;
+    typedef typename TrieMap<char, V, Policy>::iterator iterator;
+
+    TrieIntMap(TrieLayout layout = TrieLayout::PathCompressed)
+      : map(layout) {}
+
+    /**
+        Insert key with value (replacing the value of an existing key)
+    **/
+    void insert(const K& key, V value);
+
+    /**
+        Find key, end() if it is not in the map. Not for
+        TrieOptimisticLocking, see findValue.
+    **/
+    iterator find(const K& key);
+
+    iterator end() {
+        return map.end();
+    }
+
+    /**
+        Find key, copying its value out. Return true if found.
+    **/
+    bool findValue(const K& key, V& value);
+
+    /**
+        findValue for each key (K) of [begin, end), found[i] and values[i]
+        being the answer for the i'th. The walks of a batch are
+        interleaved to overlap their cache misses, see
+        TrieMap<char>::findBatch. Returns how many were found.
+    **/
+    template <typename Itr>
+    size_t findBatch(Itr begin, Itr end, V* values, bool* found);
+
+    /**
+        Erase key from the map.
+    **/
+    void erase(const K& key);
+
+    /**
+        Call visit(K, V&) for every key in [low, high] in key order.
+        The map is locked for the walk, visit must not call back into it.
+    **/
+    template <typename Visitor>
+    void range(const K& low, const K& high, Visitor visit);
+
+    /**
+        Call visit(K, V&) for every key in key order, see range.
+    **/
+    template <typename Visitor>
+    void forEach(Visitor visit);
+
+    size_t size() {
+        return map.stats(false).keys;
+    }
+
+    TrieStats stats() {
+        return map.stats();
+    }
+
+private:
+
+    // keys encoded at once by findBatch
+    static const size_t batchKeys = 64;
+
+    TrieMap<char, V, Policy> map;
+};
+
+/**
+    A Trie of integer keys K.
+**/
+template <typename K, typename Policy = DefaultTriePolicy>
+class TrieIntSet {
+public:
+
+    typedef TrieIntKey<K> Key;
+
+    TrieIntSet(TrieLayout layout = TrieLayout::PathCompressed)
+      : set(layout) {}
+
+    void insert(const K& key);
+
+    bool exists(const K& key);
+
+    void erase(const K& key);
+
+    /**
+        Call visit(K) for every key in [low, high] in key order.
+        The set is locked for the walk, visit must not call back into it.
+    **/
+    template <typename Visitor>
+    void range(const K& low, const K& high, Visitor visit);
+
+    size_t size() {
+        return set.stats(false).keys;
+    }
+
+    TrieStats stats() {
+        return set.stats();
+    }
+
+private:
+
+    Trie<char, Policy> set;
+};
+
+#include "utilities/trie_int.cc"
@@ -0,0 +1,136 @@
+#include <algorithm>
+
+inline void TrieBitVector::freeze() {
+    blockRanks.clear();
+    zeroSamples.clear();
+    uint32_t ones = 0;
+    uint32_t zeros = 0;
+    for (size_t w = 0; w < words.size(); w++) {
+        if (w % wordsPerBlock == 0) {
+            blockRanks.push_back(ones);
+        }
+        const size_t valid = std::min<size_t>(64, bits - w * 64);
+        for (size_t b = 0; b < valid; b++) {
+            if ((words[w] >> b) & 1) {
+                ones++;
+            } else {
+                if (zeros % zerosPerSample == 0) {
+                    zeroSamples.push_back(static_cast<uint32_t>(w * 64 + b));
+                }
+                zeros++;
+            }
+        }
+    }
+    words.shrink_to_fit();
+    blockRanks.shrink_to_fit();
+    zeroSamples.shrink_to_fit();
+}
+
+inline size_t TrieBitVector::rank1(size_t pos) const {
+    const size_t word = pos / 64;
+    size_t rank = blockRanks[word / wordsPerBlock];
+    for (size_t w = word - word % wordsPerBlock; w < word; w++) {
+        rank += __builtin_popcountll(words[w]);
+    }
+    if (pos % 64) {
+        rank += __builtin_popcountll(words[word] & ((uint64_t(1) << (pos % 64)) - 1));
+    }
+    return rank;
+}
+
+inline size_t TrieBitVector::select0(size_t i) const {
+    // Start from the word holding the nearest sampled zero at or before i
+    size_t word = zeroSamples[i / zerosPerSample] / 64;
+    size_t remaining = i - rank0(word * 64);
+    for (;; word++) {
+        uint64_t zeros = ~words[word];
+        size_t count = __builtin_popcountll(zeros);
+        if (remaining < count) {
+            for (; remaining; remaining--) {
+                zeros &= zeros - 1;
+            }
+            return word * 64 + __builtin_ctzll(zeros);
+        }
+        remaining -= count;
+    }
+}
+
+inline size_t TrieBitVector::runOfOnes(size_t pos) const {
+    size_t run = 0;
+    for (;;) {
+        // shifting in zeros from the top gives ~w a set bit, unless pos
+        // is on a word boundary and the word is all ones
+        uint64_t w = words[pos / 64] >> (pos % 64);
+        const uint64_t zeros = ~w;
+        size_t ones = zeros ? __builtin_ctzll(zeros) : 64;
+        run += ones;
+        if (ones < 64 - pos % 64 || (pos + ones) / 64 >= words.size()) {
+            return run;
+        }
+        pos += ones;
+    }
+}
+
+inline void FrozenTrie::appendNode(bool terminates, const uint8_t* childLabels, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        louds.push_back(true);
+        labels.push_back(childLabels[i]);
+    }
+    louds.push_back(false);
+    terminals.push_back(terminates);
+}
+
+inline void FrozenTrie::finish() {
+    louds.freeze();
+    terminals.freeze();
+    labels.shrink_to_fit();
+}
+
+inline size_t FrozenTrie::findChild(size_t node, uint8_t byte) const {
+    // The children of node are the 1s after its predecessor's 0. There are
+    // node zeros and so (start - node) ones before them, the first child
+    // is numbered one more than that (the root is not a 1).
+    const size_t start = node ? louds.select0(node - 1) + 1 : 0;
+    const size_t degree = louds.runOfOnes(start);
+    if (!degree) {
+        return 0;
+    }
+    const size_t first = start - node + 1;
+    const uint8_t* begin = labels.data() + first - 1;
+    const uint8_t* end = begin + degree;
+    const uint8_t* match;
+    if (degree <= 8) {
+        match = std::find(begin, end, byte);
+    } else {
+        match = std::lower_bound(begin, end, byte);
+    }
+    if (match == end || *match != byte) {
+        return 0;
+    }
+    return first + (match - begin);
+}
+
+inline bool FrozenTrie::findNode(const char* begin, const char* end, size_t& node) const {
+    node = 0;
+    for (const char* element = begin; element != end; element++) {
+        node = findChild(node, static_cast<uint8_t>(*element));
+        if (!node) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool FrozenTrie::findPrefixNode(const char* begin, const char* end, size_t& node) const {
+    node = 0;
+    for (const char* element = begin; element != end; element++) {
+        node = findChild(node, static_cast<uint8_t>(*element));
+        if (!node) {
+            return false;
+        }
+        if (isTerminal(node)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,265 @@
+/**
+    Frozen, read only tries in a succinct (LOUDS) layout.
+
+    Trie<char>::freeze() and TrieMap<char, V>::freeze() copy a trie into
+    a FrozenTrie/FrozenTrieMap. Nothing in a frozen trie is a pointer, the
+    tree is stored as
+
+      - louds: the level order unary degree sequence. Nodes are numbered
+        in level (breadth first) order, each node writes a 1 for each
+        child followed by a 0. The root is node 0.
+      - labels: one byte per node (except the root), the key byte on the
+        edge into the node. The children of a node have consecutive
+        numbers so their labels are adjacent and sorted.
+      - terminals: one bit per node, set if the node ends a key.
+
+    That is 2 + 8 + 1 bits per node plus rank/select indexes. A path
+    compressed segment is stored as a chain of nodes, at ~11 bits each
+    that is still smaller than the segment's bytes plus the node holding
+    them.
+
+    A FrozenTrieMap keeps its values in one array, the value of a key is
+    at the rank of its node among the terminal nodes.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+    A bit vector with rank and select support, built once by appending.
+
+    rank1 uses a count of the set bits before each 512 bit block.
+    select0 samples the position of every 64th zero and scans on from
+    the sample with popcounts.
+**/
+class TrieBitVector {
+public:
+
+    TrieBitVector()
+      : bits(0) {}
+
+    void push_back(bool bit) {
+        if (bits % 64 == 0) {
+            words.push_back(0);
+        }
+        if (bit) {
+            words.back() |= uint64_t(1) << (bits % 64);
+        }
+        bits++;
+    }
+
+    /**
+        Build the rank/select indexes, no push_back after this.
+    **/
+    void freeze();
+
+    bool get(size_t pos) const {
+        return (words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    size_t size() const {
+        return bits;
+    }
+
+    /**
+        Number of set bits in [0, pos)
+    **/
+    size_t rank1(size_t pos) const;
+
+    size_t rank0(size_t pos) const {
+        return pos - rank1(pos);
+    }
+
+    /**
+        Position of the i'th (from 0) zero bit.
+    **/
+    size_t select0(size_t i) const;
+
+    /**
+        Number of consecutive set bits starting at pos.
+    **/
+    size_t runOfOnes(size_t pos) const;
+
+    /**
+        Bytes used by the bits and indexes.
+    **/
+    size_t getMemoryBytes() const {
+        return words.size() * sizeof(uint64_t) +
+               blockRanks.size() * sizeof(uint32_t) +
+               zeroSamples.size() * sizeof(uint32_t);
+    }
+
+private:
+
+    static const size_t wordsPerBlock = 8;
+    static const size_t zerosPerSample = 64;
+
+    std::vector<uint64_t> words;
+    std::vector<uint32_t> blockRanks;
+    std::vector<uint32_t> zeroSamples;
+    size_t bits;
+};
+
+/**
+    A frozen Trie<char>, see the top of this file.
+**/
+class FrozenTrie {
+public:
+
+    /**
+        An empty frozen trie.
+    **/
+    FrozenTrie() {
+        appendNode(false, nullptr, 0);
+        finish();
+    }
+
+    /**
+        Does a key exist?
+        Pass the start and end of a key to search for.
+    **/
+    bool exists(const char* begin, const char* end) const {
+        size_t node = 0;
+        return findNode(begin, end, node) && isTerminal(node);
+    }
+
+    /**
+     * Is key prefixed with a key in the Trie? (See Trie::prefixExists)
+     */
+    bool prefixExists(const char* begin, const char* end) const {
+        size_t node = 0;
+        return findPrefixNode(begin, end, node);
+    }
+
+    /**
+        Number of nodes, a path compressed segment counts a node per byte.
+    **/
+    size_t getNodeCount() const {
+        return labels.size() + 1;
+    }
+
+    /**
+        Bytes used by the frozen structure (excluding any values).
+    **/
+    size_t getMemoryBytes() const {
+        return louds.getMemoryBytes() + terminals.getMemoryBytes() + labels.size();
+    }
+
+    /**
+        Used by freeze to build a frozen trie. clear, then append the nodes
+        in level order (root first) with the sorted labels of each node's
+        children, then finish.
+    **/
+    void clear() {
+        louds = TrieBitVector();
+        terminals = TrieBitVector();
+        labels.clear();
+    }
+
+    void appendNode(bool terminates, const uint8_t* childLabels, size_t count);
+
+    /**
+        Called once every node has been appended.
+    **/
+    void finish();
+
+protected:
+
+    /**
+        Walk from the root, node is the last node reached.
+        Returns true if all of the key was matched.
+    **/
+    bool findNode(const char* begin, const char* end, size_t& node) const;
+
+    /**
+        Find the first terminal node on the path of key (not the root),
+        returns true and sets node if there is one.
+    **/
+    bool findPrefixNode(const char* begin, const char* end, size_t& node) const;
+
+    /**
+        The child of node labelled byte, or 0 if none (0 is the root so is
+        never anyone's child).
+    **/
+    size_t findChild(size_t node, uint8_t byte) const;
+
+    bool isTerminal(size_t node) const {
+        return terminals.get(node);
+    }
+
+    /**
+        Position of a terminal node's value.
+    **/
+    size_t valueIndex(size_t node) const {
+        return terminals.rank1(node);
+    }
+
+private:
+
+    TrieBitVector louds;
+    TrieBitVector terminals;
+
+    // label of node n is labels[n - 1], the root has none
+    std::vector<uint8_t> labels;
+};
+
+/**
+    A frozen TrieMap<char, V>, see the top of this file.
+**/
+template <typename V>
+class FrozenTrieMap : public FrozenTrie {
+public:
+
+    /**
+        Find key, returns a pointer to its value or nullptr.
+    **/
+    const V* find(const char* begin, const char* end) const {
+        size_t node = 0;
+        if (!findNode(begin, end, node) || !isTerminal(node)) {
+            return nullptr;
+        }
+        return &values[valueIndex(node)];
+    }
+
+    /**
+        Find the first key which prefixes key, see TrieMap::prefixFind.
+    **/
+    const V* prefixFind(const char* begin, const char* end) const {
+        size_t node = 0;
+        if (!findPrefixNode(begin, end, node)) {
+            return nullptr;
+        }
+        return &values[valueIndex(node)];
+    }
+
+    void clear() {
+        FrozenTrie::clear();
+        values.clear();
+    }
+
+    /**
+        As FrozenTrie::appendNode, with the value of a terminating node.
+    **/
+    void appendNode(const V* value, const uint8_t* childLabels, size_t count) {
+        FrozenTrie::appendNode(value != nullptr, childLabels, count);
+        if (value) {
+            values.push_back(*value);
+        }
+    }
+
+    size_t getValueCount() const {
+        return values.size();
+    }
+
+private:
+
+    std::vector<V> values;
+};
+
+#include "utilities/trie_louds.cc"
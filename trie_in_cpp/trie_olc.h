@@ -0,0 +1,380 @@
+/**
+    Optimistic lock coupling support for the Trie.
+
+    A TrieImpl whose policy selects TrieOptimisticLocking does not take
+    the coarse mutex. Instead every node carries a TrieVersionLock:
+
+      - readers remember a node's version, read the node and then check
+        the version is unchanged, restarting the operation if not.
+      - writers upgrade the version they read to a write lock, only on the
+        nodes they modify.
+
+    Readers may be looking at memory a writer has just unlinked, so any
+    memory freed by the trie is handed to a TrieEpochManager and only
+    really freed once every thread which could have seen it has left its
+    epoch (epoch based reclamation).
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+    Version lock embedded in each node.
+
+    bit 0      - obsolete, the node has been unlinked from the trie
+    bit 1      - write locked
+    bits 2..31 - version, bumped by each write
+**/
+class TrieVersionLock {
+public:
+
+    TrieVersionLock()
+      : version(0) {}
+
+    /**
+        Read the version for an optimistic read.
+        Returns false (restart) if the node is locked or obsolete.
+    **/
+    bool readLock(uint32_t& v) const {
+        v = version.load(std::memory_order_acquire);
+        return (v & (lockedBit | obsoleteBit)) == 0;
+    }
+
+    /**
+        Check nothing has changed since readLock returned v.
+    **/
+    bool validate(uint32_t v) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version.load(std::memory_order_relaxed) == v;
+    }
+
+    /**
+        Take the write lock if the version is still v.
+    **/
+    bool upgrade(uint32_t v) {
+        return version.compare_exchange_strong(v, v + lockedBit,
+                                               std::memory_order_acquire);
+    }
+
+    void unlock() {
+        version.fetch_add(lockedBit, std::memory_order_release);
+    }
+
+    /**
+        Unlock a node which is no longer reachable.
+    **/
+    void unlockObsolete() {
+        version.fetch_add(lockedBit | obsoleteBit, std::memory_order_release);
+    }
+
+private:
+    static const uint32_t obsoleteBit = 1;
+    static const uint32_t lockedBit = 2;
+
+    std::atomic<uint32_t> version;
+};
+
+/**
+    Access to a node field which an optimistic reader may read whilst a
+    writer stores to it. The field stays a plain member, the accesses are
+    atomic so the race is defined (and visible to TSan); the version lock
+    decides whether what was read is used.
+
+    Relaxed for values. A pointer to memory filled in before it is linked
+    (a child layout block, a segment) is stored with release and loaded
+    with acquire, so a reader which sees the pointer sees the contents.
+
+    A trivially copyable field wider than a word (a TrieMap value) is
+    copied a word at a time, each word atomic. A reader may see a mix of
+    two stores, the version lock rejects it. Anything else is never read
+    optimistically (TrieMap requires a trivially copyable V for it) and
+    is accessed plainly.
+**/
+template <typename T>
+struct TrieAtomicWords {
+    static const bool scalar = std::is_integral<T>::value || std::is_pointer<T>::value;
+    static const bool copied = !scalar && std::is_trivially_copyable<T>::value;
+
+    // The widest word the field's alignment allows, sizeof(T) is a multiple
+    typedef typename std::conditional<alignof(T) % 8 == 0, uint64_t,
+            typename std::conditional<alignof(T) % 4 == 0, uint32_t,
+            typename std::conditional<alignof(T) % 2 == 0, uint16_t,
+                                      uint8_t>::type>::type>::type Word;
+    typedef Word __attribute__((may_alias)) AliasWord;
+
+    static const size_t count = sizeof(T) / sizeof(Word);
+};
+
+template <typename T>
+inline T trieLoadRelaxed(const T& field) {
+    typedef TrieAtomicWords<T> Words;
+    if constexpr (Words::scalar) {
+        return __atomic_load_n(&field, __ATOMIC_RELAXED);
+    } else if constexpr (Words::copied) {
+        typename Words::Word words[Words::count];
+        auto* src = reinterpret_cast<const typename Words::AliasWord*>(&field);
+        for (size_t i = 0; i < Words::count; i++) {
+            words[i] = __atomic_load_n(src + i, __ATOMIC_RELAXED);
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    } else {
+        return field;
+    }
+}
+
+template <typename T>
+inline void trieStoreRelaxed(T& field, T value) {
+    typedef TrieAtomicWords<T> Words;
+    if constexpr (Words::scalar) {
+        __atomic_store_n(&field, value, __ATOMIC_RELAXED);
+    } else if constexpr (Words::copied) {
+        typename Words::Word words[Words::count];
+        std::memcpy(words, &value, sizeof(T));
+        auto* dst = reinterpret_cast<typename Words::AliasWord*>(&field);
+        for (size_t i = 0; i < Words::count; i++) {
+            __atomic_store_n(dst + i, words[i], __ATOMIC_RELAXED);
+        }
+    } else {
+        field = std::move(value);
+    }
+}
+
+template <typename T>
+inline T trieLoadAcquire(const T& field) {
+    return __atomic_load_n(&field, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+inline void trieStoreRelease(T& field, T value) {
+    __atomic_store_n(&field, value, __ATOMIC_RELEASE);
+}
+
+/**
+    A small dense index for the calling thread, released for reuse when
+    the thread exits. Used to give each thread its own slot in per-trie
+    arrays without any registration.
+**/
+class TrieThreadIndex {
+public:
+
+    static const size_t maxThreads = 256;
+
+    static size_t get() {
+        thread_local Holder holder;
+        return holder.index;
+    }
+
+private:
+
+    struct Registry {
+        std::mutex lock;
+        std::vector<bool> used = std::vector<bool>(maxThreads, false);
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    struct Holder {
+        Holder() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lg(r.lock);
+            for (index = 0; index < maxThreads && r.used[index]; index++) {
+            }
+            if (index == maxThreads) {
+                throw std::length_error("TrieThreadIndex: too many threads");
+            }
+            r.used[index] = true;
+        }
+
+        ~Holder() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lg(r.lock);
+            r.used[index] = false;
+        }
+
+        size_t index;
+    };
+};
+
+/**
+    Epoch based reclamation.
+
+    Threads enter() before touching the trie and exit() after. Memory is
+    retire()d with the epoch it was unlinked in, and freed once every
+    thread inside an epoch entered after that one.
+**/
+template <typename Allocator>
+class TrieEpochManager {
+public:
+
+    TrieEpochManager(Allocator& allocator)
+      : allocator(allocator),
+        globalEpoch(1) {}
+
+    TrieEpochManager(const TrieEpochManager&) = delete;
+    TrieEpochManager& operator=(const TrieEpochManager&) = delete;
+
+    /**
+        Free everything, no thread may be using the trie.
+    **/
+    ~TrieEpochManager() {
+        for (auto& slot : slots) {
+            for (auto& r : slot.retired) {
+                allocator.deallocate(r.p, r.bytes);
+            }
+        }
+    }
+
+    void enter() {
+        Slot& slot = slots[TrieThreadIndex::get()];
+        slot.epoch.store(globalEpoch.load(std::memory_order_acquire),
+                         std::memory_order_relaxed);
+        // The fence pairs with the one in reclaim: either reclaim sees this
+        // slot's epoch or this thread's trie loads see memory unlinked
+        // before reclaim. A seq_cst store alone lets later loads pass it.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit() {
+        slots[TrieThreadIndex::get()].epoch.store(0, std::memory_order_release);
+    }
+
+    void retire(void* p, size_t bytes) {
+        Slot& slot = slots[TrieThreadIndex::get()];
+        slot.retired.push_back({p, bytes, globalEpoch.load()});
+        if (slot.retired.size() >= reclaimThreshold) {
+            reclaim(slot);
+        }
+    }
+
+    /**
+        RAII enter/exit.
+    **/
+    class Guard {
+    public:
+        Guard(TrieEpochManager& epochs)
+          : epochs(epochs) {
+            epochs.enter();
+        }
+
+        ~Guard() {
+            epochs.exit();
+        }
+
+    private:
+        TrieEpochManager& epochs;
+    };
+
+private:
+
+    static const size_t reclaimThreshold = 128;
+
+    struct Retired {
+        void* p;
+        size_t bytes;
+        uint64_t epoch;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0};
+        std::vector<Retired> retired;
+    };
+
+    void reclaim(Slot& slot) {
+        globalEpoch.fetch_add(1);
+        // pairs with the fence in enter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // the oldest epoch any thread is still inside
+        uint64_t oldest = globalEpoch.load();
+        for (auto& s : slots) {
+            uint64_t e = s.epoch.load();
+            if (e && e < oldest) {
+                oldest = e;
+            }
+        }
+
+        size_t kept = 0;
+        for (auto& r : slot.retired) {
+            if (r.epoch < oldest) {
+                allocator.deallocate(r.p, r.bytes);
+            } else {
+                slot.retired[kept++] = r;
+            }
+        }
+        slot.retired.resize(kept);
+    }
+
+    Allocator& allocator;
+    std::atomic<uint64_t> globalEpoch;
+    Slot slots[TrieThreadIndex::maxThreads];
+};
+
+/**
+    Allocator wrapper used by an optimistic TrieImpl. Frees are deferred
+    through the epoch manager, everything else goes to the underlying
+    allocator (which must be thread safe).
+**/
+template <typename Allocator>
+class TrieEpochAllocator {
+public:
+
+    typedef TrieEpochManager<Allocator> Epochs;
+
+    static const bool releasesAll = false;
+    static const bool threadSafe = true;
+
+    TrieEpochAllocator()
+      : epochs(underlying) {}
+
+    void* allocate(size_t bytes) {
+        return underlying.allocate(bytes);
+    }
+
+    void deallocate(void* p, size_t bytes) {
+        epochs.retire(p, bytes);
+    }
+
+    TrieEpochManager<Allocator>& getEpochs() {
+        return epochs;
+    }
+
+    /**
+        The wrapped allocator, for freeing when no thread can be reading.
+    **/
+    Allocator& getUnderlying() {
+        return underlying;
+    }
+
+private:
+    Allocator underlying;
+    TrieEpochManager<Allocator> epochs;
+};
+
+/**
+    Policy Locking option: per node version locks and lock free readers.
+    Only supported by the char nodes (Trie<char>, TrieMap<char, V>) with
+    a thread safe allocator, a TrieMap value must be trivially copyable
+    and is read with TrieMap::findValue.
+**/
+struct TrieOptimisticLocking {
+    static const bool optimistic = true;
+    static const size_t shards = 1;
+    typedef std::mutex Mutex;
+};
@@ -1,12 +1,24 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <random>
+#include <set>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include "utilities/trie.h"
+#include "utilities/trie_cidr.h"
+#include "utilities/trie_histogram.h"
 #include "platform/platform.h"
 
-template<typename T>
 struct Stats {
     std::string name;
     double mean;
@@ -15,39 +27,30 @@ struct Stats {
     double pct5;
     double pct95;
     double pct99;
-    std::vector<T>* values;
+    const TrieHistogram* values;
 };
 
-// Given a vector of values (each a vector<T>) calcuate metrics on them
-// and print to stdout.
-template<typename T>
-void print_values(std::vector<std::pair<std::string, std::vector<T>*> > values,
+// Given a set of histograms calcuate metrics on them and print to stdout.
+void print_values(std::vector<std::pair<std::string, TrieHistogram*> > values,
                   std::string unit)
 {
     // First, calculate mean, median, standard deviation and percentiles of
     // each set of values, both for printing and to derive what the range of
     // the graphs should be.
-    std::vector<Stats<T>> value_stats;
+    std::vector<Stats> value_stats;
     for (const auto& t : values) {
-        Stats<T> stats;
+        Stats stats;
         stats.name = t.first;
         stats.values = t.second;
-        std::vector<T>& vec = *t.second;
+        const TrieHistogram& histogram = *t.second;
 
         // Calculate latency percentiles
-        std::sort(vec.begin(), vec.end());
-        stats.median = vec[(vec.size() * 50) / 100];
-        stats.pct5 = vec[(vec.size() * 5) / 100];
-        stats.pct95 = vec[(vec.size() * 95) / 100];
-        stats.pct99 = vec[(vec.size() * 99) / 100];
-
-        const double sum = std::accumulate(vec.begin(), vec.end(), 0.0);
-        stats.mean = sum / vec.size();
-        double accum = 0.0;
-        std::for_each (vec.begin(), vec.end(), [&](const double d) {
-            accum += (d - stats.mean) * (d - stats.mean);
-        });
-        stats.stddev = sqrt(accum / (vec.size() - 1));
+        stats.median = histogram.percentile(50);
+        stats.pct5 = histogram.percentile(5);
+        stats.pct95 = histogram.percentile(95);
+        stats.pct99 = histogram.percentile(99);
+        stats.mean = histogram.mean();
+        stats.stddev = histogram.stddev();
 
         value_stats.push_back(stats);
     }
@@ -55,8 +58,8 @@ void print_values(std::vector<std::pair<std::string, std::vector<T>*> > values,
     // From these find the start and end for the spark graphs which covers the
     // a "reasonable sample" of each value set. We define that as from the 5th
     // to the 95th percentile, so we ensure *all* sets have that range covered.
-    T spark_start = std::numeric_limits<T>::max();
-    T spark_end = 0;
+    double spark_start = std::numeric_limits<double>::max();
+    double spark_end = 0;
     for (const auto& stats : value_stats) {
         spark_start = (stats.pct5 < spark_start) ? stats.pct5 : spark_start;
         spark_end = (stats.pct95 > spark_end) ? stats.pct95 : spark_end;
@@ -78,16 +81,13 @@ void print_values(std::vector<std::pair<std::string, std::vector<T>*> > values,
 
         // Calculate and render Sparkline (requires UTF-8 terminal).
         const int nbins = 32;
-        int prev_distance = 0;
+        uint64_t prev_below = 0;
         std::vector<size_t> histogram;
         for (unsigned int bin = 0; bin < nbins; bin++) {
-            const T max_for_bin = (spark_end / nbins) * bin;
-            auto it = std::lower_bound(stats.values->begin(),
-                                       stats.values->end(),
-                                       max_for_bin);
-            const int distance = std::distance(stats.values->begin(), it);
-            histogram.push_back(distance - prev_distance);
-            prev_distance = distance;
+            const uint64_t max_for_bin = uint64_t(spark_end / nbins) * bin;
+            const uint64_t below = stats.values->countBelow(max_for_bin);
+            histogram.push_back(below - prev_below);
+            prev_below = below;
         }
 
         const auto minmax = std::minmax_element(histogram.begin(), histogram.end());
@@ -105,14 +105,27 @@ void print_values(std::vector<std::pair<std::string, std::vector<T>*> > values,
            int(spark_start/1e3), unit.c_str(), int(spark_end/1e3));
 }
 
-static void perf_char() {
+static std::vector<std::string> load_dict() {
     std::ifstream dictFile("/usr/share/dict/words");
     std::string line;
-    std::vector<hrtime_t> insert, exists, erase;
+    std::vector<std::string> dict;
     // get dictionary in memory for random insert
-    while(std::getline(dictFile, line) && i<65536) {
+    while(std::getline(dictFile, line) && dict.size() < 65536) {
         dict.push_back(line);
     }
+    if (dict.empty()) {
+        std::cerr << "No words in /usr/share/dict/words" << std::endl;
+    }
+    return dict;
+}
+
+static void perf_char() {
+    std::vector<std::string> dict = load_dict();
+    TrieHistogram insert, exists, erase;
+    Trie<char> trie;
+    if (dict.empty()) {
+        return;
+    }
 
     {
         std::mt19937 gen(0); // fixed seed
@@ -122,7 +135,7 @@ static void perf_char() {
         for (auto s: dict) {
             hrtime_t start = gethrtime();
             trie.insert(s);
-            insert.push_back(gethrtime() - start);
+            insert.record(gethrtime() - start);
         }
     }
 
@@ -133,9 +146,9 @@ static void perf_char() {
             hrtime_t start = gethrtime();
             if (!trie.exists(s.c_str(), s.c_str() + s.length())) {
                 std::cerr << "Failed to find value " << s << std::endl;
-                return 0;
+                return;
             }
-            exists.push_back(gethrtime() - start);
+            exists.record(gethrtime() - start);
         }
     }
 
@@ -145,34 +158,695 @@ static void perf_char() {
         for (auto s: dict) {
             hrtime_t start = gethrtime();
             trie.erase(s);
-            erase.push_back(gethrtime() - start);
+            erase.record(gethrtime() - start);
         }
     }
 
-    std::vector<std::pair<std::string, std::vector<hrtime_t>*> > all_timings;
+    std::vector<std::pair<std::string, TrieHistogram*> > all_timings;
     all_timings.push_back(std::make_pair("insert", &insert));
     all_timings.push_back(std::make_pair("exists", &exists));
     all_timings.push_back(std::make_pair("erase", &erase));
     print_values(all_timings, "µs");
 }
 
+// Integer keys with a mid-sized fanout at each level, which is where the
+// packed child search matters.
 static void perf_int() {
-    {
-        std::mt19937 gen(0); // fixed seed
-        std::shuffle(dict.begin(), dict.end(), gen); // move it around
+    std::vector<std::vector<int> > keys;
+    TrieHistogram insert, exists;
+    Trie<int> trie;
+
+    std::mt19937 gen(0); // fixed seed
+    std::uniform_int_distribution<int> element(0, 11);
+    for (int i = 0; i < 65536; i++) {
+        std::vector<int> key(8);
+        for (auto& e : key) {
+            e = element(gen) * 1000;
+        }
+        keys.push_back(key);
+    }
 
+    {
         // time insert
-        for (auto s: dict) {
+        for (auto& k: keys) {
             hrtime_t start = gethrtime();
-            trie.insert(s);
-            insert.push_back(gethrtime() - start);
+            trie.insert(k);
+            insert.record(gethrtime() - start);
+        }
+    }
+
+    {
+        std::mt19937 gen(2); // fixed seed
+        std::shuffle(keys.begin(), keys.end(), gen); // move it around
+        for (auto& k: keys) {
+            hrtime_t start = gethrtime();
+            if (!trie.exists(k.begin(), k.end())) {
+                std::cerr << "Failed to find int key" << std::endl;
+                return;
+            }
+            exists.record(gethrtime() - start);
         }
     }
+
+    std::vector<std::pair<std::string, TrieHistogram*> > all_timings;
+    all_timings.push_back(std::make_pair("int insert", &insert));
+    all_timings.push_back(std::make_pair("int exists", &exists));
+    print_values(all_timings, "µs");
+}
+
+// What each layout costs in memory, from TrieImpl::stats
+template <typename T>
+static void print_stats(const char* name, T& trie) {
+    hrtime_t start = gethrtime();
+    TrieStats stats = trie.stats();
+    hrtime_t exactTime = gethrtime() - start;
+    start = gethrtime();
+    trie.stats(false);
+    hrtime_t countedTime = gethrtime() - start;
+
+    size_t depths = 0;
+    for (size_t d = 0; d < stats.keyDepths.size(); d++) {
+        depths += d * stats.keyDepths[d];
+    }
+    printf("  %-22s %8zu %10zu %10zu %10zu %10zu %9.02f %9.02f\n",
+           name, stats.nodes, stats.nodeBytes, stats.childBytes,
+           stats.segmentBytes, stats.valueBytes, stats.bytesPerKey(),
+           stats.keys ? double(depths) / stats.keys : 0.0);
+    printf("  %-22s fanout", "");
+    for (size_t i = 0; i < TrieStats::fanoutClasses; i++) {
+        printf(" %s:%zu", TrieStats::fanoutName(i), stats.fanout[i]);
+    }
+    printf(", stats() %.02f ms, stats(false) %.03f us\n",
+           exactTime / 1000000.0, countedTime / 1000.0);
+}
+
+static void perf_memory() {
+    std::vector<std::string> dict = load_dict();
+    if (dict.empty()) {
+        return;
+    }
+    Trie<char> expanded(TrieLayout::Expanded);
+    Trie<char> compressed(TrieLayout::PathCompressed);
+    TrieMap<char, uint64_t> map(TrieLayout::PathCompressed);
+    Trie<int> generic(TrieLayout::PathCompressed);
+    for (auto& s : dict) {
+        expanded.insert(s);
+        compressed.insert(s);
+        map.insert(s, s.size());
+        generic.insert(std::vector<int>(s.begin(), s.end()));
+    }
+
+    printf("\nmemory: %zu keys, average length %.02f\n",
+           dict.size(), expanded.stats(false).averageKeyLength());
+    printf("  %-22s %8s %10s %10s %10s %10s %9s %9s\n", "layout", "nodes", "node B",
+           "child B", "segment B", "value B", "B/key", "depth");
+    print_stats("Trie<char> expanded", expanded);
+    print_stats("Trie<char> compressed", compressed);
+    print_stats("TrieMap<char, u64>", map);
+    print_stats("Trie<int> compressed", generic);
 }
 
-int main() {
+// Time to load the dictionary with an insert per key against one bulk
+// build, from sorted and from shuffled keys.
+static void perf_bulk() {
+    std::vector<std::string> dict = load_dict();
+    if (dict.empty()) {
+        return;
+    }
+    std::vector<std::string> sorted = dict;
+    std::sort(sorted.begin(), sorted.end());
+    std::mt19937 gen(3); // fixed seed
+    std::shuffle(dict.begin(), dict.end(), gen);
+
+    // best of a few runs, the first run also pays for faulting in memory
+    auto best = [](auto load) {
+        hrtime_t fastest = std::numeric_limits<hrtime_t>::max();
+        for (int run = 0; run < 5; run++) {
+            hrtime_t start = gethrtime();
+            load();
+            fastest = std::min(fastest, gethrtime() - start);
+        }
+        return fastest;
+    };
+
+    printf("\nload %zu keys (ms)      insert loop   bulk sorted   bulk shuffled\n",
+           dict.size());
+    for (TrieLayout layout : {TrieLayout::Expanded, TrieLayout::PathCompressed}) {
+        // each trie is destroyed outside of the timed part
+        std::vector<std::unique_ptr<Trie<char> > > tries;
+        hrtime_t loop = best([&]() {
+            tries.emplace_back(new Trie<char>(layout));
+            for (const auto& s : sorted) {
+                tries.back()->insert(s);
+            }
+        });
+        tries.clear();
+        hrtime_t bulkSorted = best([&]() {
+            tries.emplace_back(new Trie<char>(layout));
+            tries.back()->bulkInsert(sorted.begin(), sorted.end());
+        });
+        tries.clear();
+        hrtime_t bulkShuffled = best([&]() {
+            tries.emplace_back(new Trie<char>(layout));
+            tries.back()->bulkInsert(dict.begin(), dict.end());
+        });
+        printf("%-22s %13.02f %13.02f %15.02f\n",
+               layout == TrieLayout::Expanded ? "expanded" : "path compressed",
+               loop / 1e6, bulkSorted / 1e6, bulkShuffled / 1e6);
+    }
+}
+
+// exists() latency of the pointer trie against the frozen (LOUDS) copy
+static void perf_frozen() {
+    std::vector<std::string> dict = load_dict();
+    TrieHistogram exists, frozenExists;
+    if (dict.empty()) {
+        return;
+    }
+    Trie<char> trie(TrieLayout::PathCompressed);
+    trie.bulkInsert(dict.begin(), dict.end());
+    FrozenTrie frozen = trie.freeze();
+
+    std::mt19937 gen(4); // fixed seed
+    std::shuffle(dict.begin(), dict.end(), gen);
+    for (auto& s : dict) {
+        hrtime_t start = gethrtime();
+        if (!trie.exists(s.c_str(), s.c_str() + s.length())) {
+            std::cerr << "Failed to find value " << s << std::endl;
+            return;
+        }
+        exists.record(gethrtime() - start);
+
+        start = gethrtime();
+        if (!frozen.exists(s.c_str(), s.c_str() + s.length())) {
+            std::cerr << "Failed to find frozen value " << s << std::endl;
+            return;
+        }
+        frozenExists.record(gethrtime() - start);
+    }
+
+    printf("\nfrozen: %zu keys, %zu nodes, %zu bytes (%.02f bits per node)\n",
+           dict.size(), frozen.getNodeCount(), frozen.getMemoryBytes(),
+           frozen.getMemoryBytes() * 8.0 / frozen.getNodeCount());
+    std::vector<std::pair<std::string, TrieHistogram*> > all_timings;
+    all_timings.push_back(std::make_pair("exists", &exists));
+    all_timings.push_back(std::make_pair("frozen exists", &frozenExists));
+    print_values(all_timings, "µs");
+}
+
+static void perf_darray() {
+    std::vector<std::string> dict = load_dict();
+    TrieHistogram exists, darrayExists;
+    if (dict.empty()) {
+        return;
+    }
+    Trie<char> trie(TrieLayout::PathCompressed);
+    trie.bulkInsert(dict.begin(), dict.end());
+    hrtime_t start = gethrtime();
+    DoubleArrayTrie darray = trie.buildDoubleArray();
+    hrtime_t buildTime = gethrtime() - start;
+
+    std::mt19937 gen(5); // fixed seed
+    std::shuffle(dict.begin(), dict.end(), gen);
+    for (auto& s : dict) {
+        start = gethrtime();
+        if (!trie.exists(s.c_str(), s.c_str() + s.length())) {
+            std::cerr << "Failed to find value " << s << std::endl;
+            return;
+        }
+        exists.record(gethrtime() - start);
+
+        start = gethrtime();
+        if (!darray.exists(s.c_str(), s.c_str() + s.length())) {
+            std::cerr << "Failed to find double-array value " << s << std::endl;
+            return;
+        }
+        darrayExists.record(gethrtime() - start);
+    }
+
+    printf("\ndouble-array: %zu keys, %zu slots, %zu bytes, built in %.02f ms\n",
+           dict.size(), darray.getStateCount(), darray.getMemoryBytes(),
+           buildTime / 1000000.0);
+    std::vector<std::pair<std::string, TrieHistogram*> > all_timings;
+    all_timings.push_back(std::make_pair("exists", &exists));
+    all_timings.push_back(std::make_pair("darray exists", &darrayExists));
+    print_values(all_timings, "µs");
+}
+
+// Startup: rebuild the trie from the word list (getline + insert) versus
+// opening a saved file and answering the first query.
+static void perf_mmap() {
+    const std::string path = "/tmp/trie_perf.trie";
+    std::vector<hrtime_t> rebuild, open;
+    std::string probe;
+    for (int run = 0; run < 5; run++) {
+        hrtime_t start = gethrtime();
+        std::ifstream dictFile("/usr/share/dict/words");
+        std::string line;
+        Trie<char> trie;
+        size_t count = 0;
+        while (std::getline(dictFile, line) && count++ < 65536) {
+            trie.insert(line);
+            probe = line;
+        }
+        rebuild.push_back(gethrtime() - start);
+        if (count == 0) {
+            return;
+        }
+        if (run == 0) {
+            trie.save(path);
+        }
+    }
+
+    for (int run = 0; run < 5; run++) {
+        hrtime_t start = gethrtime();
+        DoubleArrayTrie mapped = DoubleArrayTrie::open(path);
+        if (!mapped.exists(probe.c_str(), probe.c_str() + probe.length())) {
+            std::cerr << "Failed to find mapped value " << probe << std::endl;
+            return;
+        }
+        open.push_back(gethrtime() - start);
+    }
+    std::remove(path.c_str());
+
+    std::sort(rebuild.begin(), rebuild.end());
+    std::sort(open.begin(), open.end());
+    printf("\nstartup (best of 5): rebuild %.02f ms, mmap open + first exists %.02f ms\n",
+           rebuild[0] / 1000000.0, open[0] / 1000000.0);
+}
+
+// Scan text made of dictionary words for 1000 keywords, with the
+// Aho-Corasick automaton versus prefixExists at every offset.
+static void perf_aho() {
+    std::vector<std::string> dict = load_dict();
+    if (dict.empty()) {
+        return;
+    }
+    std::mt19937 gen(6); // fixed seed
+    Trie<char> keywords;
+    for (int i = 0; i < 1000; i++) {
+        keywords.insert(dict[gen() % dict.size()]);
+    }
+    AhoCorasick automaton = keywords.buildAhoCorasick();
+
+    std::string text;
+    while (text.size() < (64 << 20)) {
+        text += dict[gen() % dict.size()];
+        text.push_back(' ');
+    }
+
+    // Scanned in 1MB chunks as a log would be read
+    const size_t chunk = 1 << 20;
+    size_t matches = 0;
+    AhoCorasick::Scanner scanner;
+    hrtime_t start = gethrtime();
+    for (size_t offset = 0; offset < text.size(); offset += chunk) {
+        size_t length = std::min(chunk, text.size() - offset);
+        automaton.scan(scanner, text.data() + offset, text.data() + offset + length,
+                       [&matches](uint64_t, const std::string&) {
+                           matches++;
+                       });
+    }
+    hrtime_t ahoTime = gethrtime() - start;
+
+    // The naive scan is far slower, time it over the first 4MB
+    const size_t naiveBytes = 4 << 20;
+    size_t naiveMatches = 0;
+    start = gethrtime();
+    for (size_t offset = 0; offset < naiveBytes; offset++) {
+        naiveMatches += keywords.prefixExists(text.data() + offset, text.data() + text.size());
+    }
+    hrtime_t naiveTime = gethrtime() - start;
+
+    printf("\naho-corasick: %zu states, %zu classes, %zu bytes, %zu matches in %zu MB\n",
+           automaton.getStateCount(), automaton.getClassCount(),
+           automaton.getMemoryBytes(), matches, text.size() >> 20);
+    printf("  aho-corasick scan  %.03f GB/s\n", text.size() / double(ahoTime));
+    printf("  prefixExists scan  %.03f GB/s (%zu offsets matched)\n",
+           naiveBytes / double(naiveTime), naiveMatches);
+}
+
+// IPv4 route lookups against a table with roughly the prefix length mix
+// of a BGP full table (mostly /24, then /22, /23 and the shorter
+// aggregates), versus probing a hash table per length from /32 down.
+static void perf_routes() {
+    struct Weight {
+        unsigned length;
+        double weight;
+    };
+    const Weight mix[] = {{8, 0.1}, {12, 0.2}, {14, 0.4}, {15, 0.4}, {16, 2.0},
+                          {17, 1.0}, {18, 1.8}, {19, 3.2}, {20, 4.0}, {21, 5.0},
+                          {22, 10.5}, {23, 9.5}, {24, 59.0}, {28, 0.3}, {32, 0.2}};
+    std::vector<double> weights;
+    for (const Weight& w : mix) {
+        weights.push_back(w.weight);
+    }
+    std::discrete_distribution<size_t> pickLength(weights.begin(), weights.end());
+
+    std::mt19937 gen(7); // fixed seed
+    TrieCidrMap<uint32_t> table(4);
+    std::unordered_map<uint32_t, uint32_t> byLength[33];
+    std::vector<uint32_t> prefixes;
+    for (uint32_t i = 0; i < 200000; i++) {
+        unsigned length = mix[pickLength(gen)].length;
+        uint32_t prefix = gen() & (~uint32_t(0) << (32 - length));
+        uint8_t bytes[4] = {uint8_t(prefix >> 24), uint8_t(prefix >> 16),
+                            uint8_t(prefix >> 8), uint8_t(prefix)};
+        table.insert(bytes, length, i);
+        byLength[length][prefix] = i;
+        prefixes.push_back(prefix);
+    }
+    uint8_t zero[4] = {};
+    table.insert(zero, 0, UINT32_MAX);
+    byLength[0][0] = UINT32_MAX;
+
+    // Most traffic goes to routed space, some to anywhere
+    std::vector<uint32_t> addresses;
+    for (int i = 0; i < 500000; i++) {
+        uint32_t address = gen();
+        if (i % 10) {
+            address = prefixes[gen() % prefixes.size()] | (address & 0xff);
+        }
+        addresses.push_back(address);
+    }
+
+    // Timed as a batch, a lookup is too quick to time one at a time
+    uint64_t check = 0;
+    hrtime_t start = gethrtime();
+    for (uint32_t address : addresses) {
+        uint8_t bytes[4] = {uint8_t(address >> 24), uint8_t(address >> 16),
+                            uint8_t(address >> 8), uint8_t(address)};
+        uint32_t value = 0;
+        table.find(bytes, value);
+        check += value;
+    }
+    hrtime_t trieTime = gethrtime() - start;
+
+    start = gethrtime();
+    for (uint32_t address : addresses) {
+        for (int length = 32; length >= 0; length--) {
+            uint32_t masked = length ? address & (~uint32_t(0) << (32 - length)) : 0;
+            auto it = byLength[length].find(masked);
+            if (it != byLength[length].end()) {
+                check -= it->second;
+                break;
+            }
+        }
+    }
+    hrtime_t hashTime = gethrtime() - start;
+    if (check) {
+        std::cerr << "Route lookups disagree" << std::endl;
+        return;
+    }
+
+    printf("\nroutes: %zu IPv4 routes, %zu lookups\n", table.size(), addresses.size());
+    printf("  cidr trie        %.02f Mlookups/s\n", addresses.size() * 1000.0 / trieTime);
+    printf("  hash per length  %.02f Mlookups/s\n", addresses.size() * 1000.0 / hashTime);
+}
+
+// Ordered iteration: every key through one cursor, then every key again
+// through a prefix cursor per distinct first two bytes.
+static void perf_cursor() {
+    std::vector<std::string> dict = load_dict();
+    if (dict.empty()) {
+        return;
+    }
+    Trie<char> trie(TrieLayout::PathCompressed);
+    trie.bulkInsert(dict.begin(), dict.end());
+
+    size_t keys = 0;
+    size_t bytes = 0;
+    hrtime_t start = gethrtime();
+    for (auto cursor = trie.cursor(); cursor.valid(); cursor.next()) {
+        keys++;
+        bytes += cursor.key().size();
+    }
+    hrtime_t scanTime = gethrtime() - start;
+
+    std::set<std::string> prefixes;
+    for (auto& s : dict) {
+        prefixes.insert(s.substr(0, 2));
+    }
+    size_t prefixKeys = 0;
+    start = gethrtime();
+    for (auto& p : prefixes) {
+        for (auto cursor = trie.prefixCursor(p.data(), p.data() + p.size());
+             cursor.valid();
+             cursor.next()) {
+            prefixKeys++;
+        }
+    }
+    hrtime_t prefixTime = gethrtime() - start;
+
+    printf("\ncursor: %zu keys (%zu bytes) in order, %.02f Mkeys/s\n",
+           keys, bytes, keys * 1000.0 / scanTime);
+    printf("  %zu prefix cursors, %zu keys, %.02f Mkeys/s\n",
+           prefixes.size(), prefixKeys, prefixKeys * 1000.0 / prefixTime);
+}
+
+// Lookups one at a time versus existsBatch, on the dictionary (which fits
+// in the cache) and on a few million random keys (which does not).
+static void perf_batch() {
+    auto run = [](const char* name, const std::vector<std::string>& keys) {
+        Trie<char> trie(TrieLayout::PathCompressed);
+        for (auto& k : keys) {
+            trie.insert(k);
+        }
+        std::vector<std::string> probes = keys;
+        std::mt19937 gen(8); // fixed seed
+        std::shuffle(probes.begin(), probes.end(), gen);
+        probes.resize(std::min<size_t>(probes.size(), 1000000));
+
+        size_t found = 0;
+        hrtime_t start = gethrtime();
+        for (auto& p : probes) {
+            found += trie.exists(p.data(), p.data() + p.size());
+        }
+        hrtime_t singleTime = gethrtime() - start;
+
+        std::unique_ptr<bool[]> results(new bool[probes.size()]);
+        start = gethrtime();
+        size_t batchFound = trie.existsBatch(probes.begin(), probes.end(), results.get());
+        hrtime_t batchTime = gethrtime() - start;
+        if (found != probes.size() || batchFound != found) {
+            std::cerr << "Batch lookups missed keys" << std::endl;
+            return;
+        }
+        printf("  %-16s %zu keys: exists %.02f Mops/s, existsBatch %.02f Mops/s (%.02fx)\n",
+               name, keys.size(), probes.size() * 1000.0 / singleTime,
+               probes.size() * 1000.0 / batchTime, double(singleTime) / batchTime);
+    };
+
+    printf("\nbatch lookups\n");
+    std::vector<std::string> dict = load_dict();
+    if (!dict.empty()) {
+        run("dictionary", dict);
+    }
+
+    std::mt19937 gen(9); // fixed seed
+    std::set<std::string> unique;
+    while (unique.size() < 3000000) {
+        std::string key;
+        size_t length = 8 + gen() % 16;
+        for (size_t i = 0; i < length; i++) {
+            key.push_back('a' + gen() % 26);
+        }
+        unique.insert(key);
+    }
+    run("random", std::vector<std::string>(unique.begin(), unique.end()));
+}
+
+struct InstrumentedPolicy : DefaultTriePolicy {
+    typedef TrieCountingInstrumentation Instrumentation;
+};
+
+// What the trie records about its own operations, and what recording
+// costs (the same exists loop with and without the counters).
+static void perf_instrumented() {
+    std::vector<std::string> dict = load_dict();
+    if (dict.empty()) {
+        return;
+    }
+    Trie<char, InstrumentedPolicy> trie(TrieLayout::PathCompressed);
+    Trie<char> plain(TrieLayout::PathCompressed);
+    std::mt19937 gen(10); // fixed seed
+    std::shuffle(dict.begin(), dict.end(), gen);
+    for (auto& s : dict) {
+        trie.insert(s);
+        plain.insert(s);
+    }
+
+    auto existsLoop = [&dict](auto& t) {
+        hrtime_t start = gethrtime();
+        for (int round = 0; round < 5; round++) {
+            for (auto& s : dict) {
+                t.exists(s.data(), s.data() + s.size());
+                t.prefixExists(s.data(), s.data() + s.size());
+            }
+        }
+        return gethrtime() - start;
+    };
+    hrtime_t plainTime = existsLoop(plain);
+    hrtime_t countedTime = existsLoop(trie);
+    for (auto& s : dict) {
+        trie.erase(s);
+    }
+
+    printf("\ninstrumented: %zu keys, counting costs %.02f%% on exists/prefixExists\n",
+           dict.size(), (double(countedTime) / plainTime - 1) * 100);
+    printf("  %-11s %9s %9s %9s %12s %9s %9s\n", "op", "count", "nodes/op",
+           "allocs/op", "lock ns/op", "p50 ns", "p99 ns");
+    const std::pair<const char*, TrieOp> ops[] = {
+        {"insert", TrieOp::Insert},
+        {"find", TrieOp::Find},
+        {"prefixFind", TrieOp::PrefixFind},
+        {"erase", TrieOp::Erase}
+    };
+    for (auto& op : ops) {
+        TrieOpCounters c = trie.getInstrumentation().read(op.second);
+        printf("  %-11s %9llu %9.02f %9.02f %12.02f %9llu %9llu\n", op.first,
+               (unsigned long long)c.operations, c.nodesPerOperation(),
+               c.allocationsPerOperation(), c.lockWaitPerOperation(),
+               (unsigned long long)c.latencyPercentile(50),
+               (unsigned long long)c.latencyPercentile(99));
+    }
+}
+
+struct ShardedPolicy : DefaultTriePolicy {
+    typedef TrieShardedLocking<64> Locking;
+};
+
+struct OptimisticPolicy : DefaultTriePolicy {
+    typedef TrieOptimisticLocking Locking;
+};
+
+// Indexes into the dictionary for each operation, either uniform or with a
+// zipf (theta 0.99) skew so a few hot words (and so a few shards) take most
+// of the operations.
+static std::vector<size_t> make_indexes(size_t n, size_t count, bool skewed, int seed) {
+    std::mt19937 gen(seed);
+    std::vector<size_t> indexes(count);
+    if (!skewed) {
+        std::uniform_int_distribution<size_t> uniform(0, n - 1);
+        for (auto& i : indexes) {
+            i = uniform(gen);
+        }
+        return indexes;
+    }
+
+    std::vector<double> cdf(n);
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += 1.0 / std::pow(double(i + 1), 0.99);
+        cdf[i] = sum;
+    }
+    std::uniform_real_distribution<double> uniform(0, sum);
+    for (auto& i : indexes) {
+        i = std::lower_bound(cdf.begin(), cdf.end(), uniform(gen)) - cdf.begin();
+        i = std::min(i, n - 1);
+    }
+    return indexes;
+}
+
+// Operations per second of a read mostly mix (90% exists, 10% insert)
+// with the trie half loaded, from 'threads' threads at once.
+template <typename Policy>
+static double run_throughput(const std::vector<std::string>& dict,
+                             int threads,
+                             bool skewed) {
+    const size_t opsPerThread = 200000;
+    Trie<char, Policy> trie;
+    for (size_t i = 0; i < dict.size(); i += 2) {
+        trie.insert(dict[i]);
+    }
+
+    std::vector<std::vector<size_t> > indexes;
+    for (int t = 0; t < threads; t++) {
+        indexes.push_back(make_indexes(dict.size(), opsPerThread, skewed, t));
+    }
+
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            ready++;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            size_t found = 0;
+            for (size_t op = 0; op < opsPerThread; op++) {
+                const std::string& s = dict[indexes[t][op]];
+                if (op % 10 == 0) {
+                    trie.insert(s);
+                } else {
+                    found += trie.exists(s.c_str(), s.c_str() + s.length());
+                }
+            }
+            if (found == opsPerThread) {
+                std::cerr << "unexpected: every key found" << std::endl;
+            }
+        });
+    }
+    while (ready != threads) {
+        std::this_thread::yield();
+    }
+    hrtime_t start = gethrtime();
+    go = true;
+    for (auto& w : workers) {
+        w.join();
+    }
+    hrtime_t elapsed = gethrtime() - start;
+    return (double(opsPerThread) * threads) / (double(elapsed) / 1e9);
+}
+
+static void perf_throughput(int maxThreads) {
+    std::vector<std::string> dict = load_dict();
+    if (dict.empty()) {
+        return;
+    }
+
+    printf("\nthroughput (Mops/s), 90%% exists 10%% insert\n");
+    printf("%-8s %-8s %10s %10s %10s\n", "keys", "threads", "mutex", "sharded", "optimistic");
+    for (bool skewed : {false, true}) {
+        for (int threads = 1; threads <= maxThreads; threads++) {
+            printf("%-8s %-8d %10.02f %10.02f %10.02f\n",
+                   skewed ? "zipf" : "uniform",
+                   threads,
+                   run_throughput<DefaultTriePolicy>(dict, threads, skewed) / 1e6,
+                   run_throughput<ShardedPolicy>(dict, threads, skewed) / 1e6,
+                   run_throughput<OptimisticPolicy>(dict, threads, skewed) / 1e6);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    // Build with -DTRIE_DISABLE_SIMD to get the scalar child search and
+    // compare the exists() latency against the vectorised build.
+#ifdef TRIE_SIMD_SSE2
+    printf("child search: SSE2\n");
+#else
+    printf("child search: scalar\n");
+#endif
     perf_char();
     perf_int();
+    perf_memory();
+    perf_bulk();
+    perf_frozen();
+    perf_darray();
+    perf_mmap();
+    perf_aho();
+    perf_routes();
+    perf_cursor();
+    perf_batch();
+    perf_instrumented();
+
+    // Throughput from 1 thread up to the number of cores (or argv[1])
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1) {
+        maxThreads = std::max(1, atoi(argv[1]));
+    }
+    perf_throughput(maxThreads);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,140 @@
+/**
+    Vectorised child search kernels for the Trie nodes.
+
+    Mid fanout nodes keep their child ids packed in an array, one vector
+    compare finds the matching slot rather than a hash lookup or a walk
+    over a sparse pointer table.
+
+    SSE2 is used on x86-64, everything else (or a build with
+    TRIE_DISABLE_SIMD defined) uses the scalar fallback.
+
+    triePrefetch is here too, the other per CPU helper.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE2__) && !defined(TRIE_DISABLE_SIMD)
+#include <emmintrin.h>
+#define TRIE_SIMD_SSE2 1
+#endif
+
+/**
+    Hint that p will be read soon. p may be any value, even nullptr.
+**/
+inline void triePrefetch(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+/**
+    Search 'count' keys of a 16 byte array for 'key'.
+    keys must point at 16 readable bytes, only the first count are valid.
+    Returns the index of the match or -1.
+**/
+inline int trieFindByte16(const uint8_t* keys, int count, uint8_t key) {
+#ifdef TRIE_SIMD_SSE2
+    __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(key)),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(cmp)) & ((1u << count) - 1);
+    return mask ? __builtin_ctz(mask) : -1;
+#else
+    for (int i = 0; i < count; i++) {
+        if (keys[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+#endif
+}
+
+#ifdef TRIE_SIMD_SSE2
+/**
+    Per width compare of a 16 byte vector against a broadcast key.
+    Returns a movemask with every byte of a matching lane set.
+**/
+template <size_t Width>
+struct TrieSimdLane;
+
+template <>
+struct TrieSimdLane<1> {
+    static __m128i broadcast(uint8_t key) {
+        return _mm_set1_epi8(static_cast<char>(key));
+    }
+    static unsigned match(__m128i keys, __m128i key) {
+        return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(keys, key)));
+    }
+};
+
+template <>
+struct TrieSimdLane<2> {
+    static __m128i broadcast(uint16_t key) {
+        return _mm_set1_epi16(static_cast<short>(key));
+    }
+    static unsigned match(__m128i keys, __m128i key) {
+        return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(keys, key)));
+    }
+};
+
+template <>
+struct TrieSimdLane<4> {
+    static __m128i broadcast(uint32_t key) {
+        return _mm_set1_epi32(static_cast<int>(key));
+    }
+    static unsigned match(__m128i keys, __m128i key) {
+        return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi32(keys, key)));
+    }
+};
+
+template <>
+struct TrieSimdLane<8> {
+    static __m128i broadcast(uint64_t key) {
+        return _mm_set1_epi64x(static_cast<long long>(key));
+    }
+    static unsigned match(__m128i keys, __m128i key) {
+        // SSE2 has no 64-bit compare, so both 32-bit halves must match.
+        __m128i cmp = _mm_cmpeq_epi32(keys, key);
+        cmp = _mm_and_si128(cmp, _mm_shuffle_epi32(cmp, _MM_SHUFFLE(2, 3, 0, 1)));
+        return static_cast<unsigned>(_mm_movemask_epi8(cmp));
+    }
+};
+#endif
+
+/**
+    Search 'count' packed keys for 'key', K must be integral.
+    Whole 16 byte vectors are compared at once and any remainder is
+    checked one at a time, so no bytes past keys[count] are read.
+    Returns the index of the match or -1.
+**/
+template <typename K>
+inline int trieFindKey(const K* keys, int count, K key) {
+    static_assert(std::is_integral<K>::value, "trieFindKey requires integral keys");
+    int i = 0;
+#ifdef TRIE_SIMD_SSE2
+    typedef typename std::make_unsigned<K>::type U;
+    typedef TrieSimdLane<sizeof(K)> Lane;
+    const int lanes = 16 / sizeof(K);
+    const __m128i needle = Lane::broadcast(static_cast<U>(key));
+    for (; i + lanes <= count; i += lanes) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        unsigned mask = Lane::match(v, needle);
+        if (mask) {
+            return i + static_cast<int>(__builtin_ctz(mask) / sizeof(K));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (keys[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
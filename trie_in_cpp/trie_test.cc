@@ -1,5 +1,23 @@
 #include "utilities/trie.h"
+#include "utilities/trie_cidr.h"
+#include "utilities/trie_hat.h"
+#include "utilities/trie_histogram.h"
+#include "utilities/trie_int.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <string_view>
+#include <thread>
+#include <utility>
 
 
 #include "gtest/gtest.h"
@@ -177,6 +195,1854 @@ TYPED_TEST(TrieTest, insert_3_exists_b) {
     }
 }
 
+// Every byte value can be a key element, including the "negative" chars
+TEST(TrieCharTest, all_byte_values) {
+    Trie<char> t;
+    for (int b = 0; b < 256; b++) {
+        std::string key(1, static_cast<char>(b));
+        t.insert(key);
+        key.push_back(static_cast<char>(255 - b));
+        t.insert(key);
+    }
+    for (int b = 0; b < 256; b++) {
+        char key[2] = {static_cast<char>(b), static_cast<char>(255 - b)};
+        EXPECT_TRUE(t.exists(key, key + 1));
+        EXPECT_TRUE(t.exists(key, key + 2));
+    }
+    // erase every other key, driving the root back down through the layouts
+    for (int b = 0; b < 256; b += 2) {
+        t.erase(std::string(1, static_cast<char>(b)) + static_cast<char>(255 - b));
+        t.erase(std::string(1, static_cast<char>(b)));
+    }
+    for (int b = 0; b < 256; b++) {
+        char key[2] = {static_cast<char>(b), static_cast<char>(255 - b)};
+        EXPECT_EQ(b % 2 == 1, t.exists(key, key + 1));
+        EXPECT_EQ(b % 2 == 1, t.exists(key, key + 2));
+    }
+}
+
+// Node layout grows and shrinks with the number of children
+TEST(TrieCharTest, node_layouts) {
+    typedef TrieNode<char>::Kind Kind;
+    TrieHeapAllocator allocator;
+    TrieNode<char> node;
+    EXPECT_EQ(Kind::Empty, node.getKind());
+
+    const std::vector<std::pair<int, Kind> > growth = {
+        {1, Kind::Single}, {4, Kind::Node4}, {5, Kind::Node16},
+        {16, Kind::Node16}, {17, Kind::Node48}, {48, Kind::Node48},
+        {49, Kind::Node256}, {256, Kind::Node256}};
+    int added = 0;
+    for (const auto& step : growth) {
+        while (added < step.first) {
+            // insert in a scattered order so sorted layouts are exercised
+            node.addChild(new TrieNode<char>(static_cast<char>((added * 7) & 0xff)),
+                          allocator);
+            added++;
+        }
+        EXPECT_EQ(step.second, node.getKind());
+        EXPECT_EQ(added, node.getChildCount());
+    }
+
+    for (int b = 0; b < 256; b++) {
+        TrieNode<char>* child = node.findChild(static_cast<char>(b));
+        ASSERT_NE(nullptr, child);
+        EXPECT_EQ(static_cast<char>(b), child->getId());
+    }
+
+    const std::vector<std::pair<int, Kind> > shrinkage = {
+        {41, Kind::Node256}, {40, Kind::Node48}, {13, Kind::Node48},
+        {12, Kind::Node16}, {4, Kind::Node16}, {3, Kind::Node4},
+        {2, Kind::Node4}, {1, Kind::Single}, {0, Kind::Empty}};
+    int remaining = 256;
+    for (const auto& step : shrinkage) {
+        while (remaining > step.first) {
+            remaining--;
+            delete node.unlinkChild(static_cast<char>((remaining * 7) & 0xff), allocator);
+        }
+        EXPECT_EQ(step.second, node.getKind());
+        EXPECT_EQ(remaining, node.getChildCount());
+        for (int i = 0; i < 256; i++) {
+            char id = static_cast<char>((i * 7) & 0xff);
+            EXPECT_EQ(i < remaining, node.findChild(id) != nullptr);
+        }
+    }
+}
+
+template <typename T>
+class TrieSimdTest : public ::testing::Test {
+};
+
+typedef ::testing::Types<int8_t, uint16_t, int, uint32_t, int64_t, uint64_t> SimdTypes;
+TYPED_TEST_CASE(TrieSimdTest, SimdTypes);
+
+// vector search agrees with a linear search for every count/position
+TYPED_TEST(TrieSimdTest, find_key) {
+    std::vector<TypeParam> keys;
+    for (int i = 0; i < 40; i++) {
+        // an odd multiplier keeps the low byte unique and mixes the high bits
+        keys.push_back(static_cast<TypeParam>(i * 0x9E3779B97F4A7C15ull));
+    }
+    for (int count = 0; count <= 40; count++) {
+        for (int i = 0; i < 40; i++) {
+            EXPECT_EQ(i < count ? i : -1, trieFindKey(keys.data(), count, keys[i]));
+        }
+    }
+}
+
+TEST(TrieSimdTest, find_byte16) {
+    uint8_t keys[16];
+    for (int i = 0; i < 16; i++) {
+        keys[i] = static_cast<uint8_t>(i * 17);
+    }
+    for (int count = 0; count <= 16; count++) {
+        for (int i = 0; i < 16; i++) {
+            EXPECT_EQ(i < count ? i : -1, trieFindByte16(keys, count, keys[i]));
+        }
+    }
+}
+
+// the children stay one flat array sorted by id, found by the window and
+// binary search, as it grows 4 -> 16 -> doubling and shrinks again; a
+// single child is inline with no array at all
+TEST(TrieIntTest, packed_children) {
+    TrieHeapAllocator allocator;
+    TrieNode<int> node;
+    // wide enough to be binary searched, added out of order
+    std::vector<int> ids;
+    for (int i = 0; i < 300; i++) {
+        ids.push_back(i * 37 - 5000);
+    }
+    std::mt19937 gen(5);
+    std::shuffle(ids.begin(), ids.end(), gen);
+    std::set<int> added;
+    for (int id : ids) {
+        node.addChild(new TrieNode<int>(id), allocator);
+        added.insert(id);
+        if (added.size() % 23 == 1) {
+            for (int j = 0; j < 300; j++) {
+                int other = j * 37 - 5000;
+                EXPECT_EQ(added.count(other) == 1, node.findChild(other) != nullptr);
+                EXPECT_EQ(nullptr, node.findChild(other + 1));
+            }
+        }
+    }
+    std::vector<int> order;
+    node.forEachChild([&order](TrieNode<int>* child) {
+        order.push_back(child->getId());
+    });
+    EXPECT_TRUE(std::equal(order.begin(), order.end(), added.begin(), added.end()));
+
+    for (int id : ids) {
+        delete node.unlinkChild(id, allocator);
+        added.erase(id);
+        EXPECT_EQ(nullptr, node.findChild(id));
+        if (!added.empty()) {
+            EXPECT_NE(nullptr, node.findChild(*added.begin()));
+            EXPECT_NE(nullptr, node.findChild(*added.rbegin()));
+        }
+        EXPECT_EQ(added.size() == 1, node.getOnlyChild() != nullptr);
+    }
+    EXPECT_FALSE(node.hasChildren());
+    EXPECT_EQ(0u, node.getChildBytes());
+
+    // one child is held inline
+    node.addChild(new TrieNode<int>(7), allocator);
+    EXPECT_EQ(0u, node.getChildBytes());
+    EXPECT_EQ(7, node.getOnlyChild()->getId());
+    delete node.unlinkChild(7, allocator);
+}
+
+class TrieLayoutTest : public ::testing::TestWithParam<TrieLayout> {
+};
+
+INSTANTIATE_TEST_CASE_P(Layouts, TrieLayoutTest,
+                        ::testing::Values(TrieLayout::Expanded,
+                                          TrieLayout::PathCompressed));
+
+static bool exists(Trie<char>& t, const std::string& key) {
+    return t.exists(key.data(), key.data() + key.size());
+}
+
+static bool prefixExists(Trie<char>& t, const std::string& key) {
+    return t.prefixExists(key.data(), key.data() + key.size());
+}
+
+// a key of minLength up to (not including) maxLength elements of alphabet
+static std::string randomKey(std::mt19937& gen,
+                             std::string_view alphabet,
+                             size_t maxLength,
+                             size_t minLength = 0) {
+    std::string key;
+    size_t length = minLength + gen() % (maxLength - minLength);
+    for (size_t i = 0; i < length; i++) {
+        key.push_back(alphabet[gen() % alphabet.size()]);
+    }
+    return key;
+}
+
+// count random keys valued by the order they went in, then the empty key
+// (-1) and 300 'z's (300)
+template <typename Map>
+static void insertRandomKeys(Map& t,
+                             std::mt19937& gen,
+                             int count,
+                             std::string_view alphabet,
+                             size_t maxLength) {
+    for (int i = 0; i < count; i++) {
+        t.insert(randomKey(gen, alphabet, maxLength), i);
+    }
+    t.insert("", -1);
+    t.insert(std::string(300, 'z'), 300);
+}
+
+// other (a read only form of t, whose find and prefixFind return a value
+// pointer) answers key as t does
+template <typename Map, typename ReadOnly>
+static ::testing::AssertionResult sameAnswers(Map& t,
+                                              const ReadOnly& other,
+                                              const std::string& key) {
+    const char* b = key.data();
+    const char* e = key.data() + key.size();
+    int value = 0;
+    bool found = t.findValue(b, e, value);
+    const int* otherValue = other.find(b, e);
+    if (found != (otherValue != nullptr) || (found && value != *otherValue)) {
+        return ::testing::AssertionFailure() << "find differs for " << key;
+    }
+    bool prefixed = t.prefixFindValue(b, e, value);
+    otherValue = other.prefixFind(b, e);
+    if (prefixed != (otherValue != nullptr) || (prefixed && value != *otherValue)) {
+        return ::testing::AssertionFailure() << "prefixFind differs for " << key;
+    }
+    return ::testing::AssertionSuccess();
+}
+
+// as sameAnswers for a read only form of the keys of t
+template <typename ReadOnly>
+static ::testing::AssertionResult sameKeys(Trie<char>& t,
+                                           const ReadOnly& other,
+                                           const std::string& key) {
+    const char* b = key.data();
+    const char* e = key.data() + key.size();
+    if (t.exists(b, e) != other.exists(b, e)) {
+        return ::testing::AssertionFailure() << "exists differs for " << key;
+    }
+    if (t.prefixExists(b, e) != other.prefixExists(b, e)) {
+        return ::testing::AssertionFailure() << "prefixExists differs for " << key;
+    }
+    return ::testing::AssertionSuccess();
+}
+
+static const std::vector<std::string> hamKeys = {"", "h", "ha", "ham", "hams", "hamster", "hamsters"};
+
+// keys which split and then re-merge compressed edges
+TEST_P(TrieLayoutTest, split_and_merge) {
+    Trie<char> t(GetParam());
+    t.insert("http://example.com/index.html");
+    t.insert("http://example.com/about.html");
+    t.insert("http://example.com/");
+    t.insert("http://example.org/");
+
+    EXPECT_TRUE(exists(t, "http://example.com/index.html"));
+    EXPECT_TRUE(exists(t, "http://example.com/about.html"));
+    EXPECT_TRUE(exists(t, "http://example.com/"));
+    EXPECT_TRUE(exists(t, "http://example.org/"));
+    EXPECT_FALSE(exists(t, "http://example."));
+    EXPECT_FALSE(exists(t, "http://example.com/index"));
+    EXPECT_FALSE(exists(t, "http://example.com/index.htmlx"));
+    EXPECT_TRUE(prefixExists(t, "http://example.com/contact"));
+    EXPECT_FALSE(prefixExists(t, "http://example.net/"));
+
+    t.erase("http://example.com/");
+    EXPECT_FALSE(exists(t, "http://example.com/"));
+    EXPECT_TRUE(exists(t, "http://example.com/index.html"));
+    t.erase("http://example.com/index.html");
+    EXPECT_FALSE(exists(t, "http://example.com/index.html"));
+    EXPECT_TRUE(exists(t, "http://example.com/about.html"));
+    EXPECT_FALSE(prefixExists(t, "http://example.com/contact"));
+    t.erase("http://example.org/");
+    t.erase("http://example.com/about.html");
+    EXPECT_FALSE(exists(t, "http://example.com/about.html"));
+
+    // erasing everything leaves a usable trie
+    t.insert("http");
+    EXPECT_TRUE(exists(t, "http"));
+    EXPECT_FALSE(exists(t, "http://example.org/"));
+}
+
+// compare against std::set over a random workload of prefix heavy keys
+TEST_P(TrieLayoutTest, random_model) {
+    Trie<char> t(GetParam());
+    std::set<std::string> model;
+    std::mt19937 gen(7);
+
+    for (int op = 0; op < 20000; op++) {
+        std::string key = randomKey(gen, "ab\xff", 13, 1);
+        if (gen() % 3) {
+            t.insert(key);
+            model.insert(key);
+        } else {
+            t.erase(key);
+            model.erase(key);
+        }
+        std::string probe = randomKey(gen, "ab\xff", 13, 1);
+        ASSERT_EQ(model.count(probe) == 1, exists(t, probe)) << probe;
+    }
+    for (const auto& key : model) {
+        EXPECT_TRUE(exists(t, key));
+    }
+}
+
+TEST_P(TrieLayoutTest, map_insert_erase_find) {
+    TrieMap<char, std::string> t(GetParam());
+    t.insert("beer::", "beer");
+    t.insert("beer::stout", "stout");
+    t.insert("beers::", "beers");
+
+    std::string key = "beer::stout";
+    auto itr = t.find(key.data(), key.data() + key.size());
+    ASSERT_TRUE(itr != t.end());
+    EXPECT_EQ("stout", *itr);
+
+    key = "beer::lager";
+    itr = t.prefixFind(key.data(), key.data() + key.size());
+    ASSERT_TRUE(itr != t.end());
+    EXPECT_EQ("beer", *itr);
+
+    t.erase("beer::");
+    EXPECT_TRUE(t.prefixFind(key.data(), key.data() + key.size()) == t.end());
+    key = "beer::stout";
+    itr = t.find(key.data(), key.data() + key.size());
+    ASSERT_TRUE(itr != t.end());
+    EXPECT_EQ("stout", *itr);
+}
+
+struct ArenaPolicy : DefaultTriePolicy {
+    typedef TrieArenaAllocator Allocator;
+};
+
+// erased blocks are handed out again for the same size class
+TEST(TrieArenaTest, free_list_reuse) {
+    TrieArenaAllocator arena(4096);
+    void* a = arena.allocate(40);
+    void* b = arena.allocate(48);
+    EXPECT_EQ(static_cast<char*>(a) + 48, b);
+    arena.deallocate(a, 40);
+    EXPECT_EQ(a, arena.allocate(33));
+    EXPECT_NE(a, arena.allocate(40));
+
+    // large allocations are tracked and released with the arena
+    void* big = arena.allocate(10000);
+    std::memset(big, 0, 10000);
+    arena.deallocate(big, 10000);
+    arena.allocate(20000);
+}
+
+TEST_P(TrieLayoutTest, arena_random_model) {
+    Trie<char, ArenaPolicy> t(GetParam());
+    std::set<std::string> model;
+    std::mt19937 gen(11);
+    for (int op = 0; op < 20000; op++) {
+        std::string key;
+        size_t length = 1 + gen() % 40;
+        for (size_t i = 0; i < length; i++) {
+            key.push_back('a' + gen() % 4);
+        }
+        if (gen() % 3) {
+            t.insert(key);
+            model.insert(key);
+        } else {
+            t.erase(key);
+            model.erase(key);
+        }
+    }
+    for (const auto& key : model) {
+        EXPECT_TRUE(t.exists(key.data(), key.data() + key.size()));
+    }
+}
+
+// values with destructors are still destroyed when the arena is used
+TEST_P(TrieLayoutTest, arena_map_values) {
+    TrieMap<char, std::string, ArenaPolicy> t(GetParam());
+    for (int i = 0; i < 1000; i++) {
+        t.insert("key" + std::to_string(i), std::string(100, 'x') + std::to_string(i));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        t.erase("key" + std::to_string(i));
+    }
+    std::string key = "key999";
+    auto itr = t.find(key.data(), key.data() + key.size());
+    ASSERT_TRUE(itr != t.end());
+    EXPECT_EQ(std::string(100, 'x') + "999", *itr);
+}
+
+struct OlcPolicy : DefaultTriePolicy {
+    typedef TrieOptimisticLocking Locking;
+};
+
+// single threaded, the optimistic paths must match the model exactly
+TEST_P(TrieLayoutTest, olc_random_model) {
+    TrieMap<char, int, OlcPolicy> t(GetParam());
+    Trie<char, OlcPolicy> keys(GetParam());
+    std::map<std::string, int> model;
+    std::mt19937 gen(13);
+
+    for (int op = 0; op < 20000; op++) {
+        std::string key = randomKey(gen, "ab\xff", 12);
+        if (gen() % 3) {
+            t.insert(key, op);
+            keys.insert(key);
+            model[key] = op;
+        } else {
+            t.erase(key);
+            keys.erase(key);
+            model.erase(key);
+        }
+        std::string probe = randomKey(gen, "ab\xff", 12);
+        ASSERT_EQ(model.count(probe) == 1, keys.exists(probe.data(), probe.data() + probe.size()));
+        int value = -1;
+        auto m = model.find(probe);
+        ASSERT_EQ(m != model.end(),
+                  t.findValue(probe.data(), probe.data() + probe.size(), value)) << probe;
+        if (m != model.end()) {
+            ASSERT_EQ(m->second, value);
+        }
+
+        // the root (empty key) is never reported as a prefix
+        bool prefixed = false;
+        for (size_t l = 1; l <= probe.size() && !prefixed; l++) {
+            prefixed = model.count(probe.substr(0, l)) == 1;
+        }
+        ASSERT_EQ(prefixed, t.prefixFindValue(probe.data(), probe.data() + probe.size(), value)) << probe;
+    }
+}
+
+// readers never miss a key which is not being changed, whilst writers
+// insert and erase around it
+TEST_P(TrieLayoutTest, olc_concurrent_readers_writers) {
+    TrieMap<char, uint64_t, OlcPolicy> t(GetParam());
+    const int stable = 2000;
+    for (int i = 0; i < stable; i++) {
+        std::string key = "stable/" + std::to_string(i * 7919);
+        t.insert(key, i);
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int w = 0; w < 2; w++) {
+        threads.emplace_back([&t, w]() {
+            std::mt19937 gen(w);
+            for (int op = 0; op < 40000; op++) {
+                // shares prefixes with the stable keys to force splits/merges
+                std::string key = "stable/" + std::to_string(gen() % 20000) +
+                                  "/" + std::to_string(w);
+                if (gen() % 2) {
+                    t.insert(key, op);
+                } else {
+                    t.erase(key);
+                }
+            }
+        });
+    }
+    for (int r = 0; r < 2; r++) {
+        threads.emplace_back([&t, &done, &failures, stable]() {
+            while (!done) {
+                for (int i = 0; i < stable; i++) {
+                    std::string key = "stable/" + std::to_string(i * 7919);
+                    uint64_t value = 0;
+                    if (!t.findValue(key.data(), key.data() + key.size(), value) ||
+                        value != static_cast<uint64_t>(i)) {
+                        failures++;
+                    }
+                }
+            }
+        });
+    }
+    threads[0].join();
+    threads[1].join();
+    done = true;
+    threads[2].join();
+    threads[3].join();
+    EXPECT_EQ(0, failures);
+
+    // every writer key is erased from a single thread, the stable keys remain
+    for (int i = 0; i < 20000; i++) {
+        for (int w = 0; w < 2; w++) {
+            t.erase("stable/" + std::to_string(i) + "/" + std::to_string(w));
+        }
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < stable; i++) {
+        std::string key = "stable/" + std::to_string(i * 7919);
+        EXPECT_TRUE(t.findValue(key.data(), key.data() + key.size(), value)) << key;
+    }
+    std::string key = "stable/1/0";
+    EXPECT_FALSE(t.findValue(key.data(), key.data() + key.size(), value));
+}
+
+// a value wider than a word is never seen half written, a writer updates
+// it in place whilst readers copy it out
+TEST_P(TrieLayoutTest, olc_wide_values) {
+    struct Pair {
+        uint64_t a;
+        uint64_t b;
+    };
+    TrieMap<char, Pair, OlcPolicy> t(GetParam());
+    const int keys = 64;
+    for (int i = 0; i < keys; i++) {
+        t.insert("pair/" + std::to_string(i), Pair{0, 0});
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&t]() {
+        for (uint64_t n = 1; n <= 20000; n++) {
+            t.insert("pair/" + std::to_string(n % keys), Pair{n, n});
+        }
+    });
+    for (int r = 0; r < 2; r++) {
+        threads.emplace_back([&t, &done, &failures]() {
+            while (!done) {
+                for (int i = 0; i < keys; i++) {
+                    std::string key = "pair/" + std::to_string(i);
+                    Pair value{1, 2};
+                    if (!t.findValue(key.data(), key.data() + key.size(), value) ||
+                        value.a != value.b) {
+                        failures++;
+                    }
+                }
+            }
+        });
+    }
+    threads[0].join();
+    done = true;
+    threads[1].join();
+    threads[2].join();
+    EXPECT_EQ(0, failures);
+
+    Pair value{};
+    std::string key = "pair/0";
+    ASSERT_TRUE(t.findValue(key.data(), key.data() + key.size(), value));
+    EXPECT_EQ(19968u, value.a);
+    EXPECT_EQ(19968u, value.b);
+}
+
+// each shard has its own arena, which its lock protects
+struct ShardedPolicy : DefaultTriePolicy {
+    typedef TrieArenaAllocator Allocator;
+    typedef TrieShardedLocking<16> Locking;
+};
+
+TEST_P(TrieLayoutTest, sharded_random_model) {
+    TrieMap<char, int, ShardedPolicy> t(GetParam());
+    Trie<int, ShardedPolicy> ints(GetParam());
+    std::map<std::string, int> model;
+    std::mt19937 gen(17);
+    for (int op = 0; op < 20000; op++) {
+        std::string key = randomKey(gen, "ab\x80\xff", 8);
+        std::vector<int> intKey(key.begin(), key.end());
+        if (gen() % 3) {
+            t.insert(key, op);
+            ints.insert(intKey);
+            model[key] = op;
+        } else {
+            t.erase(key);
+            ints.erase(intKey);
+            model.erase(key);
+        }
+    }
+    for (const auto& kv : model) {
+        int value = -1;
+        std::vector<int> intKey(kv.first.begin(), kv.first.end());
+        ASSERT_TRUE(t.findValue(kv.first.data(), kv.first.data() + kv.first.size(), value));
+        EXPECT_EQ(kv.second, value);
+        EXPECT_TRUE(ints.exists(intKey.begin(), intKey.end()));
+    }
+
+    // prefixes are found from within the key's shard
+    std::string key = "ab";
+    t.insert("a", 1);
+    int value = 0;
+    EXPECT_TRUE(t.prefixFindValue(key.data(), key.data() + key.size(), value));
+    EXPECT_EQ(1, value);
+}
+
+// writers each own a first byte, readers check keys that never change
+TEST(TrieShardedTest, concurrent_writers) {
+    Trie<char, ShardedPolicy> t;
+    for (int i = 0; i < 1000; i++) {
+        t.insert("s" + std::to_string(i));
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> writers;
+    for (char w = 'a'; w < 'e'; w++) {
+        writers.emplace_back([&t, w]() {
+            for (int i = 0; i < 20000; i++) {
+                t.insert(w + std::to_string(i));
+            }
+            for (int i = 0; i < 20000; i += 2) {
+                t.erase(w + std::to_string(i));
+            }
+        });
+    }
+    std::thread reader([&t, &done, &failures]() {
+        while (!done) {
+            for (int i = 0; i < 1000; i++) {
+                std::string key = "s" + std::to_string(i);
+                if (!t.exists(key.data(), key.data() + key.size())) {
+                    failures++;
+                }
+            }
+        }
+    });
+    for (auto& w : writers) {
+        w.join();
+    }
+    done = true;
+    reader.join();
+    EXPECT_EQ(0, failures);
+
+    for (char w = 'a'; w < 'e'; w++) {
+        for (int i = 0; i < 20000; i++) {
+            std::string key = w + std::to_string(i);
+            ASSERT_EQ(i % 2 == 1, t.exists(key.data(), key.data() + key.size())) << key;
+        }
+    }
+}
+
+// a bulk build must give the same trie as inserting key by key
+TEST_P(TrieLayoutTest, bulk_insert_model) {
+    std::mt19937 gen(19);
+    std::vector<std::pair<std::string, int> > items;
+    for (int i = 0; i < 5000; i++) {
+        items.push_back({randomKey(gen, "ab\x80\xff", 10), i});
+    }
+
+    // unsorted with duplicates, the last of each duplicate wins
+    std::map<std::string, int> model;
+    for (const auto& item : items) {
+        model[item.first] = item.second;
+    }
+
+    TrieMap<char, int> t(GetParam());
+    t.bulkInsert(items.begin(), items.end());
+    TrieMap<char, int, ShardedPolicy> sharded(GetParam());
+    sharded.bulkInsert(items.begin(), items.end());
+    TrieMap<char, int, OlcPolicy> olc(GetParam());
+    olc.bulkInsert(model.begin(), model.end());
+
+    std::mt19937 probes(23);
+    for (int i = 0; i < 20000; i++) {
+        std::string key;
+        size_t length = probes() % 10;
+        for (size_t j = 0; j < length; j++) {
+            key.push_back("ab\x80\xff"[probes() % 4]);
+        }
+        auto m = model.find(key);
+        int value = -1;
+        ASSERT_EQ(m != model.end(), t.findValue(key.data(), key.data() + key.size(), value)) << key;
+        if (m != model.end()) {
+            EXPECT_EQ(m->second, value);
+        }
+        ASSERT_EQ(m != model.end(), sharded.findValue(key.data(), key.data() + key.size(), value));
+        ASSERT_EQ(m != model.end(), olc.findValue(key.data(), key.data() + key.size(), value));
+    }
+
+    // the built trie carries on working with erase and insert
+    for (const auto& kv : model) {
+        t.erase(kv.first);
+    }
+    t.insert("ab", 1);
+    std::string key = "ab";
+    int value = 0;
+    EXPECT_TRUE(t.findValue(key.data(), key.data() + key.size(), value));
+    EXPECT_EQ(1, value);
+
+    // a non-empty trie falls back to inserting each key
+    std::vector<std::vector<int> > keys = {{3, 1}, {1, 2, 3}, {1, 2}, {}};
+    Trie<int> ints(GetParam());
+    ints.insert({9});
+    ints.bulkInsert(keys.begin(), keys.end());
+    Trie<int> built(GetParam());
+    built.bulkInsert(keys.begin(), keys.end());
+    for (auto& k : keys) {
+        EXPECT_TRUE(ints.exists(k.begin(), k.end()));
+        EXPECT_TRUE(built.exists(k.begin(), k.end()));
+    }
+    std::vector<int> prefix = {3};
+    EXPECT_FALSE(built.exists(prefix.begin(), prefix.end()));
+}
+
+TEST(TrieBitVectorTest, rank_select) {
+    TrieBitVector bits;
+    std::vector<bool> model;
+    std::mt19937 gen(29);
+    for (int i = 0; i < 5000; i++) {
+        // long runs of ones as well as mixed words
+        bool bit = i < 1000 ? gen() % 2 : (i < 2000 || gen() % 5);
+        bits.push_back(bit);
+        model.push_back(bit);
+    }
+    bits.freeze();
+
+    size_t ones = 0, zeros = 0;
+    for (size_t i = 0; i < model.size(); i++) {
+        ASSERT_EQ(ones, bits.rank1(i));
+        ASSERT_EQ(bool(model[i]), bits.get(i));
+        if (model[i]) {
+            ones++;
+        } else {
+            ASSERT_EQ(i, bits.select0(zeros));
+            zeros++;
+        }
+        size_t run = 0;
+        while (i + run < model.size() && model[i + run]) {
+            run++;
+        }
+        ASSERT_EQ(run, bits.runOfOnes(i)) << i;
+    }
+}
+
+// the frozen trie answers exactly as the trie it was frozen from
+TEST_P(TrieLayoutTest, freeze_model) {
+    TrieMap<char, int, ShardedPolicy> t(GetParam());
+    std::mt19937 gen(31);
+    insertRandomKeys(t, gen, 3000, "ab\x80\xff", 14);
+
+    FrozenTrieMap<int> frozen = t.freeze();
+    ASSERT_TRUE(sameAnswers(t, frozen, std::string(300, 'z')));
+    for (int i = 0; i < 20000; i++) {
+        ASSERT_TRUE(sameAnswers(t, frozen, randomKey(gen, "ab\x80\xff", 14)));
+    }
+
+    Trie<char> keys(GetParam());
+    EXPECT_FALSE(keys.freeze().exists("", ""));
+    keys.insert("ham");
+    keys.insert("hamster");
+    FrozenTrie frozenKeys = keys.freeze();
+    for (const std::string& key : hamKeys) {
+        EXPECT_TRUE(sameKeys(keys, frozenKeys, key));
+    }
+    EXPECT_EQ(8u, frozenKeys.getNodeCount());
+
+    // nodes of 64 or more children are runs of 64+ ones in the LOUDS
+    // bits, some starting on a word boundary
+    Trie<char> wide(GetParam());
+    std::vector<std::string> wideKeys;
+    for (int c = 0; c < 256; c++) {
+        wideKeys.push_back(std::string(1, static_cast<char>(c)));
+        wideKeys.push_back(std::string("w") + static_cast<char>(c));
+        if (c < 100) {
+            wideKeys.push_back(std::string("x") + static_cast<char>(c) + "y");
+        }
+    }
+    for (const std::string& k : wideKeys) {
+        wide.insert(k);
+    }
+    FrozenTrie frozenWide = wide.freeze();
+    for (const std::string& k : wideKeys) {
+        ASSERT_TRUE(frozenWide.exists(k.data(), k.data() + k.size())) << k;
+        EXPECT_TRUE(sameKeys(wide, frozenWide, k + "q"));
+    }
+    std::string xy = "x\x7fy";
+    EXPECT_FALSE(frozenWide.exists(xy.data(), xy.data() + xy.size()));
+}
+
+// the double array answers exactly as the trie it was built from
+TEST_P(TrieLayoutTest, double_array_model) {
+    TrieMap<char, int, ShardedPolicy> t(GetParam());
+    std::mt19937 gen(37);
+    insertRandomKeys(t, gen, 3000, "ab\x80\xff", 14);
+
+    DoubleArrayTrieMap<int> darray = t.buildDoubleArray();
+    ASSERT_TRUE(sameAnswers(t, darray, std::string(300, 'z')));
+    for (int i = 0; i < 20000; i++) {
+        ASSERT_TRUE(sameAnswers(t, darray, randomKey(gen, "ab\x80\xff", 14)));
+    }
+
+    Trie<char> keys(GetParam());
+    EXPECT_FALSE(keys.buildDoubleArray().exists("", ""));
+    keys.insert("ham");
+    keys.insert("hamster");
+    DoubleArrayTrie darrayKeys = keys.buildDoubleArray();
+    for (const std::string& key : hamKeys) {
+        EXPECT_TRUE(sameKeys(keys, darrayKeys, key));
+    }
+}
+
+TEST_P(TrieLayoutTest, mapped_file_model) {
+    TrieMap<char, int> t(GetParam());
+    std::mt19937 gen(41);
+    insertRandomKeys(t, gen, 2000, "ab\x80\xff", 10);
+
+    const std::string path = testing::TempDir() + "trie_mapped_file_model";
+    t.save(path);
+    DoubleArrayTrieMap<int> mapped = DoubleArrayTrieMap<int>::open(path);
+    DoubleArrayTrie mappedKeys = DoubleArrayTrie::open(path);
+    for (int i = 0; i < 10000; i++) {
+        std::string key = randomKey(gen, "ab\x80\xff", 10);
+        ASSERT_TRUE(sameAnswers(t, mapped, key));
+        int value = 0;
+        EXPECT_EQ(t.findValue(key.data(), key.data() + key.size(), value),
+                  mappedKeys.exists(key.data(), key.data() + key.size())) << key;
+    }
+
+    // A Trie file has no values for a DoubleArrayTrieMap
+    Trie<char> keys(GetParam());
+    keys.insert("ham");
+    keys.save(path);
+    EXPECT_TRUE(DoubleArrayTrie::open(path).exists("ham", "ham" + 3));
+    EXPECT_THROW(DoubleArrayTrieMap<int>::open(path), std::runtime_error);
+
+    // Not a trie file
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << std::string(256, 'x');
+    }
+    EXPECT_THROW(DoubleArrayTrie::open(path), std::runtime_error);
+    std::remove(path.c_str());
+    EXPECT_THROW(DoubleArrayTrie::open(path), std::system_error);
+}
+
+TEST_P(TrieLayoutTest, aho_corasick_model) {
+    TrieMap<char, int> t(GetParam());
+    std::mt19937 gen(43);
+    std::set<std::string> keys;
+    for (int i = 0; i < 300; i++) {
+        keys.insert(randomKey(gen, "abc\xff", 7, 1));
+    }
+    int value = 0;
+    for (const std::string& key : keys) {
+        t.insert(key, value++);
+    }
+    t.insert("", -1);
+
+    std::string text;
+    for (int i = 0; i < 5000; i++) {
+        text.push_back("abcd\xff"[gen() % 5]);
+    }
+
+    // Every (offset, key) which a search at each offset finds
+    std::set<std::pair<uint64_t, std::string> > expected;
+    for (size_t offset = 0; offset < text.size(); offset++) {
+        for (const std::string& key : keys) {
+            if (text.compare(offset, key.size(), key) == 0) {
+                expected.insert(std::make_pair(offset, key));
+            }
+        }
+    }
+
+    // Scanned in uneven chunks, so matches span chunk boundaries
+    AhoCorasickMap<int> automaton = t.buildAhoCorasick();
+    AhoCorasick::Scanner scanner;
+    std::set<std::pair<uint64_t, std::string> > found;
+    size_t matches = 0;
+    for (size_t offset = 0; offset < text.size();) {
+        size_t length = std::min<size_t>(1 + gen() % 7, text.size() - offset);
+        automaton.scan(scanner, text.data() + offset, text.data() + offset + length,
+                       [&](uint64_t at, const std::string& key, int v) {
+                           int expectedValue = 0;
+                           ASSERT_TRUE(t.findValue(key.data(), key.data() + key.size(), expectedValue));
+                           EXPECT_EQ(expectedValue, v);
+                           found.insert(std::make_pair(at, key));
+                           matches++;
+                       });
+        offset += length;
+    }
+    EXPECT_EQ(text.size(), scanner.getOffset());
+    EXPECT_EQ(expected.size(), matches);
+    EXPECT_EQ(expected, found);
+
+    // Overlapping keys all match, longest first at the same end
+    Trie<char> words(GetParam());
+    words.insert("he");
+    words.insert("she");
+    words.insert("his");
+    words.insert("hers");
+    std::vector<std::pair<uint64_t, std::string> > ushers;
+    AhoCorasick::Scanner stream;
+    std::string text2 = "ushers";
+    words.buildAhoCorasick().scan(stream, text2.data(), text2.data() + text2.size(),
+                                  [&ushers](uint64_t at, const std::string& key) {
+                                      ushers.push_back(std::make_pair(at, key));
+                                  });
+    std::vector<std::pair<uint64_t, std::string> > expectedUshers = {
+        {1, "she"}, {2, "he"}, {2, "hers"}};
+    EXPECT_EQ(expectedUshers, ushers);
+}
+
+TEST_P(TrieLayoutTest, longest_and_all_prefixes) {
+    TrieMap<char, int> t(GetParam());
+    t.insert("", 0);
+    t.insert("h", 1);
+    t.insert("ham", 3);
+    t.insert("hamster", 7);
+    t.insert("hat", 30);
+
+    std::string key = "hamsters";
+    const char* b = key.data();
+    EXPECT_EQ(7, *t.longestPrefixFind(b, b + 8));
+    EXPECT_EQ(3, *t.longestPrefixFind(b, b + 6));
+    EXPECT_EQ(1, *t.longestPrefixFind(b, b + 2));
+    EXPECT_EQ(t.end(), t.longestPrefixFind(b, b));
+    int value = 0;
+    size_t length = 0;
+    EXPECT_TRUE(t.longestPrefixFindValue(b, b + 7, value, &length));
+    EXPECT_EQ(7, value);
+    EXPECT_EQ(7u, length);
+
+    std::vector<std::pair<size_t, int> > prefixes;
+    t.allPrefixes(b, b + 8, [&prefixes](size_t l, int& v) {
+        prefixes.push_back(std::make_pair(l, v));
+    });
+    std::vector<std::pair<size_t, int> > expected = {{1, 1}, {3, 3}, {7, 7}};
+    EXPECT_EQ(expected, prefixes);
+
+    TrieMap<int, int> generic(GetParam());
+    generic.insert({1}, 1);
+    generic.insert({1, 2, 3}, 3);
+    std::vector<int> path = {1, 2, 3, 4};
+    EXPECT_EQ(3, *generic.longestPrefixFind(path.begin(), path.end()));
+    EXPECT_EQ(1, *generic.longestPrefixFind(path.begin(), path.begin() + 2));
+    size_t count = 0;
+    generic.allPrefixes(path.begin(), path.end(), [&count](size_t, int&) {
+        count++;
+    });
+    EXPECT_EQ(2u, count);
+
+    // The optimistic walk gives the same answers
+    TrieMap<char, int, OlcPolicy> olc(GetParam());
+    olc.insert("h", 1);
+    olc.insert("ham", 3);
+    olc.insert("hamster", 7);
+    EXPECT_TRUE(olc.longestPrefixFindValue(b, b + 6, value, &length));
+    EXPECT_EQ(3, value);
+    EXPECT_EQ(3u, length);
+    EXPECT_FALSE(olc.longestPrefixFindValue(b + 1, b + 6, value));
+}
+
+TEST(TrieCidrMapTest, random_model) {
+    struct Route {
+        uint32_t prefix;
+        unsigned length;
+        int value;
+    };
+    std::mt19937 gen(47);
+    std::vector<Route> routes;
+    TrieCidrMap<int> table(4);
+    auto bytesOf = [](uint32_t address, uint8_t* bytes) {
+        for (int i = 0; i < 4; i++) {
+            bytes[i] = static_cast<uint8_t>(address >> (24 - 8 * i));
+        }
+    };
+    auto mask = [](unsigned length) {
+        return length ? ~uint32_t(0) << (32 - length) : 0;
+    };
+    // Addresses clustered in 10.x.x.x so the routes overlap a lot
+    auto randomAddress = [&gen]() {
+        return (uint32_t(10) << 24) | (gen() & 0x00ff00ff);
+    };
+
+    uint8_t bytes[4];
+    for (int op = 0; op < 3000; op++) {
+        if (op % 3 == 2 && !routes.empty()) {
+            size_t i = gen() % routes.size();
+            bytesOf(routes[i].prefix, bytes);
+            EXPECT_TRUE(table.erase(bytes, routes[i].length));
+            routes.erase(routes.begin() + i);
+        } else {
+            Route route;
+            route.length = gen() % 33;
+            route.prefix = randomAddress() & mask(route.length);
+            route.value = op;
+            routes.erase(std::remove_if(routes.begin(), routes.end(), [&route](const Route& r) {
+                             return r.prefix == route.prefix && r.length == route.length;
+                         }), routes.end());
+            routes.push_back(route);
+            bytesOf(route.prefix, bytes);
+            table.insert(bytes, route.length, route.value);
+        }
+        ASSERT_EQ(routes.size(), table.size());
+
+        for (int lookup = 0; lookup < 20; lookup++) {
+            uint32_t address = randomAddress();
+            const Route* best = nullptr;
+            for (const Route& r : routes) {
+                if ((address & mask(r.length)) == r.prefix && (!best || r.length > best->length)) {
+                    best = &r;
+                }
+            }
+            bytesOf(address, bytes);
+            int value = 0;
+            unsigned length = 0;
+            ASSERT_EQ(best != nullptr, table.find(bytes, value, &length));
+            if (best) {
+                EXPECT_EQ(best->value, value);
+                EXPECT_EQ(best->length, length);
+            }
+        }
+    }
+
+    EXPECT_THROW(table.insert(bytes, 33, 0), std::invalid_argument);
+    EXPECT_FALSE(table.erase(bytes, 33));
+    EXPECT_THROW(TrieCidrMap<int>(17), std::invalid_argument);
+}
+
+// optimistic lookups (through a const table) whilst one writer adds and
+// removes a more specific route, the answer is always one of the two
+TEST(TrieCidrMapTest, olc_concurrent_lookups) {
+    TrieCidrMap<uint64_t, OlcPolicy> table(4);
+    const uint8_t wide[4] = {10, 1, 0, 0};
+    const uint8_t narrow[4] = {10, 1, 2, 0};
+    table.insert(wide, 16, 16);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::thread writer([&table, &narrow]() {
+        for (int op = 0; op < 5000; op++) {
+            table.insert(narrow, 24, 24);
+            table.erase(narrow, 24);
+        }
+    });
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; r++) {
+        readers.emplace_back([&table = std::as_const(table), &done, &failures]() {
+            const uint8_t address[4] = {10, 1, 2, 3};
+            while (!done) {
+                uint64_t value = 0;
+                unsigned length = 0;
+                if (!table.find(address, value, &length) ||
+                    (length != 16 && length != 24) || value != length) {
+                    failures++;
+                }
+            }
+        });
+    }
+    writer.join();
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(0, failures);
+    EXPECT_EQ(1u, table.size());
+}
+
+TEST_P(TrieLayoutTest, cursor_model) {
+    TrieMap<char, int, ShardedPolicy> t(GetParam());
+    std::map<std::string, int> model;
+    std::mt19937 gen(53);
+    for (int i = 0; i < 2000; i++) {
+        std::string key = randomKey(gen, "ab\x80\xff", 8);
+        t.insert(key, i);
+        model[key] = i;
+    }
+
+    auto expectRange = [](auto cursor, auto first, auto last) {
+        for (; first != last; ++first) {
+            ASSERT_TRUE(cursor.valid());
+            EXPECT_EQ(first->first, cursor.key());
+            EXPECT_EQ(first->second, cursor.value());
+            cursor.next();
+        }
+        EXPECT_FALSE(cursor.valid());
+    };
+
+    expectRange(t.cursor(), model.begin(), model.end());
+    for (int i = 0; i < 300; i++) {
+        std::string key = randomKey(gen, "ab\x80\xff", 8);
+        const char* b = key.data();
+        const char* e = key.data() + key.size();
+        expectRange(t.lowerBound(b, e), model.lower_bound(key), model.end());
+        expectRange(t.upperBound(b, e), model.upper_bound(key), model.end());
+
+        auto last = model.lower_bound(key);
+        while (last != model.end() && last->first.compare(0, key.size(), key) == 0) {
+            ++last;
+        }
+        expectRange(t.prefixCursor(b, e), model.lower_bound(key), last);
+    }
+
+    // Generic keys are ordered by element, with unordered children
+    TrieMap<int, int> generic(GetParam());
+    std::map<std::vector<int>, int> genericModel;
+    for (int i = 0; i < 500; i++) {
+        std::vector<int> key;
+        size_t length = gen() % 5;
+        for (size_t j = 0; j < length; j++) {
+            key.push_back(static_cast<int>(gen() % 40) - 20);
+        }
+        generic.insert(key, i);
+        genericModel[key] = i;
+    }
+    expectRange(generic.cursor(), genericModel.begin(), genericModel.end());
+    std::vector<int> probe = {3, -7};
+    expectRange(generic.lowerBound(probe.begin(), probe.end()),
+                genericModel.lower_bound(probe), genericModel.end());
+}
+
+TEST_P(TrieLayoutTest, batch_model) {
+    TrieMap<char, int, ShardedPolicy> t(GetParam());
+    Trie<char> keys(GetParam());
+    std::mt19937 gen(59);
+    for (int i = 0; i < 2000; i++) {
+        std::string key = randomKey(gen, "ab\x80\xff", 10);
+        t.insert(key, i);
+        keys.insert(key);
+    }
+    t.insert("", -1);
+
+    // More keys than the batch width, so slots are refilled
+    std::vector<std::string> probes;
+    for (int i = 0; i < 1000; i++) {
+        probes.push_back(randomKey(gen, "ab\x80\xff", 10));
+    }
+    std::unique_ptr<bool[]> found(new bool[probes.size()]);
+    std::vector<int> values(probes.size(), 0);
+    size_t count = t.findBatch(probes.begin(), probes.end(), values.data(), found.get());
+    EXPECT_EQ(count, static_cast<size_t>(std::count(found.get(), found.get() + probes.size(), true)));
+    std::unique_ptr<bool[]> exists(new bool[probes.size()]);
+    keys.existsBatch(probes.begin(), probes.end(), exists.get());
+    std::unique_ptr<bool[]> prefixed(new bool[probes.size()]);
+    keys.prefixExistsBatch(probes.begin(), probes.end(), prefixed.get());
+
+    for (size_t i = 0; i < probes.size(); i++) {
+        const std::string& key = probes[i];
+        const char* b = key.data();
+        const char* e = key.data() + key.size();
+        int value = 0;
+        ASSERT_EQ(t.findValue(b, e, value), found[i]) << key;
+        if (found[i]) {
+            EXPECT_EQ(value, values[i]);
+        }
+        EXPECT_EQ(keys.exists(b, e), exists[i]) << key;
+        EXPECT_EQ(keys.prefixExists(b, e), prefixed[i]) << key;
+    }
+
+    // The optimistic form looks the keys up one at a time
+    Trie<char, OlcPolicy> olc(GetParam());
+    olc.insert("ham");
+    std::vector<std::string> olcProbes = {"ham", "hamster", "ha"};
+    bool olcResults[3];
+    EXPECT_EQ(1u, olc.existsBatch(olcProbes.begin(), olcProbes.end(), olcResults));
+    EXPECT_EQ(2u, olc.prefixExistsBatch(olcProbes.begin(), olcProbes.end(), olcResults));
+    EXPECT_FALSE(olcResults[2]);
+}
+
+
+// The counters (stats(false)) agree with a walk of the trie, and the walk
+// agrees with the keys inserted.
+template <typename T, typename Keys>
+static void checkStats(T& t, const Keys& keys, TrieLayout layout) {
+    TrieStats exact = t.stats();
+    TrieStats counted = t.stats(false);
+    EXPECT_TRUE(exact.exact);
+    EXPECT_FALSE(counted.exact);
+
+    size_t elements = 0;
+    std::vector<size_t> depths;
+    for (auto& key : keys) {
+        elements += key.size();
+        if (depths.size() <= key.size()) {
+            depths.resize(key.size() + 1);
+        }
+        depths[key.size()]++;
+    }
+    EXPECT_EQ(keys.size(), exact.keys);
+    EXPECT_EQ(elements, exact.keyElements);
+    EXPECT_EQ(exact.keys, counted.keys);
+    EXPECT_EQ(exact.keyElements, counted.keyElements);
+    EXPECT_EQ(exact.nodes, counted.nodes);
+    EXPECT_EQ(exact.nodeBytes, counted.nodeBytes);
+    EXPECT_EQ(exact.valueBytes, counted.valueBytes);
+
+    size_t nodes = 0;
+    for (size_t count : exact.fanout) {
+        nodes += count;
+    }
+    EXPECT_EQ(exact.nodes, nodes);
+    size_t depthKeys = 0;
+    for (size_t count : exact.keyDepths) {
+        depthKeys += count;
+    }
+    EXPECT_EQ(exact.keys, depthKeys);
+    if (layout == TrieLayout::Expanded) {
+        // a node per element
+        EXPECT_EQ(depths, exact.keyDepths);
+        EXPECT_EQ(0u, exact.segmentBytes);
+    }
+}
+
+TEST_P(TrieLayoutTest, stats_model) {
+    std::mt19937 gen(61);
+
+    Trie<char> empty(GetParam());
+    TrieStats none = empty.stats();
+    EXPECT_EQ(0u, none.keys);
+    EXPECT_EQ(0u, none.nodes);
+    EXPECT_EQ(0u, none.totalBytes());
+
+    TrieMap<char, int, ShardedPolicy> t(GetParam());
+    Trie<char, OlcPolicy> olc(GetParam());
+    Trie<int> generic(GetParam());
+    std::set<std::string> model;
+    std::set<std::vector<int> > genericModel;
+    for (int i = 0; i < 4000; i++) {
+        std::string key = randomKey(gen, "abc\xff", 12);
+        std::vector<int> genericKey(key.begin(), key.end());
+        if (gen() % 3 == 0) {
+            t.erase(key);
+            olc.erase(key);
+            generic.erase(genericKey);
+            model.erase(key);
+            genericModel.erase(genericKey);
+        } else {
+            t.insert(key, i);
+            olc.insert(key);
+            generic.insert(genericKey);
+            model.insert(key);
+            genericModel.insert(genericKey);
+        }
+    }
+    checkStats(t, model, GetParam());
+    checkStats(olc, model, GetParam());
+    checkStats(generic, genericModel, GetParam());
+
+    TrieStats map = t.stats();
+    EXPECT_EQ(map.nodes * sizeof(int), map.valueBytes);
+    EXPECT_GT(map.childBytes, 0u);
+    EXPECT_GT(map.bytesPerKey(), 0);
+    if (GetParam() == TrieLayout::PathCompressed) {
+        EXPECT_GT(map.segmentBytes, 0u);
+    }
+
+    // A bulk built trie counts the same as one built by insert
+    Trie<char> bulk(GetParam());
+    std::vector<std::string> keys(model.begin(), model.end());
+    keys.push_back(keys.front());
+    bulk.bulkInsert(keys.begin(), keys.end());
+    checkStats(bulk, model, GetParam());
+}
+
+
+// Counts the copies made of it, a value should be moved into the trie
+struct CopyCounted {
+    static int copies;
+
+    CopyCounted(const std::string& s = std::string())
+      : text(s) {}
+
+    CopyCounted(const CopyCounted& other)
+      : text(other.text) {
+        copies++;
+    }
+
+    CopyCounted(CopyCounted&&) = default;
+
+    CopyCounted& operator=(const CopyCounted& other) {
+        text = other.text;
+        copies++;
+        return *this;
+    }
+
+    CopyCounted& operator=(CopyCounted&&) = default;
+
+    std::string text;
+};
+
+int CopyCounted::copies = 0;
+
+TEST_P(TrieLayoutTest, leaf_values_model) {
+    std::mt19937 gen(67);
+
+    // values beyond the inline size, every one a heap allocated string
+    // which leaks (found by the sanitisers) unless the trie destroys it
+    TrieMap<char, std::string> heap(GetParam());
+    TrieMap<char, std::string, ArenaPolicy> arena(GetParam());
+    TrieMap<char, std::string, ShardedPolicy> sharded(GetParam());
+    TrieMap<int, std::string> generic(GetParam());
+    std::map<std::string, std::string> model;
+    for (int i = 0; i < 3000; i++) {
+        std::string key = randomKey(gen, "abc", 10);
+        std::vector<int> genericKey(key.begin(), key.end());
+        if (gen() % 3 == 0) {
+            model.erase(key);
+            heap.erase(key);
+            arena.erase(key);
+            sharded.erase(key);
+            generic.erase(genericKey);
+        } else {
+            std::string value = key + " is a value too long for a short string " +
+                                std::to_string(i);
+            model[key] = value;
+            heap.insert(key, value);
+            arena.insert(key, value);
+            sharded.insert(key, value);
+            generic.insert(genericKey, value);
+        }
+        std::string probe = randomKey(gen, "abc", 10);
+        std::vector<int> genericProbe(probe.begin(), probe.end());
+        auto it = model.find(probe);
+        std::string value;
+        ASSERT_EQ(it != model.end(), heap.findValue(probe, value)) << probe;
+        if (it != model.end()) {
+            EXPECT_EQ(it->second, value);
+            EXPECT_EQ(it->second, *arena.find(probe));
+            EXPECT_EQ(it->second, *sharded.find(probe));
+            EXPECT_EQ(it->second, *generic.find(genericProbe));
+        } else {
+            EXPECT_TRUE(arena.find(probe) == arena.end());
+            EXPECT_TRUE(generic.find(genericProbe) == generic.end());
+        }
+    }
+    std::set<std::string> modelKeys;
+    Trie<char> keys(GetParam());
+    for (auto& kv : model) {
+        modelKeys.insert(kv.first);
+        keys.insert(kv.first);
+    }
+    checkStats(heap, modelKeys, GetParam());
+
+    // the nodes of a Trie, a pointer per node and a value per key
+    TrieStats stats = heap.stats();
+    EXPECT_EQ(keys.stats().nodes, stats.nodes);
+    EXPECT_EQ(stats.nodes * sizeof(TrieNode<char>), stats.nodeBytes);
+    EXPECT_EQ(stats.nodes * sizeof(std::string*) + stats.keys * sizeof(std::string),
+              stats.valueBytes);
+
+    // moved, not copied, into the map and then only copied out
+    TrieMap<char, CopyCounted> moved(GetParam());
+    CopyCounted::copies = 0;
+    moved.insert("hamster", CopyCounted("hamster"));
+    moved.insert("ham", CopyCounted("ham"));
+    moved.insert("hamster", CopyCounted("replaced"));
+    EXPECT_EQ(0, CopyCounted::copies);
+    EXPECT_EQ("replaced", (*moved.find("hamster")).text);
+    moved.erase("hamster");
+    EXPECT_TRUE(moved.find("hamster") == moved.end());
+    EXPECT_EQ("ham", (*moved.find("ham")).text);
+}
+
+
+struct InstrumentedPolicy : DefaultTriePolicy {
+    typedef TrieArenaAllocator Allocator;
+    typedef TrieCountingInstrumentation Instrumentation;
+};
+
+struct OlcInstrumentedPolicy : OlcPolicy {
+    typedef TrieCountingInstrumentation Instrumentation;
+};
+
+static uint64_t latencyTotal(const TrieOpCounters& counters) {
+    uint64_t total = 0;
+    for (uint64_t count : counters.latency) {
+        total += count;
+    }
+    return total;
+}
+
+TEST(TrieInstrumentTest, counts) {
+    static_assert(!DefaultTriePolicy::Instrumentation::enabled,
+                  "instrumentation is opt in");
+    static_assert(std::is_empty<TrieNoInstrumentation>::value,
+                  "no instrumentation has no state");
+
+    // Expanded, so a walk visits a node per element
+    TrieMap<char, int, InstrumentedPolicy> t(TrieLayout::Expanded);
+    t.insert("ham", 1);
+    t.insert("hamster", 2);
+    t.insert("jam", 3);
+    TrieOpCounters inserts = t.getInstrumentation().read(TrieOp::Insert);
+    EXPECT_EQ(3u, inserts.operations);
+    // "hamster" walks h, a, m and misses s
+    EXPECT_EQ(1u + 4u + 1u, inserts.nodes);
+    // at least a node per new element
+    EXPECT_GE(inserts.allocations, 3u + 4u + 3u);
+    EXPECT_EQ(3u, latencyTotal(inserts));
+
+    int value = 0;
+    EXPECT_TRUE(t.findValue("hamster", "hamster" + 7, value));
+    EXPECT_FALSE(t.findValue("ha", "ha" + 2, value));
+    EXPECT_FALSE(t.findValue("x", "x" + 1, value));
+    TrieOpCounters finds = t.getInstrumentation().read(TrieOp::Find);
+    EXPECT_EQ(3u, finds.operations);
+    EXPECT_EQ(7u + 2u + 1u, finds.nodes);
+    EXPECT_EQ(0u, finds.allocations);
+    EXPECT_EQ(3u, latencyTotal(finds));
+    EXPECT_GT(finds.latencyPercentile(100), 0u);
+
+    EXPECT_TRUE(t.prefixFindValue("hamsters", "hamsters" + 8, value));
+    EXPECT_EQ(1u, t.getInstrumentation().read(TrieOp::PrefixFind).operations);
+    EXPECT_EQ(3u, t.getInstrumentation().read(TrieOp::PrefixFind).nodes);
+
+    // a batch counts every key as a lookup, and the nodes each walks
+    std::vector<std::string> batch = {"hamster", "ha", "x", "hamsters"};
+    int values[4];
+    bool found[4];
+    EXPECT_EQ(1u, t.findBatch(batch.begin(), batch.end(), values, found));
+    finds = t.getInstrumentation().read(TrieOp::Find);
+    EXPECT_EQ(3u + 4u, finds.operations);
+    // "hamsters" searches the r node for s too
+    EXPECT_EQ(10u + 7u + 2u + 1u + 8u, finds.nodes);
+    EXPECT_EQ(finds.operations, latencyTotal(finds));
+
+    Trie<char, InstrumentedPolicy> set(TrieLayout::Expanded);
+    set.insert("ham");
+    set.insert("hamster");
+    EXPECT_EQ(2u, set.prefixExistsBatch(batch.begin(), batch.end(), found));
+    TrieOpCounters prefixes = set.getInstrumentation().read(TrieOp::PrefixFind);
+    EXPECT_EQ(4u, prefixes.operations);
+    // "ham" ends the walks of hamster and hamsters
+    EXPECT_EQ(3u + 2u + 1u + 3u, prefixes.nodes);
+
+    t.erase("jam");
+    TrieOpCounters erases = t.getInstrumentation().read(TrieOp::Erase);
+    EXPECT_EQ(1u, erases.operations);
+    EXPECT_EQ(3u, erases.nodes);
+
+    // each thread counts in its own slot, read adds them up
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&t]() {
+            int v = 0;
+            for (int j = 0; j < 1000; j++) {
+                t.findValue("ham", "ham" + 3, v);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    finds = t.getInstrumentation().read(TrieOp::Find);
+    EXPECT_EQ(7u + 4000u, finds.operations);
+    EXPECT_EQ(28u + 4000u * 3u, finds.nodes);
+    EXPECT_EQ(finds.operations, latencyTotal(finds));
+
+    // The optimistic paths are counted too
+    Trie<char, OlcInstrumentedPolicy> olc(TrieLayout::Expanded);
+    olc.insert("ham");
+    EXPECT_TRUE(olc.exists("ham", "ham" + 3));
+    EXPECT_TRUE(olc.prefixExists("hamster", "hamster" + 7));
+    bool olcFound[4];
+    EXPECT_EQ(0u, olc.existsBatch(batch.begin(), batch.end(), olcFound));
+    olc.erase("ham");
+    EXPECT_EQ(1u, olc.getInstrumentation().read(TrieOp::Insert).operations);
+    EXPECT_EQ(1u + 4u, olc.getInstrumentation().read(TrieOp::Find).operations);
+    // "hamster" and "hamsters" search the m node for s
+    EXPECT_EQ(3u + 4u + 2u + 1u + 4u, olc.getInstrumentation().read(TrieOp::Find).nodes);
+    EXPECT_EQ(1u, olc.getInstrumentation().read(TrieOp::PrefixFind).operations);
+    EXPECT_EQ(1u, olc.getInstrumentation().read(TrieOp::Erase).operations);
+}
+
+// Percentiles against the sorted samples, to within a bucket, and merged
+// histograms against one which recorded everything.
+TEST(TrieHistogramTest, percentiles_and_merge) {
+    TrieHistogram empty;
+    EXPECT_EQ(0u, empty.count());
+    EXPECT_EQ(0u, empty.percentile(50));
+    EXPECT_EQ(0u, empty.min());
+    EXPECT_EQ(0.0, empty.stddev());
+
+    std::mt19937_64 gen(7);
+    std::lognormal_distribution<double> latency(7, 1.5);
+    std::vector<uint64_t> samples;
+    TrieHistogram all;
+    TrieHistogram parts[4];
+    for (int i = 0; i < 100000; i++) {
+        uint64_t value = static_cast<uint64_t>(latency(gen));
+        if (i % 1000 == 0) {
+            value = uint64_t(1) << (20 + i % 30); // past the last bucket too
+        }
+        samples.push_back(value);
+        all.record(value);
+        parts[i % 4].record(value);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    EXPECT_EQ(samples.size(), all.count());
+    EXPECT_EQ(samples.front(), all.min());
+    EXPECT_EQ(samples.back(), all.max());
+    for (double p : {1.0, 25.0, 50.0, 90.0, 99.0, 99.9, 100.0}) {
+        // the ceil(count * p / 100)'th smallest
+        const size_t rank = size_t(std::ceil(samples.size() * p / 100));
+        const uint64_t exact = samples[rank ? rank - 1 : 0];
+        const uint64_t value = all.percentile(p);
+        if (exact < (uint64_t(1) << TrieHistogram::maxBits)) {
+            EXPECT_LE(exact, value) << p;
+            EXPECT_LE(value, exact + exact / 128) << p;
+        } else {
+            EXPECT_EQ(samples.back(), value) << p;
+        }
+    }
+    for (uint64_t v : {0ull, 100ull, 1000ull, 10000ull}) {
+        const uint64_t exact = std::lower_bound(samples.begin(), samples.end(), v) - samples.begin();
+        const uint64_t low = std::lower_bound(samples.begin(), samples.end(), v - v / 128) - samples.begin();
+        EXPECT_LE(low, all.countBelow(v)) << v;
+        EXPECT_LE(all.countBelow(v), exact) << v;
+    }
+
+    double mean = 0;
+    for (uint64_t v : samples) {
+        mean += double(v) / samples.size();
+    }
+    double squares = 0;
+    for (uint64_t v : samples) {
+        squares += (v - mean) * (v - mean);
+    }
+    EXPECT_NEAR(mean, all.mean(), mean * 1e-9);
+    EXPECT_NEAR(std::sqrt(squares / (samples.size() - 1)), all.stddev(), all.stddev() * 1e-6);
+
+    TrieHistogram merged;
+    for (auto& part : parts) {
+        merged.merge(part);
+    }
+    EXPECT_EQ(all.count(), merged.count());
+    EXPECT_EQ(all.min(), merged.min());
+    EXPECT_EQ(all.max(), merged.max());
+    for (double p = 0; p <= 100; p += 0.5) {
+        EXPECT_EQ(all.percentile(p), merged.percentile(p)) << p;
+    }
+
+    merged.clear();
+    EXPECT_EQ(0u, merged.count());
+    EXPECT_EQ(0u, merged.max());
+}
+
+// HatTrieMap against a std::map, with a small burst size so buckets
+// burst many levels down, keys long enough for two byte lengths and
+// keys which prefix one another.
+TEST(HatTrieTest, random_model) {
+    for (size_t burstSize : {size_t(1), size_t(8), HatTrie::defaultBurstSize}) {
+        std::mt19937 gen(53);
+        std::map<std::string, int> model;
+        HatTrieMap<int> map(burstSize);
+        HatTrie set(burstSize);
+        auto randomKey = [&gen]() {
+            static const char* stems[] = {"ham", "hamster", "hat", "h", "x\xff\x80"};
+            std::string key = stems[gen() % 5];
+            if (gen() % 8 == 0) {
+                key += std::string(130 + gen() % 20, 'b');
+            }
+            size_t extra = gen() % 4;
+            for (size_t i = 0; i < extra; i++) {
+                key.push_back(static_cast<char>('a' + gen() % 4));
+            }
+            return key;
+        };
+
+        for (int op = 0; op < 4000; op++) {
+            const std::string key = randomKey();
+            if (op % 3 == 2) {
+                model.erase(key);
+                map.erase(key);
+                set.erase(key);
+            } else {
+                model[key] = op;
+                map.insert(key, op);
+                set.insert(key);
+            }
+            ASSERT_EQ(model.size(), map.size());
+            ASSERT_EQ(model.size(), set.size());
+
+            const std::string probe = randomKey();
+            const char* b = probe.data();
+            const char* e = b + probe.size();
+            auto it = model.find(probe);
+            int value = -1;
+            ASSERT_EQ(it != model.end(), map.findValue(b, e, value)) << probe;
+            ASSERT_EQ(it != model.end(), set.exists(b, e)) << probe;
+            if (it != model.end()) {
+                EXPECT_EQ(it->second, value);
+            }
+
+            // the shortest (non empty) key which prefixes probe
+            const std::pair<const std::string, int>* shortest = nullptr;
+            for (size_t length = 1; length <= probe.size() && !shortest; length++) {
+                auto p = model.find(probe.substr(0, length));
+                if (p != model.end()) {
+                    shortest = &*p;
+                }
+            }
+            ASSERT_EQ(shortest != nullptr, map.prefixFindValue(b, e, value)) << probe;
+            ASSERT_EQ(shortest != nullptr, set.prefixExists(b, e)) << probe;
+            if (shortest) {
+                EXPECT_EQ(shortest->second, value);
+            }
+        }
+        if (burstSize == 1) {
+            EXPECT_LT(1u, map.getNodeCount());
+        } else if (burstSize == HatTrie::defaultBurstSize) {
+            EXPECT_EQ(0u, map.getNodeCount());
+        }
+        EXPECT_LT(0u, map.getMemoryBytes());
+
+        for (auto& item : model) {
+            map.erase(item.first);
+            set.erase(item.first);
+            EXPECT_FALSE(set.exists(item.first.data(), item.first.data() + item.first.size()));
+        }
+        EXPECT_EQ(0u, map.size());
+        EXPECT_EQ(0u, set.size());
+    }
+}
+
+TEST(TrieIntMapTest, random_model) {
+    for (TrieLayout layout : {TrieLayout::Expanded, TrieLayout::PathCompressed}) {
+        std::mt19937_64 gen(59);
+        std::map<int64_t, int> model;
+        TrieIntMap<int64_t, int> map(layout);
+        TrieIntSet<uint32_t> set(layout);
+        std::set<uint32_t> setModel;
+        auto randomKey = [&gen]() {
+            // clustered around 0 (either sign) and the extremes
+            int64_t key = static_cast<int64_t>(gen() % 512) - 256;
+            switch (gen() % 4) {
+            case 0:
+                return key;
+            case 1:
+                return key + std::numeric_limits<int64_t>::max() - 255;
+            case 2:
+                return key + std::numeric_limits<int64_t>::min() + 256;
+            }
+            return key * 1000003;
+        };
+
+        for (int op = 0; op < 4000; op++) {
+            const int64_t key = randomKey();
+            if (op % 3 == 2) {
+                model.erase(key);
+                map.erase(key);
+                set.erase(static_cast<uint32_t>(key));
+                setModel.erase(static_cast<uint32_t>(key));
+            } else {
+                model[key] = op;
+                map.insert(key, op);
+                set.insert(static_cast<uint32_t>(key));
+                setModel.insert(static_cast<uint32_t>(key));
+            }
+            const int64_t probe = randomKey();
+            int value = -1;
+            auto it = model.find(probe);
+            ASSERT_EQ(it != model.end(), map.findValue(probe, value)) << probe;
+            ASSERT_EQ(it != model.end(), map.find(probe) != map.end()) << probe;
+            if (it != model.end()) {
+                EXPECT_EQ(it->second, value);
+            }
+            ASSERT_EQ(setModel.count(static_cast<uint32_t>(probe)) == 1,
+                      set.exists(static_cast<uint32_t>(probe)));
+        }
+        EXPECT_EQ(model.size(), map.size());
+
+        // more than one batch of keys, hits and misses
+        std::vector<int64_t> probes;
+        for (int i = 0; i < 300; i++) {
+            probes.push_back(randomKey());
+        }
+        std::vector<int> values(probes.size(), -1);
+        std::unique_ptr<bool[]> found(new bool[probes.size()]);
+        size_t hits = map.findBatch(probes.begin(), probes.end(), values.data(), found.get());
+        size_t expectedHits = 0;
+        for (size_t i = 0; i < probes.size(); i++) {
+            auto it = model.find(probes[i]);
+            ASSERT_EQ(it != model.end(), found[i]) << probes[i];
+            if (found[i]) {
+                EXPECT_EQ(it->second, values[i]);
+                expectedHits++;
+            }
+        }
+        EXPECT_EQ(expectedHits, hits);
+
+        // ordered as integers, signed and unsigned
+        typedef std::vector<std::pair<int64_t, int> > Pairs;
+        Pairs all;
+        map.forEach([&all](int64_t key, int& value) {
+            all.push_back(std::make_pair(key, value));
+        });
+        EXPECT_EQ(Pairs(model.begin(), model.end()), all);
+
+        for (int i = 0; i < 50; i++) {
+            int64_t low = randomKey();
+            int64_t high = randomKey();
+            if (high < low) {
+                std::swap(low, high);
+            }
+            std::vector<int64_t> keys;
+            map.range(low, high, [&keys](int64_t key, int&) {
+                keys.push_back(key);
+            });
+            std::vector<int64_t> expected;
+            for (auto m = model.lower_bound(low); m != model.end() && m->first <= high; ++m) {
+                expected.push_back(m->first);
+            }
+            EXPECT_EQ(expected, keys);
+
+            std::vector<uint32_t> setKeys;
+            set.range(static_cast<uint32_t>(low), static_cast<uint32_t>(high),
+                      [&setKeys](uint32_t key) {
+                setKeys.push_back(key);
+            });
+            std::vector<uint32_t> setExpected;
+            for (auto m = setModel.lower_bound(static_cast<uint32_t>(low));
+                 m != setModel.end() && *m <= static_cast<uint32_t>(high); ++m) {
+                setExpected.push_back(*m);
+            }
+            EXPECT_EQ(setExpected, setKeys);
+        }
+    }
+
+    // a composite key orders by each member in turn
+    typedef std::tuple<uint16_t, int32_t, uint64_t> Composite;
+    EXPECT_EQ(14u, TrieIntKey<Composite>::bytes);
+    std::map<Composite, int> model;
+    TrieIntMap<Composite, int> composite;
+    std::mt19937 gen(61);
+    for (int i = 0; i < 500; i++) {
+        Composite key(gen() % 4, static_cast<int32_t>(gen() % 7) - 3, gen() % 5);
+        model[key] = i;
+        composite.insert(key, i);
+    }
+    typedef std::vector<std::pair<Composite, int> > Pairs;
+    Pairs all;
+    composite.forEach([&all](const Composite& key, int& value) {
+        all.push_back(std::make_pair(key, value));
+    });
+    EXPECT_EQ(Pairs(model.begin(), model.end()), all);
+    size_t inRange = 0;
+    composite.range(Composite(1, -1, 0), Composite(2, 0, 0), [&inRange](const Composite&, int&) {
+        inRange++;
+    });
+    EXPECT_EQ(static_cast<size_t>(std::distance(model.lower_bound(Composite(1, -1, 0)),
+                                                model.upper_bound(Composite(2, 0, 0)))),
+              inRange);
+}
+
+// Counts the heap allocations made whilst a CountAllocations is alive
+static std::atomic<bool> countingAllocations(false);
+static std::atomic<size_t> allocationCount(0);
+
+void* operator new(size_t size) {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// std::get_temporary_buffer (std::stable_sort) allocates with this one
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    if (countingAllocations) {
+        allocationCount++;
+    }
+    return std::malloc(size ? size : 1);
+}
+
+// not inlined, where gcc would see free() of a new'd pointer and warn
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+class CountAllocations {
+public:
+    CountAllocations() {
+        allocationCount = 0;
+        countingAllocations = true;
+    }
+
+    ~CountAllocations() {
+        countingAllocations = false;
+    }
+
+    size_t count() const {
+        return allocationCount;
+    }
+};
+
+TEST_P(TrieLayoutTest, no_allocations) {
+    const std::vector<std::string> words = {"hamster", "ham", "hamburger", "cat", "catalog"};
+    Trie<char> set(GetParam());
+    TrieMap<char, int> map(GetParam());
+    TrieMap<char, int, OlcPolicy> olc(GetParam());
+    set.bulkInsert(words.begin(), words.end());
+    for (size_t i = 0; i < words.size(); i++) {
+        map.insert(words[i], static_cast<int>(i));
+        olc.insert(words[i], static_cast<int>(i));
+    }
+    Trie<int> ints(GetParam());
+    TrieMap<int, int> intMap(GetParam());
+    std::vector<int> stored = {4, 8, 15, 16, 23, 42};
+    ints.insert(stored);
+    intMap.insert(stored, 1);
+    ints.insert({4, 8});
+    intMap.insert({4, 8}, 2);
+    TrieIntMap<uint64_t, int> intKeys;
+    intKeys.insert(1234567, 1);
+
+    // a key in the middle of a caller's buffer
+    const char buffer[] = "xxhamsterxx";
+    const std::string_view hamster(buffer + 2, 7);
+    const int array[] = {4, 8, 15, 16, 23, 42};
+    size_t found = 0;
+    size_t allocations;
+    {
+        CountAllocations counter;
+        int value = 0;
+        found += set.exists(hamster);
+        found += set.exists(buffer + 2, buffer + 5);
+        found += set.prefixExists("catalogue");
+        found += map.findValue(hamster, value);
+        found += map.find(std::string_view("cat")) != map.end();
+        found += map.prefixFindValue(hamster, value);
+        found += map.longestPrefixFindValue("hamburgers", value);
+        found += olc.findValue(hamster, value);
+        found += ints.exists(array);
+        found += ints.exists(TrieKeySpan<int>(array, 2));
+        found += ints.exists(stored.begin(), stored.begin() + 2);
+        found += intMap.find(array) != intMap.end();
+        found += intMap.prefixFind(TrieKeySpan<int>(array + 0, 3)) != intMap.end();
+        found += intKeys.findValue(1234567, value);
+
+        // updating an existing key only writes its value
+        map.insert(hamster, 10);
+        olc.insert(hamster, 10);
+        set.insert(std::string_view(buffer + 2, 3));
+        ints.insert(TrieKeySpan<int>(array, 2));
+        intMap.insert(array, 10);
+        intKeys.insert(1234567, 10);
+        allocations = counter.count();
+    }
+    EXPECT_EQ(0u, allocations);
+    EXPECT_EQ(14u, found);
+
+    int value = 0;
+    EXPECT_TRUE(map.findValue(std::string_view("hamster"), value));
+    EXPECT_EQ(10, value);
+    EXPECT_TRUE(olc.findValue(std::string_view("hamster"), value));
+    EXPECT_EQ(10, value);
+    EXPECT_EQ(10, *intMap.find(stored));
+    EXPECT_EQ(2, *intMap.find({4, 8}));
+    EXPECT_TRUE(intKeys.findValue(1234567, value));
+    EXPECT_EQ(10, value);
+
+    // erase with a view of the caller's buffer
+    map.erase(hamster);
+    ints.erase(array);
+    EXPECT_FALSE(map.findValue(std::string_view("hamster"), value));
+    EXPECT_TRUE(map.findValue(std::string_view("ham"), value));
+    EXPECT_FALSE(ints.exists(stored));
+    EXPECT_TRUE(ints.exists({4, 8}));
+}
+
 /*
 TEST_F(TrieTest, insert_2_exists_b) {
     Trie<char> t;
@@ -0,0 +1,433 @@
+/**
+    YCSB style mixed workload driver for Trie/TrieMap.
+
+    Threads run a mix of reads, inserts, erases and prefix lookups over
+    a key space from trie_dataset.h for a fixed time, with uniform or
+    Zipfian key popularity. Each run reports the aggregate and per thread
+    ops/s and latency percentiles of every operation.
+
+        trie_ycsb [--dataset words|urls|binary|integers|ip_prefixes]
+                  [--keys N] [--load FRACTION]
+                  [--read PCT] [--insert PCT] [--erase PCT] [--prefix PCT]
+                  [--zipf THETA | --uniform]
+                  [--threads N[,N...]] [--pin] [--duration SECONDS]
+                  [--locking mutex|sharded|optimistic|all] [--map]
+
+    The mix percentages are relative weights, THETA is greater than 0
+    and less than 1. The defaults (90% read, 5%
+    insert, 5% erase, Zipfian 0.99, every locking from 1 thread up to the
+    number of cores) measure how far each locking scales, starting with
+    the single mutex of TrieMutexLocking.
+
+    Jim Walker (jim.w.walker@gmail.com)
+**/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "utilities/trie.h"
+#include "utilities/trie_dataset.h"
+#include "utilities/trie_histogram.h"
+#include "platform/platform.h"
+
+struct Options {
+    TrieDataset dataset = TrieDataset::Words;
+    size_t keys = 100000;
+    double load = 0.5;
+    // percentages of read, insert, erase, prefix
+    double mix[4] = {90, 5, 5, 0};
+    double theta = 0.99;
+    std::vector<int> threads;
+    bool pin = false;
+    double duration = 5;
+    std::string locking = "all";
+    bool map = false;
+};
+
+enum Op {
+    Read,
+    Insert,
+    Erase,
+    Prefix,
+    OpCount
+};
+
+static const char* opNames[OpCount] = {"read", "insert", "erase", "prefix"};
+
+/**
+    Zipfian key popularity as YCSB generates it (Gray et al., "Quickly
+    generating billion-record synthetic databases"), O(1) per draw after
+    an O(n) set up. Item 0 is the most popular, callers scatter the items
+    over the key space so the hot keys are not neighbours.
+**/
+class Zipfian {
+public:
+    Zipfian(size_t n, double theta)
+      : n(n),
+        theta(theta) {
+        double zetan = zeta(n);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2) / zetan);
+        half = 1 + std::pow(0.5, theta);
+        this->zetan = zetan;
+    }
+
+    size_t next(std::mt19937_64& gen) const {
+        const double u = (gen() >> 11) * (1.0 / 9007199254740992.0);
+        const double uz = u * zetan;
+        if (uz < 1) {
+            return 0;
+        }
+        if (uz < half) {
+            return 1;
+        }
+        return std::min(n - 1, static_cast<size_t>(n * std::pow(eta * u - eta + 1, alpha)));
+    }
+
+private:
+    double zeta(size_t count) const {
+        double sum = 0;
+        for (size_t i = 1; i <= count; i++) {
+            sum += 1 / std::pow(double(i), theta);
+        }
+        return sum;
+    }
+
+    const size_t n;
+    const double theta;
+    double alpha;
+    double eta;
+    double half;
+    double zetan;
+};
+
+/**
+    The same four operations on a Trie or a TrieMap.
+**/
+template <typename Policy>
+struct SetTarget {
+    explicit SetTarget(TrieLayout layout)
+      : trie(layout) {}
+
+    bool read(const std::string& k) {
+        return trie.exists(k.data(), k.data() + k.size());
+    }
+
+    void insert(const std::string& k, uint64_t) {
+        trie.insert(k);
+    }
+
+    void erase(const std::string& k) {
+        trie.erase(k);
+    }
+
+    bool prefix(const std::string& k) {
+        return trie.prefixExists(k.data(), k.data() + k.size());
+    }
+
+    Trie<char, Policy> trie;
+};
+
+template <typename Policy>
+struct MapTarget {
+    explicit MapTarget(TrieLayout layout)
+      : map(layout) {}
+
+    bool read(const std::string& k) {
+        uint64_t value;
+        return map.findValue(k.data(), k.data() + k.size(), value);
+    }
+
+    void insert(const std::string& k, uint64_t value) {
+        map.insert(k, value);
+    }
+
+    void erase(const std::string& k) {
+        map.erase(k);
+    }
+
+    bool prefix(const std::string& k) {
+        uint64_t value;
+        return map.prefixFindValue(k.data(), k.data() + k.size(), value);
+    }
+
+    TrieMap<char, uint64_t, Policy> map;
+};
+
+struct ShardedPolicy : DefaultTriePolicy {
+    typedef TrieShardedLocking<64> Locking;
+};
+
+struct OptimisticPolicy : DefaultTriePolicy {
+    typedef TrieOptimisticLocking Locking;
+};
+
+/**
+    What one thread did.
+**/
+struct ThreadResult {
+    uint64_t ops = 0;
+    // latency (ns) of each operation, by Op
+    TrieHistogram latency[OpCount];
+};
+
+static void pinThread(std::thread& thread, int index) {
+#ifdef __linux__
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cores, &set);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "could not pin thread %d\n", index);
+    }
+#else
+    (void)thread;
+    (void)index;
+#endif
+}
+
+template <typename Target>
+static void run(const char* name, const Options& options, const std::vector<std::string>& keys, int threads) {
+    Target target(TrieLayout::PathCompressed);
+    const size_t loaded = static_cast<size_t>(keys.size() * options.load);
+    for (size_t i = 0; i < loaded; i++) {
+        target.insert(keys[i], i);
+    }
+
+    // cumulative mix, an op is the first whose bound exceeds a draw
+    double bounds[OpCount];
+    double total = 0;
+    for (int op = 0; op < OpCount; op++) {
+        total += options.mix[op];
+        bounds[op] = total;
+    }
+    const Zipfian zipfian(keys.size(), options.theta > 0 ? options.theta : 0.99);
+
+    std::vector<ThreadResult> results(threads);
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937_64 gen(100 + t);
+            ThreadResult& result = results[t];
+            ready++;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                size_t index = options.theta > 0 ? zipfian.next(gen) : gen() % keys.size();
+                // scatter the popular items over the key space
+                if (options.theta > 0) {
+                    index = (index * 0x9e3779b97f4a7c15ull) % keys.size();
+                }
+                const std::string& key = keys[index];
+                const double draw = (gen() >> 11) * (total / 9007199254740992.0);
+                int op = 0;
+                while (op < OpCount - 1 && draw >= bounds[op]) {
+                    op++;
+                }
+
+                const hrtime_t start = gethrtime();
+                switch (op) {
+                case Read:
+                    target.read(key);
+                    break;
+                case Insert:
+                    target.insert(key, index);
+                    break;
+                case Erase:
+                    target.erase(key);
+                    break;
+                case Prefix:
+                    target.prefix(key);
+                    break;
+                }
+                result.latency[op].record(gethrtime() - start);
+                result.ops++;
+            }
+        });
+        if (options.pin) {
+            pinThread(workers.back(), t);
+        }
+    }
+    while (ready != threads) {
+        std::this_thread::yield();
+    }
+
+    const hrtime_t start = gethrtime();
+    go = true;
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+    stop = true;
+    for (auto& w : workers) {
+        w.join();
+    }
+    const double seconds = (gethrtime() - start) / 1e9;
+
+    uint64_t ops = 0;
+    std::string perThread;
+    for (auto& result : results) {
+        ops += result.ops;
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%s%.02f", perThread.empty() ? "" : " ", result.ops / seconds / 1e6);
+        perThread += buffer;
+    }
+    printf("%-11s %7d %9.02f   [%s]\n", name, threads, ops / seconds / 1e6, perThread.c_str());
+
+    for (int op = 0; op < OpCount; op++) {
+        TrieHistogram all;
+        for (auto& result : results) {
+            all.merge(result.latency[op]);
+        }
+        if (!all.count()) {
+            continue;
+        }
+        printf("    %-7s %10llu ops  p50 %6llu  p90 %6llu  p99 %7llu  p99.9 %8llu  max %9llu  stddev %8.0f ns\n",
+               opNames[op], (unsigned long long)all.count(),
+               (unsigned long long)all.percentile(50), (unsigned long long)all.percentile(90),
+               (unsigned long long)all.percentile(99), (unsigned long long)all.percentile(99.9),
+               (unsigned long long)all.max(), all.stddev());
+    }
+}
+
+template <template <typename> class Target>
+static void runLockings(const Options& options, const std::vector<std::string>& keys, int threads) {
+    if (options.locking == "all" || options.locking == "mutex") {
+        run<Target<DefaultTriePolicy> >("mutex", options, keys, threads);
+    }
+    if (options.locking == "all" || options.locking == "sharded") {
+        run<Target<ShardedPolicy> >("sharded", options, keys, threads);
+    }
+    if (options.locking == "all" || options.locking == "optimistic") {
+        run<Target<OptimisticPolicy> >("optimistic", options, keys, threads);
+    }
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--dataset words|urls|binary|integers|ip_prefixes] [--keys N]\n"
+            "          [--load FRACTION] [--read PCT] [--insert PCT] [--erase PCT]\n"
+            "          [--prefix PCT] [--zipf THETA | --uniform] [--threads N[,N...]]\n"
+            "          [--pin] [--duration SECONDS] [--locking mutex|sharded|optimistic|all]\n"
+            "          [--map]\n",
+            program);
+    exit(1);
+}
+
+static Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+            }
+            return argv[++i];
+        };
+        if (arg == "--dataset") {
+            const std::string name = value();
+            bool known = false;
+            for (int d = 0; d <= int(TrieDataset::IpPrefixes); d++) {
+                if (name == trieDatasetName(TrieDataset(d))) {
+                    options.dataset = TrieDataset(d);
+                    known = true;
+                }
+            }
+            if (!known) {
+                usage(argv[0]);
+            }
+        } else if (arg == "--keys") {
+            options.keys = std::stoull(value());
+        } else if (arg == "--load") {
+            options.load = std::stod(value());
+        } else if (arg == "--read") {
+            options.mix[Read] = std::stod(value());
+        } else if (arg == "--insert") {
+            options.mix[Insert] = std::stod(value());
+        } else if (arg == "--erase") {
+            options.mix[Erase] = std::stod(value());
+        } else if (arg == "--prefix") {
+            options.mix[Prefix] = std::stod(value());
+        } else if (arg == "--zipf") {
+            options.theta = std::stod(value());
+            // the Zipfian generator's formula only holds for 0 < theta < 1
+            if (!(options.theta > 0 && options.theta < 1)) {
+                fprintf(stderr, "--zipf THETA must be greater than 0 and less than 1\n");
+                usage(argv[0]);
+            }
+        } else if (arg == "--uniform") {
+            options.theta = 0;
+        } else if (arg == "--threads") {
+            const std::string list = value();
+            size_t pos = 0;
+            while (pos < list.size()) {
+                size_t comma = list.find(',', pos);
+                options.threads.push_back(std::max(1, std::stoi(list.substr(pos, comma - pos))));
+                pos = comma == std::string::npos ? list.size() : comma + 1;
+            }
+        } else if (arg == "--pin") {
+            options.pin = true;
+        } else if (arg == "--duration") {
+            options.duration = std::stod(value());
+        } else if (arg == "--locking") {
+            options.locking = value();
+        } else if (arg == "--map") {
+            options.map = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (options.threads.empty()) {
+        for (int t = 1; t <= int(std::max(1u, std::thread::hardware_concurrency())); t++) {
+            options.threads.push_back(t);
+        }
+    }
+    if (options.mix[Read] + options.mix[Insert] + options.mix[Erase] + options.mix[Prefix] <= 0) {
+        usage(argv[0]);
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    const Options options = parseOptions(argc, argv);
+    const std::vector<std::string> keys = trieDatasetKeys(options.dataset, options.keys, 1);
+    if (keys.empty()) {
+        fprintf(stderr, "no keys for dataset %s\n", trieDatasetName(options.dataset));
+        return 1;
+    }
+
+    printf("ycsb: %s %s, %zu keys (%.0f%% loaded), read %.0f%% insert %.0f%% erase %.0f%% prefix %.0f%%, ",
+           options.map ? "TrieMap" : "Trie", trieDatasetName(options.dataset), keys.size(),
+           options.load * 100, options.mix[Read], options.mix[Insert], options.mix[Erase],
+           options.mix[Prefix]);
+    if (options.theta > 0) {
+        printf("zipf %.02f, ", options.theta);
+    } else {
+        printf("uniform, ");
+    }
+    printf("%.01f s per run%s\n", options.duration, options.pin ? ", pinned" : "");
+    printf("%-11s %7s %9s   %s\n", "locking", "threads", "Mops/s", "[Mops/s per thread]");
+
+    for (int threads : options.threads) {
+        if (options.map) {
+            runLockings<MapTarget>(options, keys, threads);
+        } else {
+            runLockings<SetTarget>(options, keys, threads);
+        }
+    }
+    return 0;
+}
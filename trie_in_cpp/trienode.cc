@@ -1,16 +1,267 @@
-
-template <typename K>
-TrieNode<K>* TrieNode<K>::findChild(K id) {
+template <typename K, typename Node, bool Packed>
+Node* TrieNodeChildren<K, Node, Packed>::find(K id) {
     auto itr = children.find(id);
     if (itr != children.end()) {
-        return itr->second.get();
+        return itr->second;
+    }
+    return nullptr;
+}
+
+template <typename K, typename Node, bool Packed>
+template <typename Allocator>
+void TrieNodeChildren<K, Node, Packed>::add(Node* newNode, Allocator&) {
+    children[newNode->getId()] = newNode;
+}
+
+template <typename K, typename Node, bool Packed>
+template <typename Allocator>
+Node* TrieNodeChildren<K, Node, Packed>::unlink(K id, Allocator&) {
+    auto itr = children.find(id);
+    if (itr == children.end()) {
+        return nullptr;
+    }
+    Node* child = itr->second;
+    children.erase(itr);
+    return child;
+}
+
+template <typename K, typename Node, bool Packed>
+Node* TrieNodeChildren<K, Node, Packed>::replace(Node* newNode) {
+    auto itr = children.find(newNode->getId());
+    if (itr == children.end()) {
+        return nullptr;
+    }
+    Node* old = itr->second;
+    itr->second = newNode;
+    return old;
+}
+
+template <typename K, typename Node, bool Packed>
+Node* TrieNodeChildren<K, Node, Packed>::only() {
+    if (children.size() == 1) {
+        return children.begin()->second;
     }
     return nullptr;
 }
 
+template <typename K, typename Node, bool Packed>
+template <typename Function>
+void TrieNodeChildren<K, Node, Packed>::forEach(Function f) {
+    for (auto& child : children) {
+        f(child.second);
+    }
+}
+
+template <typename K, typename Node>
+int TrieNodeChildren<K, Node, true>::indexOf(K id) const {
+    uint32_t base = 0;
+    uint32_t n = count;
+    if (n > searchWindow) {
+        if (id < keys[0] || keys[n - 1] < id) {
+            return -1;
+        }
+        /**
+         * Integer ids are often spread evenly, so first guess where id
+         * is from the first and last ids and try the window around the
+         * guess. A wide node is then two or three cache misses rather
+         * than one per level of a binary search.
+         */
+        double spread = double(keys[n - 1]) - double(keys[0]);
+        uint32_t guess = static_cast<uint32_t>((double(id) - double(keys[0])) / spread * (n - 1));
+        uint32_t start = guess > searchWindow / 2 ? guess - searchWindow / 2 : 0;
+        start = std::min(start, n - searchWindow);
+        if (id < keys[start]) {
+            n = start;
+        } else if (keys[start + searchWindow - 1] < id) {
+            base = start + searchWindow;
+            n -= base;
+        } else {
+            base = start;
+            n = searchWindow;
+        }
+    }
+    // halve [base, base + n) until the window is left for trieFindKey
+    while (n > searchWindow) {
+        uint32_t half = n / 2;
+        if (keys[base + half] <= id) {
+            base += half;
+            n -= half;
+        } else {
+            n = half;
+        }
+    }
+    int i = trieFindKey(keys + base, static_cast<int>(n), id);
+    return i < 0 ? -1 : static_cast<int>(base) + i;
+}
+
+template <typename K, typename Node>
+Node* TrieNodeChildren<K, Node, true>::find(K id) {
+    if (isInline()) {
+        return (count && singleId == id) ? single : nullptr;
+    }
+    int i = indexOf(id);
+    return i < 0 ? nullptr : childArray()[i];
+}
+
+template <typename K, typename Node>
+template <typename Allocator>
+void TrieNodeChildren<K, Node, true>::add(Node* newNode, Allocator& allocator) {
+    if (count == 0 && isInline()) {
+        single = newNode;
+        singleId = newNode->getId();
+        count = 1;
+        return;
+    }
+
+    if (isInline() || count == capacity) {
+        resize(capacity == 0 ? 4 : capacity < searchWindow ? searchWindow : capacity * 2,
+               allocator);
+    }
+
+    // ids are mostly added in order (bulkInsert sorts), so look for the
+    // insert position from the end
+    const K id = newNode->getId();
+    uint32_t pos = count;
+    if (pos && id < keys[pos - 1]) {
+        pos = static_cast<uint32_t>(std::upper_bound(keys, keys + count, id) - keys);
+    }
+    Node** child = childArray();
+    std::memmove(keys + pos + 1, keys + pos, (count - pos) * sizeof(K));
+    std::memmove(child + pos + 1, child + pos, (count - pos) * sizeof(Node*));
+    keys[pos] = id;
+    child[pos] = newNode;
+    count++;
+}
+
+template <typename K, typename Node>
+template <typename Allocator>
+void TrieNodeChildren<K, Node, true>::reserve(size_t n, Allocator& allocator) {
+    if (count || n <= 1 || n <= capacity) {
+        return;
+    }
+    // the same capacity steps as add takes
+    uint32_t newCapacity = n <= 4 ? 4 : searchWindow;
+    while (newCapacity < n) {
+        newCapacity *= 2;
+    }
+    resize(newCapacity, allocator);
+}
+
+template <typename K, typename Node>
+template <typename Allocator>
+Node* TrieNodeChildren<K, Node, true>::unlink(K id, Allocator& allocator) {
+    if (isInline()) {
+        if (!count || singleId != id) {
+            return nullptr;
+        }
+        Node* detached = single;
+        single = nullptr;
+        count = 0;
+        return detached;
+    }
+
+    int i = indexOf(id);
+    if (i < 0) {
+        return nullptr;
+    }
+    Node** child = childArray();
+    Node* detached = child[i];
+    std::memmove(keys + i, keys + i + 1, (count - i - 1) * sizeof(K));
+    std::memmove(child + i, child + i + 1, (count - i - 1) * sizeof(Node*));
+    count--;
+    if (count <= 1) {
+        resize(0, allocator);
+    } else if (count * 8 <= capacity) {
+        resize(capacity / 4, allocator);
+    }
+    return detached;
+}
+
+template <typename K, typename Node>
+Node* TrieNodeChildren<K, Node, true>::replace(Node* newNode) {
+    if (isInline()) {
+        if (!count || singleId != newNode->getId()) {
+            return nullptr;
+        }
+        Node* old = single;
+        single = newNode;
+        return old;
+    }
+    int i = indexOf(newNode->getId());
+    if (i < 0) {
+        return nullptr;
+    }
+    Node* old = childArray()[i];
+    childArray()[i] = newNode;
+    return old;
+}
+
+template <typename K, typename Node>
+Node* TrieNodeChildren<K, Node, true>::only() {
+    if (count != 1) {
+        return nullptr;
+    }
+    return isInline() ? single : childArray()[0];
+}
+
+template <typename K, typename Node>
+template <typename Function>
+void TrieNodeChildren<K, Node, true>::forEach(Function f) {
+    if (isInline()) {
+        if (count) {
+            f(single);
+        }
+        return;
+    }
+    Node** child = childArray();
+    for (uint32_t i = 0; i < count; i++) {
+        f(child[i]);
+    }
+}
+
+template <typename K, typename Node>
+template <typename Allocator>
+void TrieNodeChildren<K, Node, true>::resize(uint32_t newCapacity,
+                                             Allocator& allocator) {
+    if (newCapacity == 0) {
+        if (isInline()) {
+            return;
+        }
+        Node* remaining = count == 1 ? childArray()[0] : nullptr;
+        K remainingId = count == 1 ? keys[0] : K();
+        allocator.deallocate(keys, blockSize(capacity));
+        single = remaining;
+        singleId = remainingId;
+        capacity = 0;
+        return;
+    }
+
+    K* newKeys = static_cast<K*>(allocator.allocate(blockSize(newCapacity)));
+    Node** newChild = reinterpret_cast<Node**>(reinterpret_cast<char*>(newKeys) +
+                                               childOffset(newCapacity));
+    if (isInline()) {
+        if (count) {
+            newKeys[0] = singleId;
+            newChild[0] = single;
+        }
+    } else {
+        std::copy(keys, keys + count, newKeys);
+        std::copy(childArray(), childArray() + count, newChild);
+        allocator.deallocate(keys, blockSize(capacity));
+    }
+    keys = newKeys;
+    capacity = newCapacity;
+}
+
+template <typename K>
+TrieNode<K>* TrieNode<K>::findChild(K id) {
+    return children.find(id);
+}
+
 template <typename K>
-void TrieNode<K>::addChild(TrieNode* newNode) {
-    children[newNode->getId()] = std::unique_ptr<TrieNode>(newNode);
+template <typename Allocator>
+void TrieNode<K>::addChild(TrieNode* newNode, Allocator& allocator) {
+    children.add(newNode, allocator);
 }
 
 template <typename K>
@@ -19,53 +270,555 @@ bool TrieNode<K>::hasChildren() {
 }
 
 template <typename K>
-void TrieNode<K>::unlinkChild(K id) {
-    children.erase(id);
+template <typename Allocator>
+TrieNode<K>* TrieNode<K>::unlinkChild(K id, Allocator& allocator) {
+    return children.unlink(id, allocator);
 }
 
-TrieNode<char>* TrieNode<char>::findChild(char id) {
-    if (count == 1 && children[0]->getId() == id) {
-        return children[0].get();
-    } else if (count > 1) {
-        return children[id].get();
+template <typename K>
+TrieNode<K>* TrieNode<K>::replaceChild(TrieNode<K>* newNode) {
+    return children.replace(newNode);
+}
+
+template <typename K>
+TrieNode<K>* TrieNode<K>::getOnlyChild() {
+    return children.only();
+}
+
+inline TrieNode<char>::Kind TrieNode<char>::getKind() const {
+    uintptr_t c = trieLoadAcquire(children);
+    if (!c) {
+        return Kind::Empty;
     }
-    return nullptr;
+    return isSingle(c) ? Kind::Single : header(c)->kind;
+}
+
+inline int TrieNode<char>::getChildCount() const {
+    uintptr_t c = trieLoadAcquire(children);
+    if (!c) {
+        return 0;
+    }
+    return isSingle(c) ? 1 : trieLoadRelaxed(header(c)->count);
+}
+
+inline size_t TrieNode<char>::getChildBytes() const {
+    switch (getKind()) {
+    case Kind::Node4:
+        return sizeof(Children4);
+    case Kind::Node16:
+        return sizeof(Children16);
+    case Kind::Node48:
+        return sizeof(Children48);
+    case Kind::Node256:
+        return sizeof(Children256);
+    default:
+        // Empty and Single live in the node's pointer
+        return 0;
+    }
+}
+
+/**
+    An optimistic reader may see a block part way through an update, so
+    counts are clamped to what the block can hold and nothing outside the
+    block is read. The reader's version check discards such a result.
+
+    Everything a writer may change under a reader is loaded atomically
+    (trie_olc.h), a block's kind is fixed before it is linked.
+**/
+inline TrieNode<char>* TrieNode<char>::findChild(char id) {
+    const uint8_t key = static_cast<uint8_t>(id);
+    uintptr_t c = trieLoadAcquire(children);
+    if (!c) {
+        return nullptr;
+    }
+    if (isSingle(c)) {
+        TrieNode<char>* only = single(c);
+        return only->getId() == id ? only : nullptr;
+    }
+    switch (header(c)->kind) {
+    case Kind::Node4: {
+        Children4* b = block<Children4>(c);
+        uint8_t keys[sizeof(b->keys)];
+        loadKeys(b, keys);
+        int count = std::min<int>(trieLoadRelaxed(b->header.count), 4);
+        for (int i = 0; i < count; i++) {
+            if (keys[i] == key) {
+                return trieLoadAcquire(b->child[i]);
+            }
+        }
+        return nullptr;
+    }
+    case Kind::Node16: {
+        Children16* b = block<Children16>(c);
+        uint8_t keys[sizeof(b->keys)];
+        loadKeys(b, keys);
+        int i = trieFindByte16(keys, std::min<int>(trieLoadRelaxed(b->header.count), 16), key);
+        return i < 0 ? nullptr : trieLoadAcquire(b->child[i]);
+    }
+    case Kind::Node48: {
+        Children48* b = block<Children48>(c);
+        uint8_t slot = trieLoadRelaxed(b->index[key]);
+        return slot < 48 ? trieLoadAcquire(b->child[slot]) : nullptr;
+    }
+    case Kind::Node256:
+        return trieLoadAcquire(block<Children256>(c)->child[key]);
+    default:
+        return nullptr;
+    }
+}
+
+template <typename Block, typename Allocator>
+Block* TrieNode<char>::newBlock(Kind kind, Allocator& allocator) {
+    Block* b = trieNew<Block>(allocator);
+    b->header.kind = kind;
+    return b;
 }
 
-void TrieNode<char>::addChild(TrieNode<char>* newNode) {
+/**
+    The writer methods below read the node plainly (there is only one
+    writer) and store atomically to anything a reader can already reach.
+    A new block is filled in plainly and then linked with a release store.
+**/
+template <typename Allocator>
+void TrieNode<char>::addChild(TrieNode<char>* newNode, Allocator& allocator) {
     // validate newNode exists?
-    if (count == 0) {
-        children.push_back(std::unique_ptr<TrieNode<char> >(newNode));
-        count++;
+    if (!children) {
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(newNode) | singleTag);
         return;
-    } else if (count == 1) {
-        children.resize(256);
-        // move 0 to his proper home
-        children[children[0]->getId()] = std::move(children[0]);
     }
-    children[newNode->getId()] = std::unique_ptr<TrieNode<char> >(newNode);
-    count++;
+
+    grow(allocator);
+
+    const uint8_t key = static_cast<uint8_t>(newNode->getId());
+    Header* h = header(children);
+    switch (h->kind) {
+    case Kind::Node4:
+        sortedInsert(block<Children4>(children), h->count, newNode);
+        break;
+    case Kind::Node16:
+        sortedInsert(block<Children16>(children), h->count, newNode);
+        break;
+    case Kind::Node48: {
+        Children48* b = block<Children48>(children);
+        // slots are packed, so slot 'count' is the first free one
+        trieStoreRelease(b->child[h->count], newNode);
+        trieStoreRelaxed(b->index[key], static_cast<uint8_t>(h->count));
+        break;
+    }
+    case Kind::Node256:
+        trieStoreRelease(block<Children256>(children)->child[key], newNode);
+        break;
+    default:
+        assert(false);
+    }
+    trieStoreRelaxed(h->count, static_cast<uint16_t>(h->count + 1));
 }
 
-bool TrieNode<char>::hasChildren() {
-    return count > 0;
+inline bool TrieNode<char>::hasChildren() {
+    return trieLoadRelaxed(children) != 0;
+}
+
+template <typename Allocator>
+TrieNode<char>* TrieNode<char>::unlinkChild(char id, Allocator& allocator) {
+    const uint8_t key = static_cast<uint8_t>(id);
+    TrieNode<char>* child = findChild(id);
+    if (!child) {
+        return nullptr;
+    }
+
+    if (isSingle(children)) {
+        trieStoreRelaxed(children, uintptr_t(0));
+        return child;
+    }
+
+    Header* h = header(children);
+    switch (h->kind) {
+    case Kind::Node4:
+        sortedRemove(block<Children4>(children), h->count, key);
+        break;
+    case Kind::Node16:
+        sortedRemove(block<Children16>(children), h->count, key);
+        break;
+    case Kind::Node48: {
+        // keep the slots packed by moving the last slot into the hole
+        Children48* b = block<Children48>(children);
+        uint8_t slot = b->index[key];
+        uint8_t last = static_cast<uint8_t>(h->count - 1);
+        trieStoreRelaxed(b->index[key], Children48::emptySlot);
+        if (slot != last) {
+            TrieNode<char>* moved = b->child[last];
+            trieStoreRelease(b->child[slot], moved);
+            trieStoreRelaxed(b->index[static_cast<uint8_t>(moved->getId())], slot);
+        }
+        trieStoreRelaxed(b->child[last], static_cast<TrieNode<char>*>(nullptr));
+        break;
+    }
+    case Kind::Node256:
+        trieStoreRelaxed(block<Children256>(children)->child[key],
+                         static_cast<TrieNode<char>*>(nullptr));
+        break;
+    default:
+        assert(false);
+    }
+    trieStoreRelaxed(h->count, static_cast<uint16_t>(h->count - 1));
+    shrink(allocator);
+    return child;
 }
 
-void TrieNode<char>::unlinkChild(char id) {
-    if (count > 1 && children[id]) {
-        count--;
-        children[id].reset(nullptr);
-        if (count == 1) {
-            for (auto& last : children) {
-                if (last.get()) {
-                    children[0] = std::move(last);
-                    children.resize(1);
-                    break;
-                }
+inline TrieNode<char>* TrieNode<char>::replaceChild(TrieNode<char>* newNode) {
+    const uint8_t key = static_cast<uint8_t>(newNode->getId());
+    TrieNode<char>* old = nullptr;
+    if (!children) {
+        return nullptr;
+    }
+    if (isSingle(children)) {
+        old = single(children);
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(newNode) | singleTag);
+        return old;
+    }
+
+    TrieNode<char>** slot = nullptr;
+    Header* h = header(children);
+    switch (h->kind) {
+    case Kind::Node4: {
+        Children4* b = block<Children4>(children);
+        for (int i = 0; i < h->count; i++) {
+            if (b->keys[i] == key) {
+                slot = &b->child[i];
             }
         }
-    } else if (count == 1 && children[0]->getId() == id) {
-        count--;
-        children[0].reset(nullptr);
+        break;
+    }
+    case Kind::Node16: {
+        Children16* b = block<Children16>(children);
+        int i = trieFindByte16(b->keys, h->count, key);
+        slot = i < 0 ? nullptr : &b->child[i];
+        break;
+    }
+    case Kind::Node48: {
+        Children48* b = block<Children48>(children);
+        if (b->index[key] != Children48::emptySlot) {
+            slot = &b->child[b->index[key]];
+        }
+        break;
+    }
+    case Kind::Node256:
+        slot = &block<Children256>(children)->child[key];
+        break;
+    default:
+        break;
+    }
+    if (!slot || !*slot) {
+        return nullptr;
+    }
+    old = *slot;
+    trieStoreRelease(*slot, newNode);
+    return old;
+}
+
+template <typename Allocator>
+void TrieNode<char>::reserveChildren(size_t count, Allocator& allocator) {
+    // a Single child needs no layout block
+    if (children || count <= 1) {
+        return;
+    }
+    uintptr_t c;
+    if (count <= 4) {
+        c = reinterpret_cast<uintptr_t>(newBlock<Children4>(Kind::Node4, allocator));
+    } else if (count <= 16) {
+        c = reinterpret_cast<uintptr_t>(newBlock<Children16>(Kind::Node16, allocator));
+    } else if (count <= 48) {
+        Children48* b = newBlock<Children48>(Kind::Node48, allocator);
+        std::memset(b->index, Children48::emptySlot, sizeof(b->index));
+        c = reinterpret_cast<uintptr_t>(b);
+    } else {
+        c = reinterpret_cast<uintptr_t>(newBlock<Children256>(Kind::Node256, allocator));
+    }
+    trieStoreRelease(children, c);
+}
+
+inline TrieNode<char>* TrieNode<char>::getOnlyChild() {
+    uintptr_t c = trieLoadAcquire(children);
+    return isSingle(c) ? single(c) : nullptr;
+}
+
+template <typename Block>
+void TrieNode<char>::loadKeys(const Block* block, uint8_t* keys) {
+    decltype(Block::keyWords) words;
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        words[i] = trieLoadRelaxed(block->keyWords[i]);
+    }
+    std::memcpy(keys, words, sizeof(words));
+}
+
+template <typename Block>
+void TrieNode<char>::storeKeys(Block* block, const uint8_t* keys) {
+    decltype(Block::keyWords) words;
+    std::memcpy(words, keys, sizeof(words));
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        trieStoreRelaxed(block->keyWords[i], words[i]);
+    }
+}
+
+template <typename Block>
+void TrieNode<char>::sortedInsert(Block* block, int count, TrieNode<char>* newNode) {
+    const uint8_t key = static_cast<uint8_t>(newNode->getId());
+    uint8_t keys[sizeof(block->keys)];
+    std::memcpy(keys, block->keys, sizeof(keys));
+    int pos = 0;
+    while (pos < count && keys[pos] < key) {
+        pos++;
+    }
+    std::memmove(keys + pos + 1, keys + pos, count - pos);
+    keys[pos] = key;
+    for (int i = count; i > pos; i--) {
+        trieStoreRelease(block->child[i], block->child[i - 1]);
+    }
+    trieStoreRelease(block->child[pos], newNode);
+    storeKeys(block, keys);
+}
+
+template <typename Block>
+void TrieNode<char>::sortedRemove(Block* block, int count, uint8_t key) {
+    uint8_t keys[sizeof(block->keys)];
+    std::memcpy(keys, block->keys, sizeof(keys));
+    int pos = 0;
+    while (pos < count && keys[pos] != key) {
+        pos++;
+    }
+    if (pos == count) {
+        return;
+    }
+    std::memmove(keys + pos, keys + pos + 1, count - pos - 1);
+    for (int i = pos; i < count - 1; i++) {
+        trieStoreRelease(block->child[i], block->child[i + 1]);
+    }
+    storeKeys(block, keys);
+}
+
+
+/**
+    Make room for one more child, moving to the next layout if the current
+    one is full. The new layout is filled in before it is published.
+**/
+template <typename Allocator>
+void TrieNode<char>::grow(Allocator& allocator) {
+    if (isSingle(children)) {
+        TrieNode<char>* only = single(children);
+        Children4* b = newBlock<Children4>(Kind::Node4, allocator);
+        b->keys[0] = static_cast<uint8_t>(only->getId());
+        b->child[0] = only;
+        b->header.count = 1;
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(b));
+        return;
+    }
+
+    Header* h = header(children);
+    switch (h->kind) {
+    case Kind::Node4: {
+        if (h->count < 4) {
+            break;
+        }
+        Children4* old = block<Children4>(children);
+        Children16* b = newBlock<Children16>(Kind::Node16, allocator);
+        std::memcpy(b->keys, old->keys, sizeof(old->keys));
+        std::memcpy(b->child, old->child, sizeof(old->child));
+        b->header.count = old->header.count;
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(b));
+        trieDelete(allocator, old);
+        break;
+    }
+    case Kind::Node16: {
+        if (h->count < 16) {
+            break;
+        }
+        Children16* old = block<Children16>(children);
+        Children48* b = newBlock<Children48>(Kind::Node48, allocator);
+        std::memset(b->index, Children48::emptySlot, sizeof(b->index));
+        for (int i = 0; i < old->header.count; i++) {
+            b->index[old->keys[i]] = static_cast<uint8_t>(i);
+            b->child[i] = old->child[i];
+        }
+        b->header.count = old->header.count;
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(b));
+        trieDelete(allocator, old);
+        break;
+    }
+    case Kind::Node48: {
+        if (h->count < 48) {
+            break;
+        }
+        Children48* old = block<Children48>(children);
+        Children256* b = newBlock<Children256>(Kind::Node256, allocator);
+        for (int i = 0; i < old->header.count; i++) {
+            b->child[static_cast<uint8_t>(old->child[i]->getId())] = old->child[i];
+        }
+        b->header.count = old->header.count;
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(b));
+        trieDelete(allocator, old);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+    Move to a smaller layout once the child count has dropped well below
+    the capacity of the smaller layout. The gap stops a node flapping
+    between two layouts when a child is added and removed repeatedly.
+**/
+template <typename Allocator>
+void TrieNode<char>::shrink(Allocator& allocator) {
+    if (!children || isSingle(children)) {
+        return;
+    }
+
+    Header* h = header(children);
+    switch (h->kind) {
+    case Kind::Node4: {
+        if (h->count > 1) {
+            break;
+        }
+        Children4* old = block<Children4>(children);
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(old->child[0]) | singleTag);
+        trieDelete(allocator, old);
+        break;
+    }
+    case Kind::Node16: {
+        if (h->count > 3) {
+            break;
+        }
+        Children16* old = block<Children16>(children);
+        Children4* b = newBlock<Children4>(Kind::Node4, allocator);
+        std::memcpy(b->keys, old->keys, h->count);
+        std::memcpy(b->child, old->child, h->count * sizeof(*b->child));
+        b->header.count = h->count;
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(b));
+        trieDelete(allocator, old);
+        break;
+    }
+    case Kind::Node48: {
+        if (h->count > 12) {
+            break;
+        }
+        Children48* old = block<Children48>(children);
+        Children16* b = newBlock<Children16>(Kind::Node16, allocator);
+        int n = 0;
+        for (int key = 0; key < 256; key++) {
+            uint8_t slot = old->index[key];
+            if (slot != Children48::emptySlot) {
+                b->keys[n] = static_cast<uint8_t>(key);
+                b->child[n] = old->child[slot];
+                n++;
+            }
+        }
+        b->header.count = static_cast<uint16_t>(n);
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(b));
+        trieDelete(allocator, old);
+        break;
+    }
+    case Kind::Node256: {
+        if (h->count > 40) {
+            break;
+        }
+        Children256* old = block<Children256>(children);
+        Children48* b = newBlock<Children48>(Kind::Node48, allocator);
+        std::memset(b->index, Children48::emptySlot, sizeof(b->index));
+        int n = 0;
+        for (int key = 0; key < 256; key++) {
+            if (old->child[key]) {
+                b->index[key] = static_cast<uint8_t>(n);
+                b->child[n] = old->child[key];
+                n++;
+            }
+        }
+        b->header.count = static_cast<uint16_t>(n);
+        trieStoreRelease(children, reinterpret_cast<uintptr_t>(b));
+        trieDelete(allocator, old);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+template <typename Function>
+void TrieNode<char>::forEachChild(Function f) {
+    uintptr_t c = trieLoadAcquire(children);
+    if (!c) {
+        return;
+    }
+    if (isSingle(c)) {
+        f(single(c));
+        return;
+    }
+    switch (header(c)->kind) {
+    case Kind::Node4: {
+        Children4* b = block<Children4>(c);
+        int count = std::min<int>(trieLoadRelaxed(b->header.count), 4);
+        for (int i = 0; i < count; i++) {
+            f(trieLoadAcquire(b->child[i]));
+        }
+        break;
+    }
+    case Kind::Node16: {
+        Children16* b = block<Children16>(c);
+        int count = std::min<int>(trieLoadRelaxed(b->header.count), 16);
+        for (int i = 0; i < count; i++) {
+            f(trieLoadAcquire(b->child[i]));
+        }
+        break;
+    }
+    case Kind::Node48: {
+        Children48* b = block<Children48>(c);
+        for (int key = 0; key < 256; key++) {
+            uint8_t slot = trieLoadRelaxed(b->index[key]);
+            if (slot < 48) {
+                f(trieLoadAcquire(b->child[slot]));
+            }
+        }
+        break;
+    }
+    case Kind::Node256: {
+        Children256* b = block<Children256>(c);
+        for (auto& slot : b->child) {
+            if (TrieNode<char>* child = trieLoadAcquire(slot)) {
+                f(child);
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+    Free the current child layout, the children themselves belong to
+    the TrieImpl.
+**/
+template <typename Allocator>
+void TrieNode<char>::releaseChildren(Allocator& allocator) {
+    uintptr_t c = children;
+    trieStoreRelaxed(children, uintptr_t(0));
+    if (!c || isSingle(c)) {
+        return;
+    }
+    switch (header(c)->kind) {
+    case Kind::Node4:
+        trieDelete(allocator, block<Children4>(c));
+        break;
+    case Kind::Node16:
+        trieDelete(allocator, block<Children16>(c));
+        break;
+    case Kind::Node48:
+        trieDelete(allocator, block<Children48>(c));
+        break;
+    case Kind::Node256:
+        trieDelete(allocator, block<Children256>(c));
+        break;
+    default:
+        break;
     }
 }
@@ -8,29 +8,71 @@
 
     Written because doing is my favourite way of learning.
 
-    TODO: Add iterator interface and full destructor
+    Nodes do not own their children, the TrieImpl which created them
+    allocates and frees every node through its allocator. Any node method
+    which may allocate or free memory takes that allocator.
+
+    Ordered iteration is TrieImpl::Cursor, which orders each node's
+    children with the node's idLess.
 
     Jim Walker (jim.w.walker@gmail.com)
 **/
 
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include "utilities/trie_allocator.h"
+#include "utilities/trie_olc.h"
+#include "utilities/trie_simd.h"
+
+/**
+    A node's segment as one consistent read, see TrieNodeBase::getSegmentView
+**/
+template <typename K>
+struct TrieSegmentView {
+    const K* data;
+    uint32_t length;
+};
+
 template <typename K>
 class TrieNodeBase {
 public:
 
     TrieNodeBase<K> ()
-      : terminates(false) {}
+      : terminates(false),
+        segment(nullptr) {}
 
     TrieNodeBase<K> (K id)
       : identifier(id),
-        terminates(false) {}
+        terminates(false),
+        segment(nullptr) {}
+
+    TrieNodeBase(const TrieNodeBase<K>&) = delete;
+    TrieNodeBase<K>& operator=(const TrieNodeBase<K>&) = delete;
 
     /**
         Return the node's id
     **/
     K getId() const {
-        return identifier;
+        return trieLoadRelaxed(identifier);
+    }
+
+    /**
+        Change the node's id.
+        Only valid whilst the node is not linked to a parent.
+    **/
+    void setId(K id) {
+        trieStoreRelaxed(identifier, id);
     }
 
     /**
@@ -38,26 +80,340 @@ public:
         Terminates should be set if this node marks the end of a key.
     **/
     void setTerminates(bool value) {
-        terminates = value;
+        trieStoreRelaxed(terminates, value);
     }
 
     /**
         Returns the value of the terminates flag.
     **/
     bool isTerminator() const {
-        return terminates;
+        return trieLoadRelaxed(terminates);
+    }
+
+    /**
+        Clear the terminates flag, the node no longer ends a key.
+        A TrieMapNode frees its value with allocator.
+    **/
+    template <typename Allocator>
+    void clearTerminator(Allocator&) {
+        trieStoreRelaxed(terminates, false);
+    }
+
+    /**
+        The version lock used by optimistic lock coupling (trie_olc.h).
+    **/
+    TrieVersionLock& getLock() const {
+        return lock;
+    }
+
+    /**
+        The segment is the run of key elements which follow the id on the
+        edge into this node. Path compressed tries collapse a chain of
+        single child nodes into one node, the chain is stored here.
+        An expanded trie always has an empty segment.
+
+        The length is stored at the front of the segment's memory so that
+        the view is taken from a single read of the segment pointer.
+    **/
+    TrieSegmentView<K> getSegmentView() const {
+        const SegmentBlock* block = trieLoadAcquire(segment);
+        if (!block) {
+            return {nullptr, 0};
+        }
+        return {segmentData(block), block->length};
+    }
+
+    const K* getSegment() const {
+        return getSegmentView().data;
+    }
+
+    /**
+        Start loading the segment, see TrieImpl::visitBatch.
+    **/
+    void prefetchSegment() const {
+        triePrefetch(trieLoadRelaxed(segment));
+    }
+
+    uint32_t getSegmentLength() const {
+        return getSegmentView().length;
+    }
+
+    /**
+        Bytes allocated for the segment.
+    **/
+    size_t getSegmentBytes() const {
+        const SegmentBlock* block = trieLoadAcquire(segment);
+        return block ? segmentBytes(block->length) : 0;
+    }
+
+    /**
+        Replace the segment with the elements of [begin, end).
+    **/
+    template <typename Itr, typename Allocator>
+    void setSegment(Itr begin, Itr end, Allocator& allocator) {
+        uint32_t length = static_cast<uint32_t>(std::distance(begin, end));
+        SegmentBlock* block = nullptr;
+        if (length) {
+            block = static_cast<SegmentBlock*>(allocator.allocate(segmentBytes(length)));
+            block->length = length;
+            std::uninitialized_copy(begin, end, segmentData(block));
+        }
+        releaseSegment(allocator);
+        trieStoreRelease(segment, block);
+    }
+
+    /**
+        Replace the segment with [begin, end), then element, then the
+        current segment. Used to merge a node into its only child, the
+        merged segment is built straight into the new block.
+    **/
+    template <typename Itr, typename Allocator>
+    void prependSegment(Itr begin, Itr end, const K& element, Allocator& allocator) {
+        const SegmentBlock* old = segment;
+        const uint32_t oldLength = old ? old->length : 0;
+        const uint32_t length = static_cast<uint32_t>(std::distance(begin, end)) + 1 + oldLength;
+        SegmentBlock* block = static_cast<SegmentBlock*>(allocator.allocate(segmentBytes(length)));
+        block->length = length;
+        K* out = std::uninitialized_copy(begin, end, segmentData(block));
+        new (out++) K(element);
+        if (old) {
+            std::uninitialized_copy(segmentData(old), segmentData(old) + oldLength, out);
+        }
+        releaseSegment(allocator);
+        trieStoreRelease(segment, block);
+    }
+
+    /**
+        Free the segment.
+    **/
+    template <typename Allocator>
+    void releaseSegment(Allocator& allocator) {
+        if (segment) {
+            K* data = segmentData(segment);
+            for (uint32_t i = 0; i < segment->length; i++) {
+                data[i].~K();
+            }
+            allocator.deallocate(segment, segmentBytes(segment->length));
+        }
+        trieStoreRelaxed(segment, static_cast<SegmentBlock*>(nullptr));
     }
 
 private:
+
+    struct SegmentBlock {
+        uint32_t length;
+    };
+
+    static const size_t segmentHeader = alignof(K) > sizeof(SegmentBlock) ?
+                                        alignof(K) : sizeof(SegmentBlock);
+
+    static K* segmentData(const SegmentBlock* block) {
+        return reinterpret_cast<K*>(const_cast<char*>(
+            reinterpret_cast<const char*>(block) + segmentHeader));
+    }
+
+    static size_t segmentBytes(uint32_t length) {
+        return segmentHeader + length * sizeof(K);
+    }
+
     K identifier;
     bool terminates;
+    mutable TrieVersionLock lock;
+    SegmentBlock* segment;
 };
 
 /**
-    Generic TrieNode
+    Is K a key which can be packed and searched with trie_simd.h?
+**/
+template <typename K>
+struct TrieIsPackable {
+    static const bool value = std::is_integral<K>::value &&
+                              !std::is_same<K, bool>::value;
+};
+
+/**
+    Approximate bytes allocated by an unordered_map, the bucket array and
+    one allocation per element holding the next pointer, the element and
+    (libstdc++ caches it for most keys) the hash.
+**/
+template <typename K, typename Node>
+size_t trieMapBytes(const std::unordered_map<K, Node*>& map) {
+    return map.bucket_count() * sizeof(void*) +
+           map.size() * (sizeof(void*) + sizeof(std::pair<const K, Node*>) + sizeof(size_t));
+}
+
+/**
+    Children of a generic TrieNode.
 
     The children of the node are in an unordered_map this
-    gives good space and speed.
+    gives good space and speed for any hashable K.
+**/
+template <typename K, typename Node, bool Packed = TrieIsPackable<K>::value>
+class TrieNodeChildren {
+public:
+
+    Node* find(K id);
+
+    template <typename Allocator>
+    void add(Node* newNode, Allocator& allocator);
+
+    bool empty() const {
+        return children.empty();
+    }
+
+    template <typename Allocator>
+    Node* unlink(K id, Allocator& allocator);
+
+    Node* replace(Node* newNode);
+
+    Node* only();
+
+    template <typename Allocator>
+    void reserve(size_t count, Allocator&) {
+        children.reserve(count);
+    }
+
+    template <typename Allocator>
+    void release(Allocator&) {
+        children.clear();
+    }
+
+    template <typename Function>
+    void forEach(Function f);
+
+    void prefetch() const {}
+
+    size_t size() const {
+        return children.size();
+    }
+
+    size_t getMemoryBytes() const {
+        return trieMapBytes(children);
+    }
+
+private:
+    std::unordered_map<K, Node*> children;
+};
+
+/**
+    Children of a generic TrieNode for integral K.
+
+    The children are a flat array sorted by id, so there is no hash table
+    per node and forEach gives them in key order. A single child (most
+    nodes of long integer sequences) is held inline with its id, with no
+    allocation. Wider nodes have one allocation, ids first then the child
+    pointers, which grows 4 -> 16 and then doubles, shrinking again as
+    children are unlinked.
+
+    Up to searchWindow ids are searched with one or two vector compares
+    (trieFindKey). Wider arrays first try the window where id would be
+    if the ids were evenly spread, then binary search down to a window.
+**/
+template <typename K, typename Node>
+class TrieNodeChildren<K, Node, true> {
+public:
+
+    TrieNodeChildren()
+      : keys(nullptr),
+        singleId(),
+        count(0),
+        capacity(0) {}
+
+    TrieNodeChildren(const TrieNodeChildren&) = delete;
+    TrieNodeChildren& operator=(const TrieNodeChildren&) = delete;
+
+    Node* find(K id);
+
+    template <typename Allocator>
+    void add(Node* newNode, Allocator& allocator);
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    template <typename Allocator>
+    Node* unlink(K id, Allocator& allocator);
+
+    Node* replace(Node* newNode);
+
+    Node* only();
+
+    template <typename Allocator>
+    void reserve(size_t count, Allocator& allocator);
+
+    template <typename Allocator>
+    void release(Allocator& allocator) {
+        resize(0, allocator);
+        count = 0;
+        single = nullptr;
+    }
+
+    template <typename Function>
+    void forEach(Function f);
+
+    void prefetch() const {
+        triePrefetch(keys);
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t getMemoryBytes() const {
+        return capacity ? blockSize(capacity) : 0;
+    }
+
+private:
+
+    static const uint32_t searchWindow = 16;
+
+    bool isInline() const {
+        return capacity == 0;
+    }
+
+    Node** childArray() const {
+        return reinterpret_cast<Node**>(reinterpret_cast<char*>(keys) +
+                                        childOffset(capacity));
+    }
+
+    static size_t childOffset(uint32_t capacity) {
+        size_t bytes = capacity * sizeof(K);
+        return (bytes + alignof(Node*) - 1) & ~(alignof(Node*) - 1);
+    }
+
+    static size_t blockSize(uint32_t capacity) {
+        return childOffset(capacity) + capacity * sizeof(Node*);
+    }
+
+    /**
+        The index of id in the array, or -1. Not for an inline child.
+    **/
+    int indexOf(K id) const;
+
+    /**
+        Move the children into an array of newCapacity (0 for inline,
+        which needs count <= 1).
+    **/
+    template <typename Allocator>
+    void resize(uint32_t newCapacity, Allocator& allocator);
+
+    union {
+        K* keys;
+        // the inline child when capacity is 0
+        Node* single;
+    };
+    // the id of the inline child, a node's id may change (see
+    // TrieImpl::splitNode) before it is replaced in its parent
+    K singleId;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+/**
+    Generic TrieNode
+
+    The children of the node are held in a TrieNodeChildren, an
+    unordered_map or for integral K a sorted flat array.
 **/
 template <typename K>
 class TrieNode : public TrieNodeBase<K> {
@@ -76,9 +432,9 @@ public:
 
     /**
         Add a child node to this node with id.
-        The new node is returned.
     **/
-    void addChild(TrieNode<K>* newNode);
+    template <typename Allocator>
+    void addChild(TrieNode<K>* newNode, Allocator& allocator);
 
     /**
         Returns true if this node has any children.
@@ -86,36 +442,151 @@ public:
     **/
     bool hasChildren();
 
-    void unlinkChild(K id);
+    /**
+        Remove the child which matches 'id' and hand it to the caller
+        to free. Return nullptr if no matching child is found.
+    **/
+    template <typename Allocator>
+    TrieNode<K>* unlinkChild(K id, Allocator& allocator);
+
+    /**
+        Swap the child with the same id as newNode for newNode.
+        The previous child is returned to the caller.
+    **/
+    TrieNode<K>* replaceChild(TrieNode<K>* newNode);
+
+    /**
+        Return the child if this node has exactly one, else nullptr.
+    **/
+    TrieNode<K>* getOnlyChild();
+
+    /**
+        A node with no children is about to have 'count' added, set up
+        the child storage for that many at once.
+    **/
+    template <typename Allocator>
+    void reserveChildren(size_t count, Allocator& allocator) {
+        children.reserve(count, allocator);
+    }
+
+    /**
+        The order of child ids (and so of keys). forEachChild gives the
+        children in this order only for integral K.
+    **/
+    static const bool orderedChildren = TrieIsPackable<K>::value;
+
+    static bool idLess(const K& a, const K& b) {
+        return a < b;
+    }
+
+    /**
+        Call f(TrieNode<K>*) for every child.
+    **/
+    template <typename Function>
+    void forEachChild(Function f) {
+        children.forEach(f);
+    }
+
+    /**
+        Start loading the child storage which findChild will read.
+    **/
+    void prefetchChildren() const {
+        children.prefetch();
+    }
+
+    /**
+        Return the number of children.
+    **/
+    int getChildCount() const {
+        return static_cast<int>(children.size());
+    }
+
+    /**
+        Bytes allocated for the child storage (approximate for a map).
+    **/
+    size_t getChildBytes() const {
+        return children.getMemoryBytes();
+    }
+
+    /**
+        Bytes of the node given to a value, see TrieMapNode.
+    **/
+    static const size_t valueBytes = 0;
+
+    /**
+        Bytes allocated outside the node for the value of each key it
+        ends, see TrieMapNode.
+    **/
+    static const size_t keyValueBytes = 0;
+
+    /**
+        True if release must be called to destroy a value even where the
+        allocator frees all of its memory at once.
+    **/
+    static const bool releaseValues = false;
+
+    /**
+        Free the memory this node owns (segment and child storage) ready
+        for the node itself to be freed. The children are not touched.
+    **/
+    template <typename Allocator>
+    void release(Allocator& allocator) {
+        this->releaseSegment(allocator);
+        children.release(allocator);
+    }
 
 private:
-    std::unordered_map<K, std::unique_ptr<TrieNode<K> > > children;
+    TrieNodeChildren<K, TrieNode<K> > children;
 };
 
 /**
     TrieNode<char> specialisation
 
-    The children of the node are represented by either
-      - empty vector (no children)
-      - vector of 1 for 1 child
-      - vector of 256 for >2 child
+    The children of the node are held in one of an adaptive family of
+    layouts (in the style of an adaptive radix tree). The node grows into
+    the next layout on addChild and shrinks back on unlinkChild.
+
+      - Empty    no children
+      - Single   1 child, the child pointer is stored inline
+      - Node4    up to 4 children, sorted key bytes + child pointers
+      - Node16   up to 16 children, sorted key bytes + child pointers
+      - Node48   up to 48 children, 256 byte index into 48 child pointers
+      - Node256  up to 256 children, child pointer per byte value
+
+    Key bytes are always treated as unsigned so that all 256 values of a
+    char can be stored.
 
-    This gives a good performance/size trade-off
+    Most inner nodes have a handful of children, so this gives a much
+    better size trade-off than jumping straight to 256 slots.
 
-    (a raw array[256] is the fastest but eats RAM)
+    The node itself only holds one pointer for its children. A Single
+    child is stored with the low bit set, otherwise the pointer is to a
+    layout block which starts with its kind and count. Everything about
+    the layout is therefore taken from one read of the pointer, which
+    keeps an optimistic reader racing a writer inside one block.
 **/
 template<>
 class TrieNode<char> : public TrieNodeBase<char> {
 public:
 
+    enum class Kind : uint8_t {
+        Empty,
+        Single,
+        Node4,
+        Node16,
+        Node48,
+        Node256
+    };
+
     TrieNode()
-      : children(0),
-        count(0) {}
+      : children(0) {}
 
     TrieNode(char id)
       : TrieNodeBase<char>(id),
-        children(0),
-        count(0) {}
+        children(0) {}
+
+    TrieNode(const TrieNode<char>&) = delete;
+    TrieNode<char>& operator=(const TrieNode<char>&) = delete;
 
     /**
         Find the child node which matches 'id'.
@@ -125,9 +596,9 @@ public:
 
     /**
         Add a child node to this node with id.
-        The new node is returned.
     **/
-    void addChild(TrieNode<char>* newNode);
+    template <typename Allocator>
+    void addChild(TrieNode<char>* newNode, Allocator& allocator);
 
     /**
         Returns true if this node has any children.
@@ -135,14 +606,205 @@ public:
     **/
     bool hasChildren();
 
-    void unlinkChild(char id);
+    /**
+        Remove the child which matches 'id' and hand it to the caller
+        to free. Return nullptr if no matching child is found.
+    **/
+    template <typename Allocator>
+    TrieNode<char>* unlinkChild(char id, Allocator& allocator);
+
+    /**
+        Swap the child with the same id as newNode for newNode.
+        The previous child is returned to the caller.
+    **/
+    TrieNode<char>* replaceChild(TrieNode<char>* newNode);
+
+    /**
+        Return the child if this node has exactly one, else nullptr.
+    **/
+    TrieNode<char>* getOnlyChild();
+
+    /**
+        A node with no children is about to have 'count' added, start
+        with the layout which holds them rather than growing into it.
+    **/
+    template <typename Allocator>
+    void reserveChildren(size_t count, Allocator& allocator);
+
+    /**
+        The order of child ids (and so of keys), unsigned bytes as
+        std::string compares them. forEachChild gives this order.
+    **/
+    static const bool orderedChildren = true;
+
+    static bool idLess(char a, char b) {
+        return static_cast<uint8_t>(a) < static_cast<uint8_t>(b);
+    }
+
+    /**
+        Call f(TrieNode<char>*) for every child, in unsigned byte order.
+    **/
+    template <typename Function>
+    void forEachChild(Function f);
+
+    /**
+        Start loading the child layout which findChild will read, its
+        header and keys (the first two cache lines).
+    **/
+    void prefetchChildren() const {
+        const uintptr_t c = trieLoadAcquire(children);
+        if (c && !isSingle(c)) {
+            triePrefetch(reinterpret_cast<const char*>(c));
+            triePrefetch(reinterpret_cast<const char*>(c) + 64);
+        }
+    }
+
+    /**
+        Free the memory this node owns (segment and child layout) ready
+        for the node itself to be freed. The children are not touched.
+    **/
+    template <typename Allocator>
+    void release(Allocator& allocator) {
+        releaseSegment(allocator);
+        releaseChildren(allocator);
+    }
+
+    /**
+        Return the current child layout.
+    **/
+    Kind getKind() const;
+
+    /**
+        Return the number of children.
+    **/
+    int getChildCount() const;
+
+    /**
+        Bytes allocated for the child layout.
+    **/
+    size_t getChildBytes() const;
+
+    /**
+        Bytes of the node given to a value, see TrieMapNode.
+    **/
+    static const size_t valueBytes = 0;
+
+    /**
+        Bytes allocated outside the node for the value of each key it
+        ends, see TrieMapNode.
+    **/
+    static const size_t keyValueBytes = 0;
+
+    /**
+        True if release must be called to destroy a value even where the
+        allocator frees all of its memory at once.
+    **/
+    static const bool releaseValues = false;
 
 private:
-    std::vector<std::unique_ptr<TrieNode<char> > > children;
-    int count;
+
+    static const uintptr_t singleTag = 1;
+
+    struct Header {
+        Kind kind;
+        uint8_t pad;
+        uint16_t count;
+    };
+
+    // The keys are also words, so a reader loads them whole (see
+    // loadKeys). The blocks are no bigger for it.
+    struct Children4 {
+        Header header;
+        union {
+            uint8_t keys[4];
+            uint32_t keyWords[1];
+        };
+        TrieNode<char>* child[4];
+    };
+
+    struct Children16 {
+        Header header;
+        union {
+            uint8_t keys[16];
+            uint64_t keyWords[2];
+        };
+        TrieNode<char>* child[16];
+    };
+
+    struct Children48 {
+        static const uint8_t emptySlot = 0xff;
+        Header header;
+        uint8_t index[256];
+        TrieNode<char>* child[48];
+    };
+
+    struct Children256 {
+        Header header;
+        TrieNode<char>* child[256];
+    };
+
+    static bool isSingle(uintptr_t c) {
+        return c & singleTag;
+    }
+
+    static TrieNode<char>* single(uintptr_t c) {
+        return reinterpret_cast<TrieNode<char>*>(c & ~singleTag);
+    }
+
+    static Header* header(uintptr_t c) {
+        return reinterpret_cast<Header*>(c);
+    }
+
+    template <typename Block>
+    static Block* block(uintptr_t c) {
+        return reinterpret_cast<Block*>(c);
+    }
+
+    template <typename Block, typename Allocator>
+    static Block* newBlock(Kind kind, Allocator& allocator);
+
+    /**
+        Copy the keys of a Node4/Node16 block to/from keys (sizeof
+        block->keys bytes) a word at a time, see trieLoadRelaxed.
+    **/
+    template <typename Block>
+    static void loadKeys(const Block* block, uint8_t* keys);
+
+    template <typename Block>
+    static void storeKeys(Block* block, const uint8_t* keys);
+
+    /**
+        Sorted insert/remove on the Node4/Node16 key+child arrays.
+    **/
+    template <typename Block>
+    static void sortedInsert(Block* block, int count, TrieNode<char>* newNode);
+
+    template <typename Block>
+    static void sortedRemove(Block* block, int count, uint8_t key);
+
+    template <typename Allocator>
+    void grow(Allocator& allocator);
+
+    template <typename Allocator>
+    void shrink(Allocator& allocator);
+
+    template <typename Allocator>
+    void releaseChildren(Allocator& allocator);
+
+    uintptr_t children;
 };
 
-template <typename K, typename V>
+/**
+    A TrieNode which maps the key it ends to a V.
+
+    Most nodes of a trie do not end a key, so by default only the nodes
+    which do hold a value. The value is move constructed in a slot from
+    the node's allocator (with a TrieArenaAllocator a side slab of
+    sizeof(V) slots) when the node becomes a terminator, the node keeping
+    a pointer to it, and destroyed when it stops being one. A V no bigger
+    than that pointer is cheaper inline, Inline gives every node a V.
+**/
+template <typename K, typename V, bool Inline = (sizeof(V) <= sizeof(V*))>
 class TrieMapNode : public TrieNode<K> {
 
 public:
@@ -152,24 +814,125 @@ public:
     TrieMapNode(K id)
       : TrieNode<K>(id) {}
 
-    TrieMapNode<K, V>* findChild(K id) {
-        return reinterpret_cast<TrieMapNode<K, V>* >(TrieNode<K>::findChild(id));
+    /**
+        Every node has a value slot, whether or not it ends a key.
+    **/
+    static const size_t valueBytes = sizeof(V);
+
+    TrieMapNode* findChild(K id) {
+        return static_cast<TrieMapNode*>(TrieNode<K>::findChild(id));
     }
 
+    /**
+        An optimistic reader copies the value out as a writer may store
+        it, see trieLoadRelaxed.
+    **/
     V getValue() const {
-        return value;
+        return trieLoadRelaxed(value);
     }
 
     V& getReferenceValue() {
         return value;
     }
 
-    void setValue(V value) {
-        this->value = value;
+    template <typename T, typename Allocator>
+    void setValue(T&& value, Allocator&) {
+        trieStoreRelaxed(this->value, V(std::forward<T>(value)));
+    }
+
+    /**
+        The node no longer ends a key, so drop the value it held.
+    **/
+    template <typename Allocator>
+    void clearTerminator(Allocator&) {
+        this->setTerminates(false);
+        trieStoreRelaxed(value, V());
     }
 
 private:
     V value;
 };
 
-#include "utilities/trienode.cc"
\ No newline at end of file
+template <typename K, typename V>
+class TrieMapNode<K, V, false> : public TrieNode<K> {
+
+public:
+    TrieMapNode()
+      : TrieNode<K>(),
+        value(nullptr) {}
+
+    TrieMapNode(K id)
+      : TrieNode<K>(id),
+        value(nullptr) {}
+
+    /**
+        The node holds a pointer to its value, the value itself is only
+        allocated for a terminator.
+    **/
+    static const size_t valueBytes = sizeof(V*);
+
+    static const size_t keyValueBytes = sizeof(V);
+
+    static const bool releaseValues = !std::is_trivially_destructible<V>::value;
+
+    TrieMapNode* findChild(K id) {
+        return static_cast<TrieMapNode*>(TrieNode<K>::findChild(id));
+    }
+
+    /**
+        The value, only valid for a terminator (which setValue was called
+        on).
+    **/
+    V getValue() const {
+        return *value;
+    }
+
+    V& getReferenceValue() {
+        return *value;
+    }
+
+    /**
+        Assign the value, or move/copy construct it from value into a new
+        slot if the node has none.
+    **/
+    template <typename T, typename Allocator>
+    void setValue(T&& value, Allocator& allocator) {
+        if (this->value) {
+            *this->value = std::forward<T>(value);
+        } else {
+            this->value = trieNew<V>(allocator, std::forward<T>(value));
+        }
+    }
+
+    /**
+        The node no longer ends a key, so destroy and free its value.
+    **/
+    template <typename Allocator>
+    void clearTerminator(Allocator& allocator) {
+        this->setTerminates(false);
+        releaseValue(allocator);
+    }
+
+    /**
+        Free the value as well as what TrieNode::release frees.
+    **/
+    template <typename Allocator>
+    void release(Allocator& allocator) {
+        releaseValue(allocator);
+        TrieNode<K>::release(allocator);
+    }
+
+private:
+
+    template <typename Allocator>
+    void releaseValue(Allocator& allocator) {
+        if (value) {
+            trieDelete(allocator, value);
+            value = nullptr;
+        }
+    }
+
+    V* value;
+};
+
+#include "utilities/trienode.cc"